@@ -0,0 +1,69 @@
+/**
+ * @file cache.c
+ * @brief Tool that writes the pre-normalized cache files of the MNIST training and testing sets
+ * @details Converts the MNIST images once into normalized (float or double, depending on the build) values and
+ * stores them, together with the labels, in cache files inside the /data folder. The network demo then maps
+ * these files instead of reading and normalizing the original MNIST files on every run.
+ * Usage: mnist-cache [seed]   (if a seed is given, a fixed random training order is stored in the cache)
+ */
+
+
+
+
+// Include external libraries
+#include <stdlib.h>
+
+// Include project libraries
+#include "util/mnist-utils.h"
+#include "util/mnist-loader.h"
+#include "random.h"
+
+
+
+
+/**
+ * @brief Writes the cache file of a data set
+ * @param cacheFileName The name of the cache file to be written
+ * @param imageFileName The name of the MNIST image file
+ * @param labelFileName The name of the MNIST label file
+ * @param rng A pointer to the random number generator used to shuffle a fixed sample order (NULL = no order)
+ */
+
+void createCacheFile(char *cacheFileName, char *imageFileName, char *labelFileName, Random *rng){
+    
+    MNIST_Dataset *dataset = openMNISTDataset(imageFileName, labelFileName);
+    
+    int *order = NULL;
+    
+    if (rng != NULL){
+        order = createSampleOrder(dataset->count);
+        shuffleSampleOrder(order, dataset->count, rng);
+    }
+    
+    writeMNISTCache(dataset, order, cacheFileName);
+    
+    printf("Wrote %s (%d images%s)\n", cacheFileName, dataset->count, (rng != NULL) ? ", fixed order" : "");
+    
+    free(order);
+    closeMNISTDataset(dataset);
+}
+
+
+
+
+/**
+ * @details Writes the cache files of the MNIST training and testing sets
+ */
+
+int main(int argc, const char * argv[]) {
+    
+    int shuffle = (argc > 1);
+    
+    Random rng;
+    seedRandom(&rng, shuffle ? strtoull(argv[1], NULL, 10) : 0, RANDOM_STREAM_SHUFFLE, 0);
+    
+    createCacheFile(MNIST_TRAINING_SET_CACHE_FILE_NAME, MNIST_TRAINING_SET_IMAGE_FILE_NAME, MNIST_TRAINING_SET_LABEL_FILE_NAME, shuffle ? &rng : NULL);
+    createCacheFile(MNIST_TESTING_SET_CACHE_FILE_NAME, MNIST_TESTING_SET_IMAGE_FILE_NAME, MNIST_TESTING_SET_LABEL_FILE_NAME, NULL);
+    
+    return 0;
+}
@@ -0,0 +1,300 @@
+/**
+ * @file check-backprop.c
+ * @brief Check verifying that back propagating through the transposed weights gives the same errors as the former
+ * forward connections
+ * @details Nodes used to store forward connections, through which each node pulled its error from the nodes of the
+ * following layer (errorSum = sum of the following nodes' errors times the connections' weights). Errors are now
+ * pushed backward through the following layer's weights instead: by transposed matrix-vector products and transposed
+ * convolutions (dense engine) or along the following nodes' backward connections (graph engine).
+ * This check rebuilds the forward connections from the backward connections, in the order in which they used to be
+ * created, and recalculates the error of each hidden node the old way (in double precision). The results are compared
+ * after back propagating random images with both engines and several thread counts, using a learning rate of 0 so
+ * that the weights don't change. Since the sums are accumulated in a different order (and the vectorized kernels
+ * approximate the derivatives), a node's error is measured relative to the sum of the absolute values of its terms,
+ * in multiples of the machine epsilon of Weight, and must not exceed BACKPROP_TOLERANCE.
+ * Usage: check-backprop   (exits with 1 if any error exceeds the tolerance)
+ */
+
+
+
+
+// Include external libraries
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+// Include project libraries
+#include "dnn.h"
+#include "kernels.h"
+#include "random.h"
+
+#ifdef USE_FLOAT
+#define WEIGHT_EPSILON FLT_EPSILON
+#else
+#define WEIGHT_EPSILON DBL_EPSILON
+#endif
+
+/// Define the maximum error (in multiples of WEIGHT_EPSILON, see above) of a back propagated error
+#define BACKPROP_TOLERANCE 16
+
+/// Define the number of random images that are back propagated per run
+#define CHECK_IMAGE_COUNT 10
+
+/// Define the minimum number of multiply-adds per parallel task (small, so that the layers are split)
+#define CHECK_GRAIN_SIZE 256
+
+/// Define the seed of the random images and labels
+#define CHECK_SEED 2016
+
+/// Define the size of the (random) images
+#define CHECK_IMAGE_SIZE (28*28)
+
+/// Define the number of layers of the checked network
+#define CHECK_LAYER_COUNT 5
+
+
+
+
+/**
+ * @brief Data structure holding the forward connections of all nodes of a layer (as they used to be stored)
+ */
+
+typedef struct ForwardConnections{
+    int *first;                 // index of each node's first forward connection (nodeCount+1 entries)
+    int *nodeIds;               // node of the following layer that each forward connection points to
+    int *weightIds;             // weight (inside the following layer's weights) of each forward connection
+} ForwardConnections;
+
+
+
+
+/**
+ * @brief Returns the layer definitions of the checked network (convolutional, fully connected and output layers)
+ * @attention The network refers to the layer definitions, i.e. they must be freed after the network
+ */
+
+LayerDefinition *getCheckLayerDefinitions(void){
+
+    LayerDefinition inputLayer  = {.layerType=INPUT, .nodeMap=(Volume){.width=28, .height=28}};
+    LayerDefinition convLayer   = {.layerType=CONVOLUTIONAL, .activationType=RELU, .nodeMap=(Volume){.width=13, .height=13, .depth=5}, .filter=5};
+    LayerDefinition convLayer2  = {.layerType=CONVOLUTIONAL, .activationType=RELU, .nodeMap=(Volume){.width=6, .height=6, .depth=5}, .filter=3};
+    LayerDefinition denseLayer  = {.layerType=FULLY_CONNECTED, .activationType=TANH, .nodeMap=(Volume){.width=60}};
+    LayerDefinition outputLayer = {.layerType=OUTPUT, .activationType=RELU, .nodeMap=(Volume){.width=10}};
+
+    return setLayerDefinitions(CHECK_LAYER_COUNT, inputLayer, convLayer, convLayer2, denseLayer, outputLayer);
+}
+
+
+
+
+/**
+ * @brief Rebuilds the forward connections of a layer's nodes from the backward connections of the following layer
+ * @details A node's forward connections are ordered like the following layer's nodes and their connections, which is
+ * the order in which they used to be created.
+ * @param layer A pointer to the layer whose nodes get the forward connections
+ * @param nextLayer A pointer to the following layer
+ */
+
+ForwardConnections createForwardConnections(Layer *layer, Layer *nextLayer){
+
+    int nodeCount = getLayerNodeCount(layer->layerDef);
+    int connCount = nextLayer->columnCount * nextLayer->columns[0].nodeCount * getNodeBackwardConnectionCount(nextLayer->layerDef);
+
+    ForwardConnections fc;
+    fc.first     = (int*)calloc(nodeCount+1, sizeof(int));
+    fc.nodeIds   = (int*)malloc(connCount * sizeof(int));
+    fc.weightIds = (int*)malloc(connCount * sizeof(int));
+
+    int *position = (int*)malloc(nodeCount * sizeof(int));
+
+    // Each pass walks all backward connections of the following layer: the 1st pass counts the forward connections
+    // of each node, the 2nd pass stores them
+    for (int pass=0; pass<2; pass++){
+
+        for (int c=0; c<nextLayer->columnCount; c++){
+            for (int n=0; n<nextLayer->columns[0].nodeCount; n++){
+
+                Node *node = getNetworkNode(nextLayer, c, n);
+
+                for (int i=0; i<node->backwardConnCount; i++){
+
+                    Connection *conn = &node->connections[i];
+
+                    if (pass==0) fc.first[conn->nodeId+1]++;
+                    else {
+                        int pos = position[conn->nodeId]++;
+                        fc.nodeIds[pos]   = node->id;
+                        fc.weightIds[pos] = conn->weightId;
+                    }
+                }
+            }
+        }
+
+        if (pass==0){
+            for (int n=0; n<nodeCount; n++) fc.first[n+1] += fc.first[n];
+            memcpy(position, fc.first, nodeCount * sizeof(int));
+        }
+    }
+
+    free(position);
+
+    return fc;
+}
+
+
+
+
+/**
+ * @brief Releases the memory of a layer's forward connections
+ * @param fc A pointer to the forward connections
+ */
+
+void deleteForwardConnections(ForwardConnections *fc){
+
+    free(fc->first);
+    free(fc->nodeIds);
+    free(fc->weightIds);
+}
+
+
+
+
+/**
+ * @brief Returns the maximum error (in multiples of WEIGHT_EPSILON) of a layer's back propagated errors compared with
+ * the errors pulled through the forward connections (including the derivative of the activation function)
+ * @param layer A pointer to the layer whose errors are checked
+ * @param nextLayer A pointer to the following layer
+ * @param fc A pointer to the forward connections of the layer's nodes
+ */
+
+double checkLayerErrors(Layer *layer, Layer *nextLayer, ForwardConnections *fc){
+
+    double maxError = 0;
+
+    for (int n=0; n<getLayerNodeCount(layer->layerDef); n++){
+
+        double errorSum  = 0;
+        double magnitude = 0;
+
+        for (int i=fc->first[n]; i<fc->first[n+1]; i++){
+            double term = (double)nextLayer->errorSums[fc->nodeIds[i]] * (double)nextLayer->weightsPtr[fc->weightIds[i]];
+            errorSum  += term;
+            magnitude += fabs(term);
+        }
+
+        double expected = errorSum * (double)getDerivative(layer->outputs[n], layer->layerDef->activationType);
+
+        // The derivatives don't exceed 1, i.e. the sum of the absolute terms also bounds the error of the derivative
+        double error = fabs((double)layer->errorSums[n] - expected) / (((magnitude>0) ? magnitude : 1) * WEIGHT_EPSILON);
+
+        if (error > maxError) maxError = error;
+    }
+
+    return maxError;
+}
+
+
+
+
+/**
+ * @brief Back propagates the random images and returns the maximum error of all hidden layers' errors
+ * @param nn A pointer to the neural network
+ * @param inputs A pointer to the images
+ * @param labels A pointer to the labels
+ * @param fcs The forward connections of each layer (index = layer id)
+ */
+
+double checkBackPropagation(Network *nn, const Real *inputs, const MNIST_Label *labels, ForwardConnections *fcs){
+
+    double maxError = 0;
+
+    Real *inputBuffer = getNetworkInputBuffer(nn, CHECK_IMAGE_SIZE);
+
+    for (int i=0; i<CHECK_IMAGE_COUNT; i++){
+
+        memcpy(inputBuffer, inputs + (i * CHECK_IMAGE_SIZE), CHECK_IMAGE_SIZE * sizeof(Real));
+
+        feedForwardNetwork(nn);
+        backPropagateNetwork(nn, labels[i]);
+
+        for (int l=1; l<nn->layerCount-1; l++){
+            double error = checkLayerErrors(getNetworkLayer(nn, l), getNetworkLayer(nn, l+1), &fcs[l]);
+            if (error > maxError) maxError = error;
+        }
+    }
+
+    return maxError;
+}
+
+
+
+
+/**
+ * @brief Main function back propagating random images with both engines and comparing the errors
+ */
+
+int main(void){
+
+    static Real inputs[CHECK_IMAGE_COUNT * CHECK_IMAGE_SIZE];
+    static MNIST_Label labels[CHECK_IMAGE_COUNT];
+
+    Random rng;
+    seedRandom(&rng, CHECK_SEED, RANDOM_STREAM_CHECK, 0);
+
+    for (int i=0; i<CHECK_IMAGE_COUNT * CHECK_IMAGE_SIZE; i++) inputs[i] = (Real)getRandomRange(&rng, -1, 1);
+    for (int i=0; i<CHECK_IMAGE_COUNT; i++) labels[i] = (MNIST_Label)getRandomInt(&rng, 10);
+
+    LayerDefinition *layerDefs = getCheckLayerDefinitions();
+
+    Network *nn = createNetwork(CHECK_LAYER_COUNT, layerDefs, NULL);
+
+    // @attention Without weight updates every run back propagates through the same weights
+    nn->learningRate = 0;
+    nn->batchSize    = 1;
+
+    ForwardConnections fcs[CHECK_LAYER_COUNT];
+    for (int l=1; l<CHECK_LAYER_COUNT-1; l++) fcs[l] = createForwardConnections(getNetworkLayer(nn, l), getNetworkLayer(nn, l+1));
+
+    printf("Checking back propagated %d-bit errors against the forward connections (tolerance: %d epsilon)\n", (int)(8 * sizeof(Weight)), BACKPROP_TOLERANCE);
+
+    const EngineType engines[] = {DENSE_ENGINE, GRAPH_ENGINE};
+    const int threadCounts[] = {1, 3};
+
+    bool isPassed = true;
+
+    for (int e=0; e<2; e++){
+        for (int t=0; t<2; t++){
+
+            ThreadPool *pool = createThreadPool(threadCounts[t]);
+            setNetworkThreadPool(nn, pool, CHECK_GRAIN_SIZE);
+            nn->engine = engines[e];
+
+            double error = checkBackPropagation(nn, inputs, labels, fcs);
+            bool isRunPassed = (error <= BACKPROP_TOLERANCE);
+
+            printf("%-6s engine, %d threads                    max error %6.2f epsilon  %s\n", (engines[e]==DENSE_ENGINE) ? "dense" : "graph", threadCounts[t], error, isRunPassed ? "OK" : "FAILED");
+
+            isPassed &= isRunPassed;
+
+            setNetworkThreadPool(nn, NULL, CHECK_GRAIN_SIZE);
+            deleteThreadPool(pool);
+        }
+    }
+
+    for (int l=1; l<CHECK_LAYER_COUNT-1; l++) deleteForwardConnections(&fcs[l]);
+
+    deleteNetwork(nn);
+    free(layerDefs);
+
+    if (!isPassed){
+        printf("Back propagation check FAILED!\n");
+        return 1;
+    }
+
+    printf("All back propagation checks passed.\n");
+
+    return 0;
+}
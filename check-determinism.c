@@ -0,0 +1,271 @@
+/**
+ * @file check-determinism.c
+ * @brief Check verifying that synchronous data-parallel training gives bit-identical weights
+ * @details Trains the same network on the same (random) mini-batches several times and compares hashes of the
+ * resulting weights and biases:
+ * - for a fixed number of shards, training must give the same weights for any number of threads of the thread pool
+ *   (including the nested layer loops of the replicas)
+ * - a single shard must give the same weights as serial mini-batch training (backPropagateNetwork with batchSize)
+ * - serial mini-batch training must give the same weights for any number of threads calculating the layers
+ * Every run starts from the same weights (re-initialized by the run's thread pool). A small grain size is used so
+ * that even the layers of this small network are split into several ranges.
+ * Usage: check-determinism   (exits with 1 if any hash differs)
+ */
+
+
+
+
+// Include external libraries
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+
+// Include project libraries
+#include "dnn.h"
+#include "random.h"
+
+/// Define the number of images per mini-batch
+#define CHECK_BATCH_SIZE 16
+
+/// Define the number of mini-batches that are trained
+#define CHECK_BATCH_COUNT 20
+
+/// Define the number of shards per mini-batch (for the comparison across thread counts)
+#define CHECK_SHARD_COUNT 4
+
+/// Define the minimum number of multiply-adds per parallel task (small, so that the layers are split)
+#define CHECK_GRAIN_SIZE 256
+
+/// Define the seed of the random images and labels
+#define CHECK_SEED 2016
+
+/// Define the size of the (random) images
+#define CHECK_IMAGE_SIZE (28*28)
+
+/// Define the number of layers of the trained network
+#define CHECK_LAYER_COUNT 5
+
+
+
+
+/**
+ * @brief Data structure holding the random mini-batches that every training run is trained on
+ */
+
+typedef struct CheckData{
+    Real inputs[CHECK_BATCH_COUNT * CHECK_BATCH_SIZE * CHECK_IMAGE_SIZE];   // images of all mini-batches
+    MNIST_Label labels[CHECK_BATCH_COUNT * CHECK_BATCH_SIZE];               // labels of all mini-batches
+} CheckData;
+
+
+
+
+/**
+ * @brief Returns the layer definitions of the network that is trained by all runs (convolutional, fully connected
+ * and output layers)
+ * @attention The network refers to the layer definitions, i.e. they must be freed after the network
+ */
+
+LayerDefinition *getCheckLayerDefinitions(void){
+
+    LayerDefinition inputLayer  = {.layerType=INPUT, .nodeMap=(Volume){.width=28, .height=28}};
+    LayerDefinition convLayer   = {.layerType=CONVOLUTIONAL, .activationType=RELU, .nodeMap=(Volume){.width=13, .height=13, .depth=5}, .filter=5};
+    LayerDefinition convLayer2  = {.layerType=CONVOLUTIONAL, .activationType=RELU, .nodeMap=(Volume){.width=6, .height=6, .depth=5}, .filter=3};
+    LayerDefinition denseLayer  = {.layerType=FULLY_CONNECTED, .activationType=TANH, .nodeMap=(Volume){.width=60}};
+    LayerDefinition outputLayer = {.layerType=OUTPUT, .activationType=RELU, .nodeMap=(Volume){.width=10}};
+
+    return setLayerDefinitions(CHECK_LAYER_COUNT, inputLayer, convLayer, convLayer2, denseLayer, outputLayer);
+}
+
+
+
+
+/**
+ * @brief Returns a hash (FNV-1a) of the weights and biases of a network
+ * @param nn A pointer to the neural network
+ */
+
+uint64_t hashNetworkWeights(Network *nn){
+
+    uint64_t hash = 14695981039346656037ULL;
+
+    const uint8_t *bytes = (const uint8_t*)nn->weightsPtr;
+    for (size_t i=0; i<nn->weightCount * sizeof(Weight); i++) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+
+    bytes = (const uint8_t*)nn->biasesPtr;
+    for (size_t i=0; i<nn->nodeCount * sizeof(Weight); i++) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+
+    return hash;
+}
+
+
+
+
+/**
+ * @brief Re-initializes the weights of a network using a new thread pool, and returns the pool
+ * @param nn A pointer to the neural network
+ * @param threadCount Number of threads of the thread pool
+ */
+
+ThreadPool *resetCheckNetwork(Network *nn, int threadCount){
+
+    ThreadPool *pool = createThreadPool(threadCount);
+    setNetworkThreadPool(nn, pool, CHECK_GRAIN_SIZE);
+
+    initNetworkWeights(nn, DEFAULT_WEIGHT_SEED);
+
+    return pool;
+}
+
+
+
+
+/**
+ * @brief Trains a network by synchronous data-parallel training and returns the hash of its weights
+ * @param nn A pointer to the neural network
+ * @param data A pointer to the mini-batches
+ * @param threadCount Number of threads of the thread pool
+ * @param shardCount Number of shards per mini-batch
+ */
+
+uint64_t trainShardedNetwork(Network *nn, CheckData *data, int threadCount, int shardCount){
+
+    ThreadPool *pool = resetCheckNetwork(nn, threadCount);
+
+    // The replicas use the network's pool for their layers as well (nested parallel loops)
+    Network **replicas = (Network**)malloc(shardCount * sizeof(Network*));
+    for (int s=0; s<shardCount; s++){
+        replicas[s] = createNetworkReplica(nn);
+        replicas[s]->batchSize = INT_MAX;
+        setNetworkThreadPool(replicas[s], pool, CHECK_GRAIN_SIZE);
+    }
+
+    for (int b=0; b<CHECK_BATCH_COUNT; b++){
+        int first = b * CHECK_BATCH_SIZE;
+        trainNetworkShards(nn, replicas, shardCount, data->inputs + (first * CHECK_IMAGE_SIZE), CHECK_IMAGE_SIZE, data->labels + first, CHECK_BATCH_SIZE);
+    }
+
+    uint64_t hash = hashNetworkWeights(nn);
+
+    for (int s=0; s<shardCount; s++) deleteNetwork(replicas[s]);
+    free(replicas);
+
+    setNetworkThreadPool(nn, NULL, CHECK_GRAIN_SIZE);
+    deleteThreadPool(pool);
+
+    return hash;
+}
+
+
+
+
+/**
+ * @brief Trains a network by serial mini-batch training and returns the hash of its weights
+ * @param nn A pointer to the neural network
+ * @param data A pointer to the mini-batches
+ * @param threadCount Number of threads of the thread pool calculating the layers
+ */
+
+uint64_t trainSerialNetwork(Network *nn, CheckData *data, int threadCount){
+
+    ThreadPool *pool = resetCheckNetwork(nn, threadCount);
+
+    Real *inputBuffer = getNetworkInputBuffer(nn, CHECK_IMAGE_SIZE);
+
+    // The weights are updated by backPropagateNetwork() after each nn->batchSize images
+    for (int i=0; i<CHECK_BATCH_COUNT * CHECK_BATCH_SIZE; i++){
+        memcpy(inputBuffer, data->inputs + (i * CHECK_IMAGE_SIZE), CHECK_IMAGE_SIZE * sizeof(Real));
+        feedForwardNetwork(nn);
+        backPropagateNetwork(nn, data->labels[i]);
+    }
+
+    uint64_t hash = hashNetworkWeights(nn);
+
+    setNetworkThreadPool(nn, NULL, CHECK_GRAIN_SIZE);
+    deleteThreadPool(pool);
+
+    return hash;
+}
+
+
+
+
+/**
+ * @brief Compares a hash with the expected hash and displays the result
+ * @param name The name of the training run
+ * @param hash The hash of the run's weights
+ * @param expectedHash The hash of the reference run's weights
+ */
+
+bool checkHash(const char *name, uint64_t hash, uint64_t expectedHash){
+
+    bool isPassed = (hash==expectedHash);
+
+    printf("%-44s weights %016llx  %s\n", name, (unsigned long long)hash, isPassed ? "OK" : "FAILED");
+
+    return isPassed;
+}
+
+
+
+
+/**
+ * @brief Main function running all training runs and comparing the hashes of their weights
+ */
+
+int main(void){
+
+    static CheckData data;
+
+    Random rng;
+    seedRandom(&rng, CHECK_SEED, RANDOM_STREAM_CHECK, 0);
+
+    for (int i=0; i<CHECK_BATCH_COUNT * CHECK_BATCH_SIZE * CHECK_IMAGE_SIZE; i++) data.inputs[i] = (Real)getRandomUniform(&rng);
+    for (int i=0; i<CHECK_BATCH_COUNT * CHECK_BATCH_SIZE; i++) data.labels[i] = (MNIST_Label)getRandomInt(&rng, 10);
+
+    LayerDefinition *layerDefs = getCheckLayerDefinitions();
+
+    Network *nn = createNetwork(CHECK_LAYER_COUNT, layerDefs, NULL);
+    nn->learningRate = 0.01;
+    nn->batchSize    = CHECK_BATCH_SIZE;
+
+    const int threadCounts[] = {1, 3, 4};
+    uint64_t shardHashes[3];
+    uint64_t serialHashes[3];
+
+    for (int t=0; t<3; t++){
+        shardHashes[t]  = trainShardedNetwork(nn, &data, threadCounts[t], CHECK_SHARD_COUNT);
+        serialHashes[t] = trainSerialNetwork(nn, &data, threadCounts[t]);
+    }
+
+    uint64_t singleShardHash = trainShardedNetwork(nn, &data, 3, 1);
+
+    deleteNetwork(nn);
+    free(layerDefs);
+
+    bool isPassed = true;
+    char name[64];
+
+    for (int t=0; t<3; t++){
+        sprintf(name, "%d shards, %d threads", CHECK_SHARD_COUNT, threadCounts[t]);
+        isPassed &= checkHash(name, shardHashes[t], shardHashes[0]);
+    }
+
+    for (int t=0; t<3; t++){
+        sprintf(name, "serial mini-batch, %d threads", threadCounts[t]);
+        isPassed &= checkHash(name, serialHashes[t], serialHashes[0]);
+    }
+
+    isPassed &= checkHash("1 shard (vs. serial mini-batch)", singleShardHash, serialHashes[0]);
+
+    if (!isPassed){
+        printf("Determinism check FAILED!\n");
+        return 1;
+    }
+
+    printf("All determinism checks passed.\n");
+
+    return 0;
+}
@@ -0,0 +1,516 @@
+/**
+ * @file check-kernels.c
+ * @brief Check comparing the vectorized (AVX2, AVX-512) kernels with the scalar reference kernels
+ * @details Each kernel is called with the same random inputs once with the scalar kernels and once with each
+ * vectorized kernel type supported by the CPU. The vectorized kernels are not bit-identical to the reference:
+ * - sums are accumulated in several partial sums (i.e. in a different order) and multiply-adds are fused into
+ *   FMA instructions (fp-contract=fast), so each sum may differ by a few rounding errors of its terms
+ * - exp/log/tanh are evaluated by polynomial approximations instead of the C library, and RELU (softplus) uses the
+ *   stable form max(x,0) + log(1+exp(-|x|)) instead of log(1+pow(M_E,x)), which loses all precision for x << 0
+ * The error of a sum is therefore measured relative to the sum of the absolute values of its terms, and the error of
+ * all other values relative to max(|reference|,1). Both are reported in multiples of the machine epsilon of Weight
+ * and must not exceed KERNEL_TOLERANCE.
+ * Usage: check-kernels   (exits with 1 if any kernel exceeds the tolerance)
+ */
+
+
+
+
+// Include external libraries
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <float.h>
+
+// Include project libraries
+#include "kernels.h"
+#include "random.h"
+
+#ifdef USE_FLOAT
+#define WEIGHT_EPSILON FLT_EPSILON
+#else
+#define WEIGHT_EPSILON DBL_EPSILON
+#endif
+
+/// Define the maximum error (in multiples of WEIGHT_EPSILON, see above) that a vectorized kernel may have
+#define KERNEL_TOLERANCE 16
+
+/// Define the seed of the random inputs (each check uses its own stream)
+#define KERNEL_CHECK_SEED 2016
+
+/// Define the size of the largest input vector (enough to cover full vectors, unrolled loops and remainders)
+#define KERNEL_CHECK_MAX_COUNT 1000
+
+/// Define the vector sizes that are checked (odd sizes exercise the remainder handling of the vectorized loops)
+static const int checkCounts[] = {1, 3, 8, 15, 16, 17, 63, 100, 785, KERNEL_CHECK_MAX_COUNT};
+#define KERNEL_CHECK_COUNT_NUM ((int)(sizeof(checkCounts) / sizeof(checkCounts[0])))
+
+/// Define the image size used to check sampleBilinear (MNIST size)
+#define KERNEL_CHECK_IMAGE_SIZE 28
+
+
+
+
+/**
+ * @brief Function checking one kernel of a kernel type against the scalar reference, returns the maximum error
+ * @param type The (vectorized) kernel type that is checked
+ * @param rng A pointer to the random number generator creating the inputs
+ */
+
+typedef double (*KernelCheck)(KernelType type, Random *rng);
+
+
+
+
+/**
+ * @brief Fills a vector with random values inside a range
+ * @param vec A pointer to the vector
+ * @param count Number of values in the vector
+ * @param min The smallest value
+ * @param max The largest value
+ * @param rng A pointer to the random number generator
+ */
+
+void fillRandomVector(Weight *vec, int count, double min, double max, Random *rng){
+
+    for (int i=0; i<count; i++) vec[i] = (Weight)getRandomRange(rng, min, max);
+
+}
+
+
+
+
+/**
+ * @brief Returns the maximum error (in multiples of WEIGHT_EPSILON) of a result vector compared with its reference
+ * @param expected A pointer to the reference values (scalar kernels)
+ * @param actual A pointer to the values of the checked kernels
+ * @param magnitudes A pointer to the sums of the absolute terms of each value (NULL = use max(|expected|,1))
+ * @param count Number of values in the vectors
+ */
+
+double getVectorError(const Weight *expected, const Weight *actual, const double *magnitudes, int count){
+
+    double maxError = 0;
+
+    for (int i=0; i<count; i++){
+
+        double magnitude = (magnitudes!=NULL) ? magnitudes[i] : fabs((double)expected[i]);
+        if (magnitudes==NULL && magnitude<1) magnitude = 1;
+        if (!(magnitude>0)) magnitude = 1;
+
+        double error = fabs((double)actual[i] - (double)expected[i]) / (magnitude * WEIGHT_EPSILON);
+
+        // @attention NaN results must fail the check as well
+        if (!(error<=maxError)) maxError = error;
+    }
+
+    return maxError;
+}
+
+
+
+
+/**
+ * @brief Checks calcDotProduct()
+ * @param type The (vectorized) kernel type that is checked
+ * @param rng A pointer to the random number generator creating the inputs
+ */
+
+double checkDotProduct(KernelType type, Random *rng){
+
+    static Weight a[KERNEL_CHECK_MAX_COUNT], b[KERNEL_CHECK_MAX_COUNT];
+
+    double maxError = 0;
+
+    for (int n=0; n<KERNEL_CHECK_COUNT_NUM; n++){
+
+        int count = checkCounts[n];
+
+        fillRandomVector(a, count, -1, 1, rng);
+        fillRandomVector(b, count, -1, 1, rng);
+
+        double magnitude = 0;
+        for (int i=0; i<count; i++) magnitude += fabs((double)a[i] * b[i]);
+
+        selectKernels(SCALAR_KERNELS);
+        Weight expected = calcDotProduct(a, b, count);
+
+        selectKernels(type);
+        Weight actual = calcDotProduct(a, b, count);
+
+        double error = getVectorError(&expected, &actual, &magnitude, 1);
+        if (!(error<=maxError)) maxError = error;
+    }
+
+    return maxError;
+}
+
+
+
+
+/**
+ * @brief Checks addScaledVector()
+ * @param type The (vectorized) kernel type that is checked
+ * @param rng A pointer to the random number generator creating the inputs
+ */
+
+double checkAddScaledVector(KernelType type, Random *rng){
+
+    static Weight x[KERNEL_CHECK_MAX_COUNT], expected[KERNEL_CHECK_MAX_COUNT], actual[KERNEL_CHECK_MAX_COUNT];
+    static double magnitudes[KERNEL_CHECK_MAX_COUNT];
+
+    double maxError = 0;
+
+    for (int n=0; n<KERNEL_CHECK_COUNT_NUM; n++){
+
+        int count = checkCounts[n];
+        Weight factor = (Weight)getRandomRange(rng, -1, 1);
+
+        fillRandomVector(x, count, -1, 1, rng);
+        fillRandomVector(expected, count, -1, 1, rng);
+
+        for (int i=0; i<count; i++){
+            actual[i]     = expected[i];
+            magnitudes[i] = fabs((double)expected[i]) + fabs((double)factor * x[i]);
+        }
+
+        selectKernels(SCALAR_KERNELS);
+        addScaledVector(expected, x, factor, count);
+
+        selectKernels(type);
+        addScaledVector(actual, x, factor, count);
+
+        double error = getVectorError(expected, actual, magnitudes, count);
+        if (!(error<=maxError)) maxError = error;
+    }
+
+    return maxError;
+}
+
+
+
+
+/**
+ * @brief Checks calcMatrixVectorProduct() (GEMV) and calcTransposedMatrixVectorProduct() (transposed GEMV)
+ * @details The matrix has a fixed number of rows (like the nodes of a small layer) and a varying number of columns.
+ * @param type The (vectorized) kernel type that is checked
+ * @param rng A pointer to the random number generator creating the inputs
+ * @param isTransposed Flag whether the transposed product is checked
+ */
+
+double checkMatrixVectorProduct(KernelType type, Random *rng, bool isTransposed){
+
+    const int rowCount = 10;
+
+    static Weight matrix[10 * KERNEL_CHECK_MAX_COUNT], vec[KERNEL_CHECK_MAX_COUNT];
+    static Weight expected[KERNEL_CHECK_MAX_COUNT], actual[KERNEL_CHECK_MAX_COUNT];
+    static double magnitudes[KERNEL_CHECK_MAX_COUNT];
+
+    double maxError = 0;
+
+    for (int n=0; n<KERNEL_CHECK_COUNT_NUM; n++){
+
+        int colCount = checkCounts[n];
+        int resultCount = isTransposed ? colCount : rowCount;
+
+        fillRandomVector(matrix, rowCount * colCount, -1, 1, rng);
+        fillRandomVector(vec, isTransposed ? rowCount : colCount, -1, 1, rng);
+
+        for (int i=0; i<resultCount; i++) magnitudes[i] = 0;
+
+        for (int r=0; r<rowCount; r++){
+            for (int c=0; c<colCount; c++){
+                Weight v = isTransposed ? vec[r] : vec[c];
+                magnitudes[isTransposed ? c : r] += fabs((double)matrix[r * colCount + c] * v);
+            }
+        }
+
+        selectKernels(SCALAR_KERNELS);
+        if (isTransposed) calcTransposedMatrixVectorProduct(matrix, vec, rowCount, colCount, expected);
+        else calcMatrixVectorProduct(matrix, vec, rowCount, colCount, expected);
+
+        selectKernels(type);
+        if (isTransposed) calcTransposedMatrixVectorProduct(matrix, vec, rowCount, colCount, actual);
+        else calcMatrixVectorProduct(matrix, vec, rowCount, colCount, actual);
+
+        double error = getVectorError(expected, actual, magnitudes, resultCount);
+        if (!(error<=maxError)) maxError = error;
+    }
+
+    return maxError;
+}
+
+
+
+
+/**
+ * @brief Checks calcMatrixVectorProduct()
+ * @param type The (vectorized) kernel type that is checked
+ * @param rng A pointer to the random number generator creating the inputs
+ */
+
+double checkGemv(KernelType type, Random *rng){
+    return checkMatrixVectorProduct(type, rng, false);
+}
+
+
+
+
+/**
+ * @brief Checks calcTransposedMatrixVectorProduct()
+ * @param type The (vectorized) kernel type that is checked
+ * @param rng A pointer to the random number generator creating the inputs
+ */
+
+double checkTransposedGemv(KernelType type, Random *rng){
+    return checkMatrixVectorProduct(type, rng, true);
+}
+
+
+
+
+/**
+ * @brief Checks activateVector() for an activation function
+ * @details Inputs cover [-20,20], i.e. both saturated ends of SIGMOID/TANH and the x << 0 range of RELU.
+ * @param type The (vectorized) kernel type that is checked
+ * @param rng A pointer to the random number generator creating the inputs
+ * @param actType The type of activation function to be checked
+ */
+
+double checkActivation(KernelType type, Random *rng, ActFctType actType){
+
+    static Weight expected[KERNEL_CHECK_MAX_COUNT], actual[KERNEL_CHECK_MAX_COUNT];
+
+    double maxError = 0;
+
+    for (int n=0; n<KERNEL_CHECK_COUNT_NUM; n++){
+
+        int count = checkCounts[n];
+
+        fillRandomVector(expected, count, -20, 20, rng);
+        for (int i=0; i<count; i++) actual[i] = expected[i];
+
+        selectKernels(SCALAR_KERNELS);
+        activateVector(expected, count, actType);
+
+        selectKernels(type);
+        activateVector(actual, count, actType);
+
+        double error = getVectorError(expected, actual, NULL, count);
+        if (!(error<=maxError)) maxError = error;
+    }
+
+    return maxError;
+}
+
+
+
+
+/**
+ * @brief Checks scaleByDerivative() for an activation function
+ * @details The outputs cover the output range of the activation function (RELU: [0,20]).
+ * @param type The (vectorized) kernel type that is checked
+ * @param rng A pointer to the random number generator creating the inputs
+ * @param actType The type of activation function to be checked
+ */
+
+double checkDerivative(KernelType type, Random *rng, ActFctType actType){
+
+    static Weight outputs[KERNEL_CHECK_MAX_COUNT], expected[KERNEL_CHECK_MAX_COUNT], actual[KERNEL_CHECK_MAX_COUNT];
+
+    double maxError = 0;
+
+    for (int n=0; n<KERNEL_CHECK_COUNT_NUM; n++){
+
+        int count = checkCounts[n];
+
+        fillRandomVector(outputs, count, (actType==TANH) ? -1 : 0, (actType==RELU) ? 20 : 1, rng);
+        fillRandomVector(expected, count, -1, 1, rng);
+        for (int i=0; i<count; i++) actual[i] = expected[i];
+
+        selectKernels(SCALAR_KERNELS);
+        scaleByDerivative(expected, outputs, count, actType);
+
+        selectKernels(type);
+        scaleByDerivative(actual, outputs, count, actType);
+
+        double error = getVectorError(expected, actual, NULL, count);
+        if (!(error<=maxError)) maxError = error;
+    }
+
+    return maxError;
+}
+
+
+
+
+/**
+ * @brief Checks activateVector() for SIGMOID
+ */
+
+double checkSigmoid(KernelType type, Random *rng){
+    return checkActivation(type, rng, SIGMOID);
+}
+
+
+
+
+/**
+ * @brief Checks activateVector() for TANH
+ */
+
+double checkTanh(KernelType type, Random *rng){
+    return checkActivation(type, rng, TANH);
+}
+
+
+
+
+/**
+ * @brief Checks activateVector() for RELU (softplus)
+ */
+
+double checkRelu(KernelType type, Random *rng){
+    return checkActivation(type, rng, RELU);
+}
+
+
+
+
+/**
+ * @brief Checks scaleByDerivative() for SIGMOID
+ */
+
+double checkSigmoidDerivative(KernelType type, Random *rng){
+    return checkDerivative(type, rng, SIGMOID);
+}
+
+
+
+
+/**
+ * @brief Checks scaleByDerivative() for TANH
+ */
+
+double checkTanhDerivative(KernelType type, Random *rng){
+    return checkDerivative(type, rng, TANH);
+}
+
+
+
+
+/**
+ * @brief Checks scaleByDerivative() for RELU (softplus)
+ */
+
+double checkReluDerivative(KernelType type, Random *rng){
+    return checkDerivative(type, rng, RELU);
+}
+
+
+
+
+/**
+ * @brief Checks sampleBilinear()
+ * @details The coordinates reach 3 pixels beyond each border to cover the clamping to the background value.
+ * @param type The (vectorized) kernel type that is checked
+ * @param rng A pointer to the random number generator creating the inputs
+ */
+
+double checkSampleBilinear(KernelType type, Random *rng){
+
+    const int size = KERNEL_CHECK_IMAGE_SIZE;
+
+    static Weight image[(KERNEL_CHECK_IMAGE_SIZE+2) * (KERNEL_CHECK_IMAGE_SIZE+2)];
+    static Weight xs[KERNEL_CHECK_MAX_COUNT], ys[KERNEL_CHECK_MAX_COUNT];
+    static Weight expected[KERNEL_CHECK_MAX_COUNT], actual[KERNEL_CHECK_MAX_COUNT];
+
+    double maxError = 0;
+
+    // Random pixels inside a border holding the background value
+    for (int y=0; y<size+2; y++){
+        for (int x=0; x<size+2; x++){
+            bool isBorder = (x==0 || y==0 || x==size+1 || y==size+1);
+            image[y * (size+2) + x] = isBorder ? 0 : (Weight)getRandomUniform(rng);
+        }
+    }
+
+    for (int n=0; n<KERNEL_CHECK_COUNT_NUM; n++){
+
+        int count = checkCounts[n];
+
+        fillRandomVector(xs, count, -3, size+3, rng);
+        fillRandomVector(ys, count, -3, size+3, rng);
+
+        selectKernels(SCALAR_KERNELS);
+        sampleBilinear(image, size, size, xs, ys, count, expected);
+
+        selectKernels(type);
+        sampleBilinear(image, size, size, xs, ys, count, actual);
+
+        double error = getVectorError(expected, actual, NULL, count);
+        if (!(error<=maxError)) maxError = error;
+    }
+
+    return maxError;
+}
+
+
+
+
+/**
+ * @brief Main function comparing all vectorized kernel types supported by the CPU with the scalar kernels
+ */
+
+int main(void){
+
+    const char *typeNames[] = {"scalar", "AVX2", "AVX-512"};
+
+    const char *checkNames[] = {
+        "calcDotProduct", "addScaledVector", "calcMatrixVectorProduct", "calcTransposedMatrixVectorProduct",
+        "activateVector (SIGMOID)", "activateVector (TANH)", "activateVector (RELU)",
+        "scaleByDerivative (SIGMOID)", "scaleByDerivative (TANH)", "scaleByDerivative (RELU)", "sampleBilinear"
+    };
+
+    const KernelCheck checks[] = {
+        checkDotProduct, checkAddScaledVector, checkGemv, checkTransposedGemv,
+        checkSigmoid, checkTanh, checkRelu,
+        checkSigmoidDerivative, checkTanhDerivative, checkReluDerivative, checkSampleBilinear
+    };
+
+    int checkCount = (int)(sizeof(checks) / sizeof(checks[0]));
+    int failCount = 0;
+
+    printf("Checking %d-bit kernels against the scalar reference (tolerance: %d epsilon)\n", (int)(8 * sizeof(Weight)), KERNEL_TOLERANCE);
+
+    for (KernelType type=AVX2_KERNELS; type<=AVX512_KERNELS; type++){
+
+        if (type > getBestKernelType()){
+            printf("%-8s not supported by this CPU, skipped\n", typeNames[type]);
+            continue;
+        }
+
+        for (int c=0; c<checkCount; c++){
+
+            Random rng;
+            seedRandom(&rng, KERNEL_CHECK_SEED, RANDOM_STREAM_CHECK, c);
+
+            double error = checks[c](type, &rng);
+            bool isPassed = (error <= KERNEL_TOLERANCE);
+
+            if (!isPassed) failCount++;
+
+            printf("%-8s %-36s max. error %8.2f epsilon  %s\n", typeNames[type], checkNames[c], error, isPassed ? "OK" : "FAILED");
+        }
+    }
+
+    if (failCount>0){
+        printf("%d kernel checks FAILED!\n", failCount);
+        return 1;
+    }
+
+    printf("All kernel checks passed.\n");
+
+    return 0;
+}
@@ -8,6 +8,7 @@
 
 // Include external libraries
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
 #include <stdarg.h>
@@ -17,6 +18,8 @@
 #include "util/mnist-utils.h"
 #include "util/screen.h"
 #include "dnn.h"
+#include "kernels.h"
+#include "random.h"
 
 
 
@@ -90,46 +93,6 @@ int getNodeBackwardConnectionCount(LayerDefinition *layerDef){
 
 
 
-/**
- * @brief Returns the number of forward connections of a NODE (not of a layer)
- * @attention The number of FORWARD connections in one layer is NOT the same as the number of BACKWARD connections in the following layer!!
- * @param layerDef A pointer to the layer definition
- */
-
-int getNodeForwardConnectionCount(LayerDefinition *layerDef){
-    
-    // INPUT and OUTPUT layers don't have any forward connections
-    if (layerDef->layerType==INPUT || layerDef->layerType==OUTPUT) return 0;
-    
-    int connCount = 0;
-    
-    // Check the layerType of the NEXT(!!) layer
-    switch ((layerDef+1)->layerType) {
-        case OUTPUT:
-        case FULLY_CONNECTED:{
-            connCount = getLayerNodeCount(layerDef+1);
-            break;
-        }
-        case CONVOLUTIONAL:{
-            // If the next layer is a convolutional layer, then the number of
-            // forward connections per node is NOT fix but varies
-            // i.e. we define here the MAXIMUM conn count of a node
-            connCount = pow((layerDef+1)->filter,2) * (layerDef+1)->nodeMap.depth;
-            break;
-        }
-        default:{
-            printf("Error! Wrong/Missing layer type definition! ABORT!!\n");
-            exit(1);
-            break;
-        }
-    }
-    
-    return connCount;
-}
-
-
-
-
 /**
  * @brief Returns the number of weights for a layer (based on a given layer definition)
  * @param layerDef A pointer to the layer definition
@@ -219,6 +182,111 @@ ByteSize getNetworkWeightBlockSize(int layerCount, LayerDefinition *layerDefs){
 
 
 
+/**
+ * @brief Returns the total number of nodes of all layers based on a given array of layer definitions
+ * @param layerCount The number of layers in the network
+ * @param layerDefs A pointer to an array of layer definitions
+ */
+
+int getNetworkNodeCount(int layerCount, LayerDefinition *layerDefs){
+    
+    int nodeCount = 0;
+    
+    for (int l=0; l<layerCount; l++) nodeCount += getLayerNodeCount(layerDefs+l);
+    
+    return nodeCount;
+}
+
+
+
+
+/**
+ * @brief Returns the memory size of the network's gradients block based on a given array of layer definitions
+ * @details The gradients block accumulates the weight changes of a mini-batch. It holds one gradient per weight
+ * (same layout as the weights block) followed by one gradient per node (for the nodes' bias weights).
+ * The gradients block is located inside the network object, AFTER the weights block.
+ * @param layerCount The number of layers in the network
+ * @param layerDefs A pointer to an array of layer definitions
+ */
+
+ByteSize getNetworkGradientBlockSize(int layerCount, LayerDefinition *layerDefs){
+    
+    ByteSize size = getNetworkWeightBlockSize(layerCount, layerDefs);
+    
+    size += getNetworkNodeCount(layerCount, layerDefs) * sizeof(Weight);
+    
+    return size;
+}
+
+
+
+
+/**
+ * @brief Returns the number of values of the largest convolution window (=patch) based on a given array of layer definitions
+ * @details A patch holds one value per backward connection of a node, i.e. filter * filter * depth of the previous layer
+ * @param layerCount The number of layers in the network
+ * @param layerDefs A pointer to an array of layer definitions
+ */
+
+int getNetworkMaxPatchSize(int layerCount, LayerDefinition *layerDefs){
+    
+    int maxPatchSize = 0;
+    
+    for (int l=0; l<layerCount; l++){
+        if ((layerDefs+l)->layerType!=CONVOLUTIONAL) continue;
+        int patchSize = getNodeBackwardConnectionCount(layerDefs+l);
+        if (patchSize > maxPatchSize) maxPatchSize = patchSize;
+    }
+    
+    return maxPatchSize;
+}
+
+
+
+
+/**
+ * @brief Returns the memory size of the network's node values block based on a given array of layer definitions
+ * @details The node values block holds the biases, outputs and errorSums of all nodes as 3 contiguous arrays
+ * (structure of arrays), so that the values of a layer can be read and written as dense vectors.
+ * Inside each array the values are ordered by layer, then by column, then by level.
+ * The node values block is located inside the network object, AFTER the gradients block.
+ * @param layerCount The number of layers in the network
+ * @param layerDefs A pointer to an array of layer definitions
+ */
+
+ByteSize getNetworkNodeValuesBlockSize(int layerCount, LayerDefinition *layerDefs){
+    
+    int nodeCount = getNetworkNodeCount(layerCount, layerDefs);
+    
+    // one array for the biases, one for the outputs and one for the errorSums
+    ByteSize size = 3 * nodeCount * sizeof(Weight);
+    
+    return size;
+}
+
+
+
+
+/**
+ * @brief Returns the memory size of the network's dense scratch buffer based on a given array of layer definitions
+ * @details The scratch buffer holds one convolution window (=patch) of a convolutional layer's inputs.
+ * The scratch block is located inside the network object, AFTER the node values block.
+ * @param layerCount The number of layers in the network
+ * @param layerDefs A pointer to an array of layer definitions
+ */
+
+ByteSize getNetworkDenseBufferSize(int layerCount, LayerDefinition *layerDefs){
+    
+    int maxPatchSize = getNetworkMaxPatchSize(layerCount, layerDefs);
+    
+    ByteSize size = maxPatchSize * sizeof(Weight);
+    
+    return size;
+}
+
+
+
+
 /**
  * @brief Returns the memory (byte) size of a node based on a given layer definition
  * @details Each layer's nodes' memory size may be different due to a different number of connections
@@ -229,10 +297,8 @@ ByteSize getNetworkWeightBlockSize(int layerCount, LayerDefinition *layerDefs){
 
 ByteSize getNodeSize(LayerDefinition *layerDef){
     
-    int backwardConnectCount = getNodeBackwardConnectionCount(layerDef);
-    int forwardConnectCount  = getNodeForwardConnectionCount(layerDef);
-    
-    int connectCount = backwardConnectCount + forwardConnectCount;
+    // @attention Nodes only store BACKWARD connections, errors are back propagated via the transposed weights
+    int connectCount = getNodeBackwardConnectionCount(layerDef);
     
     ByteSize nodeSize = sizeof(Node) + (connectCount * sizeof(Connection));
     
@@ -303,12 +369,24 @@ ByteSize getNetworkSize(int layerCount, LayerDefinition *layerDefs){
         size += lsize;
     }
     
-    // get size of weight memory block (located within network, after layers)
+    // add the table of layer pointers (located within network, after layers)
+    size += layerCount * sizeof(Layer*);
+    
+    // get size of weight memory block (located within network, after the layer table)
     ByteSize weightBlockSize = getNetworkWeightBlockSize(layerCount, layerDefs);
     
     // add weight block size to the network
     size += weightBlockSize;
     
+    // add the mini-batch gradients (located within network, after weights)
+    size += getNetworkGradientBlockSize(layerCount, layerDefs);
+    
+    // add the nodes' biases, outputs and errorSums (located within network, after gradients)
+    size += getNetworkNodeValuesBlockSize(layerCount, layerDefs);
+    
+    // add the dense engine's scratch buffer (located within network, after the node values)
+    size += getNetworkDenseBufferSize(layerCount, layerDefs);
+    
     return size;
 }
 
@@ -319,18 +397,16 @@ ByteSize getNetworkSize(int layerCount, LayerDefinition *layerDefs){
  * @brief Returns a pointer to a specific node defined by its id from a given layer
  * @details The node is retrieved by moving a pointer from this layer's 1st node forward by id*nodeSize 
  * (it is NOT possible to retrieve a node simply via an array because the actual size of a node 
- * depends on its number of connections)
+ * depends on its number of connections). The node size is cached in the column during initialization.
  * @param column A pointer to the column where this node is located in
  * @param nodeId The id of the node that is to be returned
  */
 
 Node *getColumnNode(Column *column, int nodeId) {
     
-    ByteSize nodeSize = sizeof(Node) + ( column->maxConnCountPerNode * sizeof(Connection));
-    
     uint8_t *sbptr = (uint8_t*) column->nodes;
     
-    sbptr += nodeId * nodeSize;
+    sbptr += nodeId * column->nodeSize;
     
     return (Node*) sbptr;
 }
@@ -342,17 +418,16 @@ Node *getColumnNode(Column *column, int nodeId) {
  * @brief Returns a pointer to a specific column defined by its id
  * @details The column is retrieved by moving a pointer from the layer's 1st column forward
  * (it is NOT possible to retrieve a column simply via an array because the actual size of each column 
- * depends on its number/sizes of nodes and thus is variable
+ * depends on its number/sizes of nodes and thus is variable). The column size is cached in the layer during initialization.
  * @param layer A pointer to the layer from which to get the column
  * @param columnId The id of the column that is to be retrieved/accessed
  */
 
 Column *getLayerColumn(Layer *layer, int columnId) {
     
-    ByteSize columnSize = getColumnSize(layer->layerDef);
     uint8_t *sbptr = (uint8_t*) layer->columns;
     
-    sbptr += columnId * columnSize;
+    sbptr += columnId * layer->columnSize;
     
     return (Column*) sbptr;
 }
@@ -380,63 +455,181 @@ Node *getNetworkNode(Layer *layer, int columnId, int nodeId) {
 
 /**
  * @brief Returns a pointer to a specific layer defined by its id from the network
- * @details The layer is retrieved by moving a pointer from the network's 1st layer forward by layerId*layerSize
- * (it is NOT possible to retrieve a layer simply via an array because the actual size of EACH layer depends on its number/sizes of nodes)
+ * @details It is NOT possible to retrieve a layer simply via an array because the actual size of EACH layer
+ * depends on its number/sizes of nodes. Instead the position of each layer is stored in the network's layer
+ * table when the layer is initialized.
  * @param nn A pointer to the NN
  * @param layerId The id of the layer that is to be returned
  */
 
 Layer *getNetworkLayer(Network *nn, int layerId){
     
-    // Create SBPTR pointing to the start of the layers
-    uint8_t *sbptr = (uint8_t*) nn->layers;
+    return nn->layerTable[layerId];
+}
+
+
+
+
+/**
+ * @brief Returns whether a layer is computed by the dense matrix engine (instead of the connection graph)
+ * @details FULLY_CONNECTED and OUTPUT layers store their weights as a row-major matrix (one row of
+ * previous-layer-nodeCount weights per node). CONVOLUTIONAL layers store one row of filter * filter *
+ * previous-layer-depth weights per feature map, which is applied to each column's convolution window.
+ * @param nn A pointer to the neural network
+ * @param layer A pointer to the layer that is to be checked
+ */
+
+bool isDenseLayer(Network *nn, Layer *layer){
+    
+    if (nn->engine!=DENSE_ENGINE) return false;
     
-    // Move pointer forward layer by layer until the LID layer is reached
-    for (int i=0;i<layerId;i++){
-        Layer *tmpLayer = (Layer*) sbptr;
-        sbptr += tmpLayer->size;
-    }
+    LayerType layerType = layer->layerDef->layerType;
     
-    return (Layer*) sbptr;
+    return (layerType==FULLY_CONNECTED || layerType==OUTPUT || layerType==CONVOLUTIONAL);
 }
 
 
 
 
 /**
- * @brief Returns the result of applying the given outputValue to the derivate of the activation function
- * @param outVal Output value that is to be back propagated
- * @param actType The type of activation function that was applied during feed forward (SIGMOID/TANH/RELU)
+ * @brief Data structure shared by the parallel tasks calculating the columns/nodes of a layer
  */
 
-Weight getDerivative(Weight outVal, ActFctType actType){
+typedef struct LayerTask{
+    Network *nn;                // network in which the layer is located
+    Layer *layer;               // layer whose columns/nodes are calculated
+    Layer *prevLayer;           // previous layer (whose outputs are the inputs of the layer)
+    Layer *nextLayer;           // following layer (whose errors are back propagated to the layer, NULL if not needed)
+} LayerTask;
+
+
+
+
+/**
+ * @brief Returns the minimum number of items (columns, nodes, ...) per parallel task
+ * @param nn A pointer to the neural network
+ * @param itemCost Number of multiply-adds per item
+ */
 
-    Weight d = 0;
+int getLayerGrainSize(Network *nn, int itemCost){
     
-    switch (actType) {
-        case SIGMOID:
-            d = outVal * (1-outVal);
-            break;
+    if (itemCost<1) itemCost = 1;
+    
+    int grainSize = (nn->grainSize + itemCost - 1) / itemCost;
+    
+    return (grainSize<1) ? 1 : grainSize;
+}
+
+
+
+
+/**
+ * @brief Returns the convolution patch (im2col scratch vector) of a thread of the network's thread pool
+ * @param nn A pointer to the neural network
+ * @param threadId The index of the thread (0 = calling thread)
+ */
+
+Weight *getThreadPatch(Network *nn, int threadId){
+    
+    if (threadId==0) return nn->densePatchPtr;
+    
+    return nn->threadPatchesPtr + ((threadId-1) * nn->threadPatchSize);
+}
+
+
+
+
+/**
+ * @brief Adds the bias of each node in a range of nodes of a layer to the node's output
+ * @param layer A pointer to the layer whose biases are to be added
+ * @param first The index of the first node
+ * @param count The number of nodes
+ */
+
+void addLayerBiases(Layer *layer, int first, int count){
+    
+    for (int i=first; i<first+count; i++) layer->outputs[i] += layer->biases[i];
+    
+}
+
+
+
+
+/**
+ * @brief Copies the inputs inside one convolution window of a previous layer into a contiguous patch (im2col)
+ * @details The patch is ordered by previous-layer level, then by row and column inside the filter window, i.e. in
+ * the same order as a feature map's weights are located in the weights block. Positions of the filter window that
+ * are outside of the previous layer's node map are set to 0 so that they neither add to the output nor to a weight.
+ * @param inputs A pointer to the previous layer's outputs (ordered by column, then by level)
+ * @param inputMap A pointer to the width/height/depth of the previous layer
+ * @param filter Number of columns/nodes on the x- and y-axis in a filter window
+ * @param startX Horizontal position of the filter window's first column in the previous layer
+ * @param startY Vertical position of the filter window's first column in the previous layer
+ * @param patch A pointer to the vector that receives filter * filter * depth values
+ */
+
+void fillConvolutionPatch(const Weight *inputs, Volume *inputMap, int filter, int startX, int startY, Weight *patch){
+    
+    int inWidth  = inputMap->width;
+    int inHeight = inputMap->height;
+    int inDepth  = inputMap->depth;
+    
+    for (int level=0; level<inDepth; level++){
+        
+        for (int y=startY; y<startY+filter; y++){
             
-        case TANH:
-            d = 1-pow(tanh(outVal),2);
-            break;
+            for (int x=startX; x<startX+filter; x++){
+                
+                if (x<inWidth && y<inHeight) *patch++ = inputs[(((y * inWidth) + x) * inDepth) + level];
+                else *patch++ = 0;
+                
+            }
             
-        case RELU:
-            d = 1 / (1 + pow(M_E,-outVal));
-            break;
+        }
+        
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Adds the values of a contiguous patch to the nodes inside one convolution window of a previous layer (col2im)
+ * @details This is the reverse of fillConvolutionPatch(), i.e. the patch is ordered in the same way. Values at positions
+ * of the filter window that are outside of the previous layer's node map are dropped. Only the levels firstLevel to
+ * lastLevel-1 are added, i.e. the patch holds filter * filter * (lastLevel-firstLevel) values.
+ * @param patch A pointer to the vector holding the values of the levels
+ * @param inputMap A pointer to the width/height/depth of the previous layer
+ * @param filter Number of columns/nodes on the x- and y-axis in a filter window
+ * @param startX Horizontal position of the filter window's first column in the previous layer
+ * @param startY Vertical position of the filter window's first column in the previous layer
+ * @param firstLevel The first level of the previous layer that is added
+ * @param lastLevel The level following the last level of the previous layer that is added
+ * @param vals A pointer to the previous layer's values (ordered by column, then by level) to which the patch is added
+ */
+
+void addConvolutionPatch(const Weight *patch, Volume *inputMap, int filter, int startX, int startY, int firstLevel, int lastLevel, Weight *vals){
+    
+    int inWidth  = inputMap->width;
+    int inHeight = inputMap->height;
+    int inDepth  = inputMap->depth;
+    
+    for (int level=firstLevel; level<lastLevel; level++){
+        
+        for (int y=startY; y<startY+filter; y++){
             
-        case NONE:
-            d = 1;
-            break;
+            for (int x=startX; x<startX+filter; x++){
+                
+                if (x<inWidth && y<inHeight) vals[(((y * inWidth) + x) * inDepth) + level] += *patch;
+                patch++;
+                
+            }
             
-        default:
-            printf("Undefined derivative function! ABORT!\n");
-            exit(1);
-            break;
+        }
+        
     }
     
-    return d;
 }
 
 
@@ -445,26 +638,28 @@ Weight getDerivative(Weight outVal, ActFctType actType){
 /**
  * @brief Updates a node's weights based on given learning rate
  * @details The accumulated error (difference between desired output and actual output) of this node
- * must have been calculated before and attached to the node (= ->errorSum)
+ * must have been calculated before and stored in the layer's errorSums
  * @param updateNode A pointer to the node whose weights are to be updated
+ * @param layer A pointer to the layer in which the node is located
+ * @param prevLayer A pointer to the previous layer to which the node's backward connections point to
  * @param learningRate The factor with which errors are applied to weights
  */
 
-void updateNodeWeights(Node *updateNode, double learningRate){
+void updateNodeWeights(Node *updateNode, Layer *layer, Layer *prevLayer, double learningRate){
+    
+    Real errorSum = layer->errorSums[updateNode->id];
     
     // @attention When updating the weights, only use the BACKWARD connections
     for (int i=0; i<updateNode->backwardConnCount; i++){
         
-        Node *prevLayerNode = updateNode->connections[i].nodePtr;
+        Connection *conn = &updateNode->connections[i];
         
-        if (prevLayerNode!=NULL){
-            *updateNode->connections[i].weightPtr += (learningRate * prevLayerNode->output * updateNode->errorSum);
-        }
+        layer->weightsPtr[conn->weightId] += (learningRate * prevLayer->outputs[conn->nodeId] * errorSum);
     
     }
     
     // update bias weight
-    updateNode->bias += (learningRate * 1 * updateNode->errorSum);
+    layer->biases[updateNode->id] += (learningRate * 1 * errorSum);
     
 }
 
@@ -472,58 +667,59 @@ void updateNodeWeights(Node *updateNode, double learningRate){
 
 
 /**
- * @brief Returns the total error of a node by adding up all the partial errors from the following layer
- * @details To speed up back propagation the partial errors are referenced via the node's forward connections
- * @param thisNode A pointer to the node whose (to be back propagated) error is to be calculated
+ * @brief Returns whether weight changes are accumulated as gradients (mini-batch) instead of being applied directly
+ * @param nn A pointer to the neural network
  */
 
-double calcNodeError(Node *thisNode) {
-   
-    double nodeErrorSum = 0;
+bool isBatchTraining(Network *nn){
+    return (nn->batchSize > 1);
+}
+
+
+
+
+/**
+ * @brief Accumulates a node's weight and bias gradients (mini-batch mode of updateNodeWeights)
+ * @details The gradient of each weight is located at the same position in the gradients block as the weight in
+ * the weights block. The node's errorSum must have been calculated before.
+ * @param node A pointer to the node whose gradients are to be accumulated
+ * @param layer A pointer to the layer in which the node is located
+ * @param prevLayer A pointer to the previous layer to which the node's backward connections point to
+ */
 
-    int forwardConnStart = thisNode->backwardConnCount;
+void accumulateNodeGradients(Node *node, Layer *layer, Layer *prevLayer){
     
-    for (int c=0; c<thisNode->forwardConnCount; c++){
+    Real errorSum = layer->errorSums[node->id];
+    
+    // @attention When accumulating the gradients, only use the BACKWARD connections
+    for (int i=0; i<node->backwardConnCount; i++){
         
-        Node  *targetNode = thisNode->connections[forwardConnStart + c].nodePtr;
-        Weight *weightPtr = thisNode->connections[forwardConnStart + c].weightPtr;
-
-        nodeErrorSum += targetNode->errorSum * *weightPtr;
+        Connection *conn = &node->connections[i];
+        
+        // The gradients have the same layout as the weights
+        layer->gradientsPtr[conn->weightId] += prevLayer->outputs[conn->nodeId] * errorSum;
         
     }
-
-    return nodeErrorSum;
+    
+    layer->biasGradientsPtr[node->id] += errorSum;
+    
 }
 
 
 
 
 /**
- * @brief Back propagates network error to hidden layer
- * @details Backpropagating a layer means looping through all its nodes' connections,
- * and update the errorSum attached to the TARGET node (=previous layer) of each connection
- * i.e. when "backpropagating" layer x, then the errorSum of the nodes of layer x-1 are calculated
+ * @brief Updates (or, in mini-batch mode, accumulates the gradients of) the bias weights of all nodes of a layer
  * @param nn A pointer to the neural network
- * @param layerId The id of the layer that is to be back propagated
+ * @param layer A pointer to the layer whose biases are to be updated
  */
 
-void backPropagateLayer(Network *nn, int layerId){
+void updateLayerBiases(Network *nn, Layer *layer){
     
-    Layer *hl = getNetworkLayer(nn, layerId);
-
-    for (int c=0; c<hl->columnCount; c++){
-        
-        for (int n=0; n<hl->columns[0].nodeCount; n++){
-            
-            Node *hn = getNetworkNode(hl,c,n);
-            
-            hn->errorSum = calcNodeError(hn) * getDerivative(hn->output, hl->layerDef->activationType);
-
-            updateNodeWeights(hn, nn->learningRate);
-            
-        }
-        
-    }
+    int nodeCount = getLayerNodeCount(layer->layerDef);
+    
+    if (isBatchTraining(nn)) addScaledVector(layer->biasGradientsPtr, layer->errorSums, 1, nodeCount);
+    else addScaledVector(layer->biases, layer->errorSums, nn->learningRate, nodeCount);
     
 }
 
@@ -531,31 +727,48 @@ void backPropagateLayer(Network *nn, int layerId){
 
 
 /**
- * @brief Calculates the error (difference of desired classification vs actual node output) of each output node
- * and back propagates the error in the output layer to the previous layer
- * @details The error is calculated based on the given target classification (= image label)
- * and is stored in each output node so that it can be backpropagated later
- * @param nn A pointer to the neural network
- * @param targetClassification The correct/desired classification (=label) of this recognition/image
+ * @brief Updates the shared weights of a range of feature maps of a convolutional layer (parallel task)
+ * @details For every column the convolution window of the previous layer's outputs is rebuilt and each feature
+ * map's row of weights is moved by learningRate * errorSum of that column's node along this window.
+ * Since all columns share the same weights, the work is split by feature maps (=rows of weights), not by columns.
+ * @param context A pointer to the LayerTask
+ * @param firstMap The first feature map (=level) whose weights are to be updated
+ * @param lastMap The feature map following the last feature map whose weights are to be updated
+ * @param threadId The index of the executing thread (selects the convolution patch)
  */
 
-void backPropagateOutputLayer(Network *nn, int targetClassification){
+void updateConvLayerMaps(void *context, int firstMap, int lastMap, int threadId){
     
-    Layer *ol = getNetworkLayer(nn, nn->layerCount-1);
+    LayerTask *task = (LayerTask*)context;
+    Network *nn = task->nn;
+    Layer *layer = task->layer;
+    Layer *prevLayer = task->prevLayer;
     
-    for (int o=0;o<ol->columnCount;o++){
+    LayerDefinition *layerDef = layer->layerDef;
+    Volume *inputMap = &prevLayer->layerDef->nodeMap;
     
-        for (int n=0; n<ol->columns[0].nodeCount; n++){
-            
-            Node *on = getNetworkNode(ol,o,n);
-            
-            int targetOutput = (o==targetClassification)?1:0;
-            
-            double errorDelta = targetOutput - on->output;
+    int filter    = layerDef->filter;
+    int width     = layerDef->nodeMap.width;
+    int depth     = layerDef->nodeMap.depth;
+    int stride    = calcStride(inputMap->width, filter, width);
+    int patchSize = getNodeBackwardConnectionCount(layerDef);
+    
+    // In mini-batch mode the changes are accumulated as gradients (the learning rate is applied per batch)
+    Weight *target = isBatchTraining(nn) ? layer->gradientsPtr : layer->weightsPtr;
+    Weight rate    = isBatchTraining(nn) ? 1 : nn->learningRate;
+    
+    Weight *patch = getThreadPatch(nn, threadId);
+    
+    for (int c=0; c<layer->columnCount; c++){
+        
+        fillConvolutionPatch(prevLayer->outputs, inputMap, filter, (c % width) * stride, (c / width) * stride, patch);
+        
+        Real *errorSums = layer->errorSums + (c * depth);
+        
+        for (int n=firstMap; n<lastMap; n++){
             
-            on->errorSum = errorDelta * getDerivative(on->output, ol->layerDef->activationType);
-
-            updateNodeWeights(on, nn->learningRate);
+            // @attention Nodes on the same level share the same row of weights
+            addScaledVector(target + (n * patchSize), patch, rate * errorSums[n], patchSize);
             
         }
         
@@ -567,28 +780,669 @@ void backPropagateOutputLayer(Network *nn, int targetClassification){
 
 
 /**
- * @brief Backpropagates the output nodes' errors from output layer backwards to first layer
- *
- * @details The network's backpropagation proceeds in 2 steps:
- *
- * 1. CALCULATE OUTPUT NODES' ERRORS
- * a. Calculate the errorsums in all output cells based on the targetClassification
- *
- * 2. BACKPROPAGATE EACH LAYER
- * a. Update the nodes weights based on actual output and accumulated errorsum
- * b. Calculate the errorsums in all TARGET cells based on errorsum in this layer (calculated in 3)
- *
+ * @brief Updates the shared weights of a convolutional layer
+ * @details The feature maps are updated in parallel (see updateConvLayerMaps), the biases afterwards.
+ * The nodes' errorSums must have been calculated before.
  * @param nn A pointer to the neural network
- * @param targetClassification The correct/desired classification (=label) of this recognition/image
+ * @param layer A pointer to the CONVOLUTIONAL layer whose weights are to be updated
  */
 
-void backPropagateNetwork(Network *nn, int targetClassification){
-
-    backPropagateOutputLayer(nn, targetClassification);
+void updateConvLayerWeights(Network *nn, Layer *layer){
+    
+    LayerTask task = {.nn=nn, .layer=layer, .prevLayer=getNetworkLayer(nn, layer->id-1)};
+    
+    int depth     = layer->layerDef->nodeMap.depth;
+    int patchSize = getNodeBackwardConnectionCount(layer->layerDef);
+    
+    runParallelFor(nn->threadPool, depth, getLayerGrainSize(nn, layer->columnCount * patchSize), updateConvLayerMaps, &task);
+    
+    updateLayerBiases(nn, layer);
+    
+}
+
+
+
+
+/**
+ * @brief Updates the weights of a range of nodes of a dense layer as rows of its weight matrix (parallel task)
+ * @details Each node's row of weights is moved by learningRate * errorSum along the vector of the previous
+ * layer's outputs (a rank-1 update of the weight matrix).
+ * @param context A pointer to the LayerTask
+ * @param first The first node whose weights are to be updated
+ * @param last The node following the last node whose weights are to be updated
+ * @param threadId The index of the executing thread (unused)
+ */
+
+void updateDenseLayerRows(void *context, int first, int last, int threadId){
+    
+    LayerTask *task = (LayerTask*)context;
+    Network *nn = task->nn;
+    Layer *layer = task->layer;
+    Layer *prevLayer = task->prevLayer;
+    
+    int inCount = getLayerNodeCount(prevLayer->layerDef);
+    
+    // In mini-batch mode the changes are accumulated as gradients (the learning rate is applied per batch)
+    Weight *row = isBatchTraining(nn) ? layer->gradientsPtr : layer->weightsPtr;
+    Weight rate = isBatchTraining(nn) ? 1 : nn->learningRate;
+    
+    row += first * inCount;
+    
+    for (int n=first; n<last; n++){
+        
+        addScaledVector(row, prevLayer->outputs, rate * layer->errorSums[n], inCount);
+        
+        row += inCount;
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Updates the weights of all nodes of a dense layer as rows of its weight matrix
+ * @details Convolutional layers are handed over to updateConvLayerWeights().
+ * The rows are updated in parallel (see updateDenseLayerRows), the biases afterwards.
+ * The nodes' errorSums must have been calculated before.
+ * @param nn A pointer to the neural network
+ * @param layer A pointer to the (FULLY_CONNECTED or OUTPUT) layer whose weights are to be updated
+ */
+
+void updateDenseLayerWeights(Network *nn, Layer *layer){
+    
+    if (layer->layerDef->layerType==CONVOLUTIONAL) {
+        updateConvLayerWeights(nn, layer);
+        return;
+    }
+    
+    LayerTask task = {.nn=nn, .layer=layer, .prevLayer=getNetworkLayer(nn, layer->id-1)};
+    
+    int inCount  = getLayerNodeCount(task.prevLayer->layerDef);
+    int outCount = getLayerNodeCount(layer->layerDef);
+    
+    runParallelFor(nn->threadPool, outCount, getLayerGrainSize(nn, inCount), updateDenseLayerRows, &task);
+    
+    updateLayerBiases(nn, layer);
+    
+}
+
+
+
+
+/**
+ * @brief Back propagates the errors of a convolutional layer to a range of levels of its previous layer (parallel task)
+ * @details For every column of the convolutional layer the errors of its nodes are multiplied with the transpose of the
+ * layer's weight matrix, resulting in one error per position of the column's convolution window. These are then added
+ * to the errorSums of the nodes inside this window (col2im). Since the windows of neighboring columns overlap, the
+ * work is split by the levels of the previous layer (=slices of the window), not by columns.
+ * @param context A pointer to the LayerTask (layer = the layer whose errorSums are calculated)
+ * @param firstLevel The first level of the layer whose errorSums are to be calculated
+ * @param lastLevel The level following the last level whose errorSums are to be calculated
+ * @param threadId The index of the executing thread (selects the convolution patch)
+ */
+
+void calcConvLayerErrorLevels(void *context, int firstLevel, int lastLevel, int threadId){
+    
+    LayerTask *task = (LayerTask*)context;
+    Layer *layer = task->layer;
+    Layer *nextLayer = task->nextLayer;
+    
+    LayerDefinition *nextDef = nextLayer->layerDef;
+    Volume *inputMap = &layer->layerDef->nodeMap;
+    
+    int filter    = nextDef->filter;
+    int width     = nextDef->nodeMap.width;
+    int depth     = nextDef->nodeMap.depth;
+    int stride    = calcStride(inputMap->width, filter, width);
+    int patchSize = getNodeBackwardConnectionCount(nextDef);
+    
+    // The window's values of each level are contiguous inside the patch (and inside each row of weights)
+    int sliceStart = firstLevel * filter * filter;
+    int sliceSize  = (lastLevel - firstLevel) * filter * filter;
+    
+    Weight *patch = getThreadPatch(task->nn, threadId);
+    
+    for (int c=0; c<nextLayer->columnCount; c++){
+        
+        Real *errorSums = nextLayer->errorSums + (c * depth);
+        
+        // @attention Rows are added one by one (also for a slice covering all levels), so that each value is summed
+        // in the same order no matter how the levels are split into ranges (i.e. for any number of threads)
+        memset(patch, 0, sliceSize * sizeof(Weight));
+        for (int n=0; n<depth; n++) addScaledVector(patch, nextLayer->weightsPtr + (n * patchSize) + sliceStart, errorSums[n], sliceSize);
+        
+        addConvolutionPatch(patch, inputMap, filter, (c % width) * stride, (c / width) * stride, firstLevel, lastLevel, layer->errorSums);
+        
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Back propagates the errors of a convolutional layer to the nodes of its previous layer (transposed convolution)
+ * @details The levels of the previous layer are calculated in parallel (see calcConvLayerErrorLevels).
+ * @param nn A pointer to the neural network
+ * @param layer A pointer to the layer whose errorSums are to be calculated
+ * @param nextLayer A pointer to the following (CONVOLUTIONAL) layer whose errors are back propagated
+ */
+
+void calcConvLayerErrors(Network *nn, Layer *layer, Layer *nextLayer){
+    
+    LayerTask task = {.nn=nn, .layer=layer, .nextLayer=nextLayer};
+    
+    LayerDefinition *nextDef = nextLayer->layerDef;
+    int levelCost = nextLayer->columnCount * nextDef->nodeMap.depth * nextDef->filter * nextDef->filter;
+    
+    memset(layer->errorSums, 0, getLayerNodeCount(layer->layerDef) * sizeof(Real));
+    
+    runParallelFor(nn->threadPool, layer->layerDef->nodeMap.depth, getLayerGrainSize(nn, levelCost), calcConvLayerErrorLevels, &task);
+    
+}
+
+
+
+
+/**
+ * @brief Back propagates the errors of the following layer to the nodes of a layer by walking the following
+ * layer's connections (connection graph engine)
+ * @details Each node of the following layer adds its error, multiplied with a connection's weight, to the errorSum
+ * of the connection's target node (i.e. errors are pushed backward along the BACKWARD connections).
+ * @param layer A pointer to the layer whose errorSums are to be calculated
+ * @param nextLayer A pointer to the following layer whose errors are back propagated
+ */
+
+void calcGraphLayerErrors(Layer *layer, Layer *nextLayer){
+    
+    memset(layer->errorSums, 0, getLayerNodeCount(layer->layerDef) * sizeof(Real));
+    
+    for (int c=0; c<nextLayer->columnCount; c++){
+        
+        Column *column = getLayerColumn(nextLayer, c);
+        
+        for (int n=0; n<column->nodeCount; n++){
+            
+            Node *nextNode = getColumnNode(column, n);
+            
+            Real errorSum = nextLayer->errorSums[nextNode->id];
+            
+            for (int i=0; i<nextNode->backwardConnCount; i++){
+                Connection *conn = &nextNode->connections[i];
+                layer->errorSums[conn->nodeId] += errorSum * nextLayer->weightsPtr[conn->weightId];
+            }
+            
+        }
+        
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Back propagates the errors of a dense (FULLY_CONNECTED/OUTPUT) layer to a range of nodes of its previous layer
+ * (parallel task)
+ * @details Each range is a range of columns of the following layer's weight matrix, calculated by adding up the
+ * matrix' scaled rows one by one. A range covering all nodes is calculated the same way (and not by the transposed
+ * matrix-vector product kernel, which adds 4 rows at a time), so that each errorSum is summed in the same order no
+ * matter how the nodes are split into ranges, i.e. the results don't depend on the number of threads.
+ * @param context A pointer to the LayerTask (layer = the layer whose errorSums are calculated)
+ * @param first The first node whose errorSum is to be calculated
+ * @param last The node following the last node whose errorSum is to be calculated
+ * @param threadId The index of the executing thread (unused)
+ */
+
+void calcDenseLayerErrorNodes(void *context, int first, int last, int threadId){
+    
+    LayerTask *task = (LayerTask*)context;
+    Layer *layer = task->layer;
+    Layer *nextLayer = task->nextLayer;
+    
+    int nodeCount     = getLayerNodeCount(layer->layerDef);
+    int nextNodeCount = getLayerNodeCount(nextLayer->layerDef);
+    
+    memset(layer->errorSums + first, 0, (last-first) * sizeof(Real));
+    
+    for (int r=0; r<nextNodeCount; r++)
+        addScaledVector(layer->errorSums + first, nextLayer->weightsPtr + (r * nodeCount) + first, nextLayer->errorSums[r], last-first);
+    
+}
+
+
+
+
+/**
+ * @brief Calculates the total errors of all nodes of a layer by adding up all the partial errors from the following layer
+ * @details The errors are back propagated through the following layer's weights, i.e. with the transpose of
+ * its weight matrix (FULLY_CONNECTED/OUTPUT) or with a transposed convolution (CONVOLUTIONAL), so that nodes don't
+ * need to store any forward connections. The derivative of the activation function is NOT applied here.
+ * @param nn A pointer to the neural network
+ * @param layer A pointer to the layer whose errorSums are to be calculated
+ * @param nextLayer A pointer to the following layer whose errors are back propagated
+ */
+
+void calcLayerErrors(Network *nn, Layer *layer, Layer *nextLayer){
+    
+    if (!isDenseLayer(nn, nextLayer)) {
+        calcGraphLayerErrors(layer, nextLayer);
+        return;
+    }
+    
+    if (nextLayer->layerDef->layerType==CONVOLUTIONAL) {
+        calcConvLayerErrors(nn, layer, nextLayer);
+        return;
+    }
+    
+    LayerTask task = {.nn=nn, .layer=layer, .nextLayer=nextLayer};
+    
+    int nodeCount     = getLayerNodeCount(layer->layerDef);
+    int nextNodeCount = getLayerNodeCount(nextLayer->layerDef);
+    
+    runParallelFor(nn->threadPool, nodeCount, getLayerGrainSize(nn, nextNodeCount), calcDenseLayerErrorNodes, &task);
+    
+}
+
+
+
+
+/**
+ * @brief Applies the derivative to the errorSums of a range of columns of a layer and updates their nodes' weights
+ * by walking the nodes' connections (connection graph engine, parallel task)
+ * @param context A pointer to the LayerTask
+ * @param first The first column whose nodes are to be updated
+ * @param last The column following the last column whose nodes are to be updated
+ * @param threadId The index of the executing thread (unused)
+ */
+
+void updateGraphLayerColumns(void *context, int first, int last, int threadId){
+    
+    LayerTask *task = (LayerTask*)context;
+    Network *nn = task->nn;
+    Layer *hl = task->layer;
+    Layer *prevLayer = task->prevLayer;
+    
+    for (int c=first; c<last; c++){
+        
+        for (int n=0; n<hl->columns[0].nodeCount; n++){
+            
+            Node *hn = getNetworkNode(hl,c,n);
+            
+            hl->errorSums[hn->id] *= getDerivative(hl->outputs[hn->id], hl->layerDef->activationType);
+
+            if (isBatchTraining(nn)) accumulateNodeGradients(hn, hl, prevLayer);
+            else updateNodeWeights(hn, hl, prevLayer, nn->learningRate);
+            
+        }
+        
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Back propagates network error to hidden layer
+ * @details Backpropagating a layer means looping through all its nodes' connections,
+ * and update the errorSum attached to the TARGET node (=previous layer) of each connection
+ * i.e. when "backpropagating" layer x, then the errorSum of the nodes of layer x-1 are calculated
+ * @param nn A pointer to the neural network
+ * @param layerId The id of the layer that is to be back propagated
+ */
+
+void backPropagateLayer(Network *nn, int layerId){
+    
+    Layer *hl = getNetworkLayer(nn, layerId);
+    Layer *prevLayer = getNetworkLayer(nn, layerId-1);
+    Layer *nextLayer = getNetworkLayer(nn, layerId+1);
+    
+    calcLayerErrors(nn, hl, nextLayer);
+    
+    // Dense layers apply the derivatives to all errorSums first and then update all weights at once
+    if (isDenseLayer(nn, hl)){
+        
+        int nodeCount = getLayerNodeCount(hl->layerDef);
+        
+        scaleByDerivative(hl->errorSums, hl->outputs, nodeCount, hl->layerDef->activationType);
+        
+        updateDenseLayerWeights(nn, hl);
+        return;
+    }
+    
+    LayerTask task = {.nn=nn, .layer=hl, .prevLayer=prevLayer};
+
+    // @attention The nodes of a convolutional layer share their weights, i.e. their columns can't be updated in parallel
+    if (hl->layerDef->layerType==CONVOLUTIONAL) updateGraphLayerColumns(&task, 0, hl->columnCount, 0);
+    else {
+        int columnCost = hl->columns[0].nodeCount * getNodeBackwardConnectionCount(hl->layerDef);
+        runParallelFor(nn->threadPool, hl->columnCount, getLayerGrainSize(nn, columnCost), updateGraphLayerColumns, &task);
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Calculates the error (difference of desired classification vs actual node output) of each output node
+ * and back propagates the error in the output layer to the previous layer
+ * @details The error is calculated based on the given target classification (= image label)
+ * and is stored in each output node so that it can be backpropagated later
+ * @param nn A pointer to the neural network
+ * @param targetClassification The correct/desired classification (=label) of this recognition/image
+ */
+
+void backPropagateOutputLayer(Network *nn, int targetClassification){
+    
+    Layer *ol = getNetworkLayer(nn, nn->layerCount-1);
+    Layer *prevLayer = getNetworkLayer(nn, nn->layerCount-2);
+    
+    // Dense layers calculate all errorSums first and then update all weights at once
+    if (isDenseLayer(nn, ol)){
+        
+        int nodeCount = getLayerNodeCount(ol->layerDef);
+        
+        // @attention The output layer's depth is 1, i.e. the node index equals the column index
+        for (int o=0; o<nodeCount; o++){
+            int targetOutput = (o==targetClassification)?1:0;
+            ol->errorSums[o] = targetOutput - ol->outputs[o];
+        }
+        
+        scaleByDerivative(ol->errorSums, ol->outputs, nodeCount, ol->layerDef->activationType);
+        
+        updateDenseLayerWeights(nn, ol);
+        return;
+    }
+    
+    for (int o=0;o<ol->columnCount;o++){
+    
+        for (int n=0; n<ol->columns[0].nodeCount; n++){
+            
+            Node *on = getNetworkNode(ol,o,n);
+            
+            int targetOutput = (o==targetClassification)?1:0;
+            
+            Real errorDelta = targetOutput - ol->outputs[on->id];
+            
+            ol->errorSums[on->id] = errorDelta * getDerivative(ol->outputs[on->id], ol->layerDef->activationType);
+
+            if (isBatchTraining(nn)) accumulateNodeGradients(on, ol, prevLayer);
+            else updateNodeWeights(on, ol, prevLayer, nn->learningRate);
+            
+        }
+        
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Applies the gradients accumulated during the current mini-batch to the network's weights and biases
+ * @details Weights are moved by learningRate times the average gradient of the batch's samples.
+ * This is called automatically by backPropagateNetwork() after each batchSize samples. Call it once more
+ * after the last sample to apply a partially filled batch. Does nothing if no gradients are accumulated.
+ * @param nn A pointer to the neural network
+ */
+
+void updateNetworkWeights(Network *nn){
+    
+    if (nn->batchSampleCount==0) return;
+    
+    Weight rate = nn->learningRate / nn->batchSampleCount;
+    
+    // Update all weights at once (the gradients block has the same layout as the weights block)
+    addScaledVector(nn->weightsPtr, nn->gradientsPtr, rate, nn->weightCount);
+    memset(nn->gradientsPtr, 0, nn->weightCount * sizeof(Weight));
+    
+    // Update the nodes' bias weights (bias gradients have the same layout as the biases)
+    addScaledVector(nn->biasesPtr, nn->biasGradientsPtr, rate, nn->nodeCount);
+    memset(nn->biasGradientsPtr, 0, nn->nodeCount * sizeof(Weight));
+    
+    nn->batchSampleCount = 0;
+}
+
+
+
+
+/**
+ * @brief Data structure shared by the parallel tasks reducing the gradients of several replicas of a network
+ */
+
+typedef struct GradientReduction{
+    Network *nn;                // network whose weights and biases are updated
+    Network **replicas;         // replicas whose gradients are reduced
+    int replicaCount;           // number of replicas
+    Weight rate;                // factor applied to the reduced gradients (learning rate / number of samples)
+} GradientReduction;
+
+
+
+
+/**
+ * @brief Reduces a range of chunks of the replicas' gradients and applies them to the weights and biases (parallel task)
+ * @details Each replica's gradients block holds the gradients of all weights followed by the gradients of all
+ * biases. For each chunk, the replicas' gradients are added up pairwise in a binary tree (replica 0 += replica 1,
+ * 2 += 3, ..., then 0 += 2, ...), so that a chunk stays in the cache while all levels of the tree are reduced.
+ * Since the tree only depends on the number of replicas, the result is the same no matter which thread reduces
+ * which chunk. Afterwards the chunk's gradients are applied and reset.
+ * @param context A pointer to the GradientReduction
+ * @param first The first chunk to be reduced
+ * @param last The chunk following the last chunk to be reduced
+ * @param threadId The index of the executing thread (unused)
+ */
+
+void reduceGradientChunks(void *context, int first, int last, int threadId){
+    
+    GradientReduction *reduction = (GradientReduction*)context;
+    Network *nn = reduction->nn;
+    Network **replicas = reduction->replicas;
+    
+    int gradientCount = nn->weightCount + nn->nodeCount;
+    
+    for (int chunk=first; chunk<last; chunk++){
+        
+        int start = chunk * GRADIENT_REDUCTION_CHUNK_SIZE;
+        int count = (gradientCount-start < GRADIENT_REDUCTION_CHUNK_SIZE) ? gradientCount-start : GRADIENT_REDUCTION_CHUNK_SIZE;
+        
+        for (int step=1; step<reduction->replicaCount; step*=2){
+            for (int r=0; r+step<reduction->replicaCount; r+=2*step)
+                addScaledVector(replicas[r]->gradientsPtr + start, replicas[r+step]->gradientsPtr + start, 1, count);
+        }
+        
+        // The chunk may cover weights, biases or (at the border) both
+        Weight *sum = replicas[0]->gradientsPtr + start;
+        int weightCount = (start >= nn->weightCount) ? 0 : (start+count <= nn->weightCount) ? count : nn->weightCount-start;
+        
+        if (weightCount>0) addScaledVector(nn->weightsPtr + start, sum, reduction->rate, weightCount);
+        if (count>weightCount) addScaledVector(nn->biasesPtr + (start + weightCount - nn->weightCount), sum + weightCount, reduction->rate, count - weightCount);
+        
+        for (int r=0; r<reduction->replicaCount; r++) memset(replicas[r]->gradientsPtr + start, 0, count * sizeof(Weight));
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Applies the gradients accumulated by several replicas of a network (synchronous data-parallel training)
+ * @details Each replica has back propagated a different shard of the same mini-batch into its own gradients.
+ * The gradients are reduced by a parallel tree reduction (using the network's thread pool) and the weights are moved
+ * once by learningRate times the average gradient of all samples. For a given number of replicas (and the same
+ * assignment of samples to replicas) the result is bit-identical, no matter how many threads the pool has.
+ * @param nn A pointer to the neural network whose weights and biases are updated
+ * @param replicas An array of pointers to the replicas of the network (see createNetworkReplica)
+ * @param replicaCount Number of replicas
+ */
+
+void applyReplicaGradients(Network *nn, Network **replicas, int replicaCount){
+    
+    int sampleCount = 0;
+    for (int r=0; r<replicaCount; r++) sampleCount += replicas[r]->batchSampleCount;
+    
+    if (sampleCount==0) return;
+    
+    GradientReduction reduction = {.nn=nn, .replicas=replicas, .replicaCount=replicaCount, .rate=nn->learningRate/sampleCount};
+    
+    int chunkCount = (nn->weightCount + nn->nodeCount + GRADIENT_REDUCTION_CHUNK_SIZE-1) / GRADIENT_REDUCTION_CHUNK_SIZE;
+    
+    runParallelFor(nn->threadPool, chunkCount, 1, reduceGradientChunks, &reduction);
+    
+    for (int r=0; r<replicaCount; r++) replicas[r]->batchSampleCount = 0;
+}
+
+
+
+
+/**
+ * @brief Data structure shared by the shards of a mini-batch in synchronous data-parallel training
+ */
+
+typedef struct BatchShards{
+    Network **replicas;         // one replica of the trained network per shard
+    int shardCount;             // number of shards (=replicas)
+    const Real *inputs;         // normalized images of the mini-batch (count x imageSize values)
+    int imageSize;              // number of values per image
+    const MNIST_Label *labels;  // labels of the mini-batch's images
+    int count;                  // number of images in the mini-batch
+    int errCount;               // number of misclassified images of all shards
+} BatchShards;
+
+
+
+
+/**
+ * @brief Feeds forward and back propagates the images of a range of shards of a mini-batch (parallel task)
+ * @details Shard s consists of the images s*count/shardCount to (s+1)*count/shardCount-1 of the batch and is
+ * always processed by replica s, i.e. the gradients accumulated by each replica do not depend on the thread.
+ * @param context A pointer to the BatchShards
+ * @param first The first shard
+ * @param last The shard following the last shard
+ * @param threadId The index of the executing thread (unused)
+ */
+
+void trainBatchShards(void *context, int first, int last, int threadId){
+    
+    BatchShards *shards = (BatchShards*)context;
+    
+    for (int s=first; s<last; s++){
+        
+        Network *replica = shards->replicas[s];
+        Real *inputBuffer = getNetworkInputBuffer(replica, shards->imageSize);
+        
+        int firstImg = (s * shards->count) / shards->shardCount;
+        int lastImg  = ((s+1) * shards->count) / shards->shardCount;
+        
+        for (int i=firstImg; i<lastImg; i++){
+            
+            MNIST_Label lbl = shards->labels[i];
+            
+            memcpy(inputBuffer, shards->inputs + (i * shards->imageSize), shards->imageSize * sizeof(Real));
+            
+            feedForwardNetwork(replica);
+            backPropagateNetwork(replica, lbl);
+            
+            if (getNetworkClassification(replica)!=lbl) __atomic_add_fetch(&shards->errCount, 1, __ATOMIC_RELAXED);
+        }
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Trains a network on one mini-batch by splitting it into shards that are back propagated in parallel by
+ * replicas of the network (synchronous data-parallel training) and returns the number of misclassified images
+ * @details Each shard is back propagated by its own replica into the replica's gradients (the replicas must have a
+ * batchSize so large that they never apply the gradients themselves). Once all shards are done, the gradients are
+ * applied by applyReplicaGradients(). The shards are processed by the network's thread pool, and the replicas may
+ * use the same pool for their layers. For a fixed number of shards the trained weights are bit-identical, no matter
+ * how many threads the pool has. A single shard gives the same weights as serial training with batchSize = count.
+ * @param nn A pointer to the neural network whose weights and biases are updated
+ * @param replicas An array of shardCount pointers to the replicas of the network (see createNetworkReplica)
+ * @param shardCount Number of shards (=replicas)
+ * @param inputs A pointer to the normalized images of the mini-batch (count x imageSize values)
+ * @param imageSize Number of values per image (must be the number of nodes in the INPUT layer)
+ * @param labels A pointer to the labels of the mini-batch's images
+ * @param count Number of images in the mini-batch
+ */
+
+int trainNetworkShards(Network *nn, Network **replicas, int shardCount, const Real *inputs, int imageSize, const MNIST_Label *labels, int count){
+    
+    BatchShards shards = {.replicas=replicas, .shardCount=shardCount, .inputs=inputs, .imageSize=imageSize, .labels=labels, .count=count, .errCount=0};
+    
+    runParallelFor(nn->threadPool, shardCount, 1, trainBatchShards, &shards);
+    
+    applyReplicaGradients(nn, replicas, shardCount);
+    
+    return shards.errCount;
+}
+
+
+
+
+/**
+ * @brief Back propagates a range of layers, starting with the last one (e.g. one stage of a layer pipeline)
+ * @details If the range includes the OUTPUT layer, its errors are calculated from the targetClassification first.
+ * Otherwise the errorSums of the layer following the range must have been calculated before. Once the range
+ * reaches the first hidden layer the sample is complete, i.e. in mini-batch mode it is counted (and the weights
+ * are updated once the batch is complete).
+ * @param nn A pointer to the neural network
+ * @param firstLayer The id of the first layer of the range (at least 1)
+ * @param lastLayer The id of the layer following the last layer of the range (at most nn->layerCount)
+ * @param targetClassification The correct/desired classification (=label) of this recognition/image
+ */
+
+void backPropagateLayers(Network *nn, int firstLayer, int lastLayer, int targetClassification){
+    
+    if (lastLayer==nn->layerCount){
+        backPropagateOutputLayer(nn, targetClassification);
+        lastLayer--;
+    }
+    
+    for (int i=lastLayer-1; i>=firstLayer; i--) backPropagateLayer(nn, i);
+    
+    // In mini-batch mode update the weights once the batch is complete
+    if (firstLayer<=1 && isBatchTraining(nn)){
+        nn->batchSampleCount++;
+        if (nn->batchSampleCount >= nn->batchSize) updateNetworkWeights(nn);
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Backpropagates the output nodes' errors from output layer backwards to first layer
+ *
+ * @details The network's backpropagation proceeds in 2 steps:
+ *
+ * 1. CALCULATE OUTPUT NODES' ERRORS
+ * a. Calculate the errorsums in all output cells based on the targetClassification
+ *
+ * 2. BACKPROPAGATE EACH LAYER
+ * a. Update the nodes weights based on actual output and accumulated errorsum
+ * b. Calculate the errorsums in all TARGET cells based on errorsum in this layer (calculated in 3)
+ *
+ * If the network's batchSize is larger than 1, the weight changes are accumulated as gradients instead
+ * and applied (via updateNetworkWeights) once batchSize samples have been back propagated.
+ *
+ * @param nn A pointer to the neural network
+ * @param targetClassification The correct/desired classification (=label) of this recognition/image
+ */
+
+void backPropagateNetwork(Network *nn, int targetClassification){
 
     // Loop backwards from the output layer to the SECOND=#1 layer
     // (the FIRST=#0 layer is the input layer)
-    for (int i=(nn->layerCount)-2; i>0; i--) backPropagateLayer(nn, i);
+    backPropagateLayers(nn, 1, nn->layerCount, targetClassification);
     
 }
 
@@ -598,86 +1452,237 @@ void backPropagateNetwork(Network *nn, int targetClassification){
 /**
  * @brief Performs an activiation function to a specified node
  * @param node Pointer to the node that is to be "activated"
- * @param actType The type of activation function to be applied (SIGMOID/TANH/RELU)
+ * @param layer Pointer to the layer in which the node is located
  */
 
-void activateNode(Node *node, ActFctType actType){
+void activateNode(Node *node, Layer *layer){
     
-    switch (actType) {
-        case SIGMOID:
-            node->output = 1 / (1 + (exp((Weight)-node->output)) );
-            break;
-            
-        case TANH:
-            node->output = tanh(node->output);
-            break;
+    layer->outputs[node->id] = activateValue(layer->outputs[node->id], layer->layerDef->activationType);
+    
+}
+
+
+
+
+/**
+ * @brief Calculates the output value of a specified node 
+ * @details Calculates the vector product of a node's weights with the connections' target nodes' outputs
+ * @param node Pointer to the node whose output is to be calculated
+ * @param layer Pointer to the layer in which the node is located
+ * @param prevLayer Pointer to the previous layer to which the node's backward connections point to
+ */
+
+void calcNodeOutput(Node *node, Layer *layer, Layer *prevLayer){
+    
+    // Start by adding the bias
+    Real output = layer->biases[node->id];
+
+    // @attention When calculating node output only loop through the BACKWARD connections
+    for (int i=0; i<node->backwardConnCount;i++){
+        
+        Connection *conn = &node->connections[i];
+        
+        output += prevLayer->outputs[conn->nodeId] * layer->weightsPtr[conn->weightId];
+    
+    }
+    
+    layer->outputs[node->id] = output;
+    
+}
+
+
+
+
+/**
+ * @brief Calculates the output values of a range of nodes of a fully connected layer (parallel task)
+ * @details The previous layer's outputs are multiplied with the nodes' rows of the layer's weight matrix.
+ * Afterwards each node's bias is added and its activation function applied.
+ * @param context A pointer to the LayerTask
+ * @param first The first node whose output is to be calculated
+ * @param last The node following the last node whose output is to be calculated
+ * @param threadId The index of the executing thread (unused)
+ */
+
+void calcDenseLayerNodes(void *context, int first, int last, int threadId){
+    
+    LayerTask *task = (LayerTask*)context;
+    Layer *layer = task->layer;
+    Layer *prevLayer = task->prevLayer;
+    
+    int inCount = getLayerNodeCount(prevLayer->layerDef);
+    
+    calcMatrixVectorProduct(layer->weightsPtr + (first * inCount), prevLayer->outputs, last-first, inCount, layer->outputs + first);
+    
+    addLayerBiases(layer, first, last-first);
+    
+    activateVector(layer->outputs + first, last-first, layer->layerDef->activationType);
+    
+}
+
+
+
+
+/**
+ * @brief Calculates the output values of all nodes of a fully connected layer as one matrix-vector product
+ * @details The rows of the matrix (=nodes) are calculated in parallel (see calcDenseLayerNodes).
+ * @param nn A pointer to the neural network
+ * @param layer Pointer to the (FULLY_CONNECTED or OUTPUT) layer whose nodes are to be calculated
+ */
+
+void calcDenseLayer(Network *nn, Layer *layer){
+    
+    LayerTask task = {.nn=nn, .layer=layer, .prevLayer=getNetworkLayer(nn, layer->id-1)};
+    
+    int inCount  = getLayerNodeCount(task.prevLayer->layerDef);
+    int outCount = getLayerNodeCount(layer->layerDef);
+    
+    runParallelFor(nn->threadPool, outCount, getLayerGrainSize(nn, inCount), calcDenseLayerNodes, &task);
+    
+}
+
+
+
+
+/**
+ * @brief Calculates the output values of the nodes of a range of columns of a convolutional layer (parallel task)
+ * @details For every column of this layer the convolution window of the previous layer's outputs
+ * is copied into a contiguous patch which is then multiplied with the layer's
+ * weight matrix (one row per feature map), resulting in the outputs of all nodes of the column.
+ * @param context A pointer to the LayerTask
+ * @param first The first column whose nodes are to be calculated
+ * @param last The column following the last column whose nodes are to be calculated
+ * @param threadId The index of the executing thread (selects the convolution patch)
+ */
+
+void calcConvLayerColumns(void *context, int first, int last, int threadId){
+    
+    LayerTask *task = (LayerTask*)context;
+    Layer *layer = task->layer;
+    Layer *prevLayer = task->prevLayer;
+    
+    LayerDefinition *layerDef = layer->layerDef;
+    Volume *inputMap = &prevLayer->layerDef->nodeMap;
+    
+    int filter    = layerDef->filter;
+    int width     = layerDef->nodeMap.width;
+    int depth     = layerDef->nodeMap.depth;
+    int stride    = calcStride(inputMap->width, filter, width);
+    int patchSize = getNodeBackwardConnectionCount(layerDef);
+    
+    Weight *patch = getThreadPatch(task->nn, threadId);
+    
+    for (int c=first; c<last; c++){
+        
+        fillConvolutionPatch(prevLayer->outputs, inputMap, filter, (c % width) * stride, (c / width) * stride, patch);
+        
+        Real *products = layer->outputs + (c * depth);
+        
+        calcMatrixVectorProduct(layer->weightsPtr, patch, depth, patchSize, products);
+        
+    }
+    
+    addLayerBiases(layer, first * depth, (last-first) * depth);
+    
+    activateVector(layer->outputs + (first * depth), (last-first) * depth, layerDef->activationType);
+    
+}
+
+
+
+
+/**
+ * @brief Calculates the output values of all nodes of a convolutional layer (im2col + matrix-vector product)
+ * @details The columns are calculated in parallel (see calcConvLayerColumns).
+ * @param nn A pointer to the neural network
+ * @param layer Pointer to the CONVOLUTIONAL layer whose nodes are to be calculated
+ */
+
+void calcConvLayer(Network *nn, Layer *layer){
+    
+    LayerTask task = {.nn=nn, .layer=layer, .prevLayer=getNetworkLayer(nn, layer->id-1)};
+    
+    int columnCost = layer->layerDef->nodeMap.depth * getNodeBackwardConnectionCount(layer->layerDef);
+    
+    runParallelFor(nn->threadPool, layer->columnCount, getLayerGrainSize(nn, columnCost), calcConvLayerColumns, &task);
+    
+}
+
+
+
+
+/**
+ * @brief Calculates the output values of the nodes of a range of columns by walking the nodes' connections
+ * (connection graph engine, parallel task)
+ * @param context A pointer to the LayerTask
+ * @param first The first column whose nodes are to be calculated
+ * @param last The column following the last column whose nodes are to be calculated
+ * @param threadId The index of the executing thread (unused)
+ */
+
+void calcGraphLayerColumns(void *context, int first, int last, int threadId){
+    
+    LayerTask *task = (LayerTask*)context;
+    Layer *layer = task->layer;
+    
+    for (int c=first; c<last; c++){
+        
+        for (int n=0; n<layer->columns[0].nodeCount; n++){
             
-        case RELU:
-            node->output =   log(1 + pow(M_E,node->output));
-            break;
+            Node *node = getNetworkNode(layer, c, n);
             
-        case NONE:
-            break;
+            calcNodeOutput(node, layer, task->prevLayer);
+            activateNode(node, layer);
             
-        default:
-            printf("Undefined activation function! ABORT!\n");
-            exit(1);
-            break;
+        }
+        
     }
-    
-    
 }
 
 
 
 
 /**
- * @brief Calculates the output value of a specified node 
- * @details Calculates the vector product of a node's weights with the connections' target nodes' outputs
- * @param node Pointer to the node whose output is to be calculated
+ * @brief Calculates the output values of all nodes of a given layer
+ * @details Fully connected and convolutional layers are calculated by the dense engine. If the network
+ * uses the GRAPH_ENGINE, all layers are calculated by walking each node's connections instead.
+ * If the network has a thread pool, the columns/nodes of the layer are calculated in parallel.
+ * @param nn A pointer to the neural network
+ * @param layer Pointer to the layer whose nodes are to be activated/calculated
  */
 
-void calcNodeOutput(Node *node){
+void calcNetworkLayer(Network *nn, Layer *layer){
     
-    // Start by adding the bias
-    node->output = node->bias;
+    if (isDenseLayer(nn, layer)) {
+        if (layer->layerDef->layerType==CONVOLUTIONAL) calcConvLayer(nn, layer);
+        else calcDenseLayer(nn, layer);
+        return;
+    }
 
-    // @attention When calculating node output only loop through the BACKWARD connections
-    for (int i=0; i<node->backwardConnCount;i++){
-        
-        Node *targetNode = node->connections[i].nodePtr;
-        
-        if (targetNode != NULL) {
-            Weight weight = *node->connections[i].weightPtr;
-            node->output += targetNode->output * weight;
-        }
+    LayerTask task = {.nn=nn, .layer=layer, .prevLayer=getNetworkLayer(nn, layer->id-1)};
     
-    }
+    int columnCost = layer->columns[0].nodeCount * getNodeBackwardConnectionCount(layer->layerDef);
     
+    runParallelFor(nn->threadPool, layer->columnCount, getLayerGrainSize(nn, columnCost), calcGraphLayerColumns, &task);
 }
 
 
 
 
 /**
- * @brief Calculates the output values of all nodes of a given layer
- * @param layer Pointer to the layer whose nodes are to be activated/calculated
+ * @brief Feeds forward a range of layers (e.g. one stage of a layer pipeline)
+ * @details The outputs of the layer preceding the range must have been calculated before.
+ * @param nn A pointer to the NN
+ * @param firstLayer The id of the first layer of the range (at least 1)
+ * @param lastLayer The id of the layer following the last layer of the range (at most nn->layerCount)
  */
 
-void calcNetworkLayer(Layer *layer){
-
-    for (int c=0;c<layer->columnCount; c++){
-        
-        for (int n=0; n<layer->columns[0].nodeCount; n++){
-            
-            Node *node = getNetworkNode(layer, c, n);
-            
-            calcNodeOutput(node);
-            activateNode(node, layer->layerDef->activationType);
-            
-        }
-        
+void feedForwardLayers(Network *nn, int firstLayer, int lastLayer){
+    
+    for (int l=firstLayer; l<lastLayer; l++){
+        Layer *layer = getNetworkLayer(nn, l);
+        calcNetworkLayer(nn, layer);
     }
+    
 }
 
 
@@ -691,10 +1696,7 @@ void calcNetworkLayer(Layer *layer){
 
 void feedForwardNetwork(Network *nn){
     
-    for (int l=1; l<nn->layerCount; l++){  // @ATTENTION: Skip the first (=INPUT) layer!
-        Layer *layer = getNetworkLayer(nn, l);
-        calcNetworkLayer(layer);
-    }
+    feedForwardLayers(nn, 1, nn->layerCount);  // @ATTENTION: Skip the first (=INPUT) layer!
     
 }
 
@@ -716,12 +1718,33 @@ void feedInput(Network *nn, Vector *v) {
         exit(1);
     }
     
-    // Copy the vector content to the "output" field of the input layer nodes
-    for (int i=0; i<v->count;i++){
-        Node *inputNode = getNetworkNode(inputLayer, i, 0);     // use 1st level of the column
-        inputNode->output = v->vals[i];
+    // Copy the vector content to the outputs of the input layer nodes
+    // @attention The input layer's depth is 1, i.e. the node index equals the column index
+    for (int i=0; i<v->count;i++) inputLayer->outputs[i] = v->vals[i];
+    
+}
+
+
+
+
+/**
+ * @brief Returns a pointer to the activations of the INPUT layer, so that input data can be written into them directly
+ * @details This is the allocation-free alternative to feedInput(): the returned buffer is part of the network and is
+ * reused for every sample, e.g. normalizeImage(&img, getNetworkInputBuffer(nn, MNIST_IMG_WIDTH*MNIST_IMG_HEIGHT))
+ * @param nn A pointer to the neural network
+ * @param count The number of values that are to be written (must be the number of nodes in the INPUT layer)
+ */
+
+Real *getNetworkInputBuffer(Network *nn, int count){
+    
+    Layer *inputLayer = nn->layers;     // @warning Input layer MUST be the FIRST layer in the network
+    
+    if (count != getLayerNodeCount(inputLayer->layerDef)){
+        printf("Number of input values must be the same as number of nodes in the NN's INPUT layer! ABORT!!\n");
+        exit(1);
     }
     
+    return inputLayer->outputs;
 }
 
 
@@ -742,10 +1765,10 @@ int getNetworkClassification(Network *nn){
     
     for (int i=0; i<l->columnCount; i++){
         
-        Node *on = getNetworkNode(l,i,0); // only consider/use 1st level of column
+        Real output = l->outputs[i * l->columns[0].nodeCount]; // only consider/use 1st level of column
     
-        if (on->output > maxOut){
-            maxOut = on->output;
+        if (output > maxOut){
+            maxOut = output;
             maxInd = i;
         }
     }
@@ -756,41 +1779,113 @@ int getNetworkClassification(Network *nn){
 
 
 
-/*
- * @brief Initialize the network's weights in the weight block with random numbers (-1 to +1)
- * @param nn A pointer to the neural network
+/**
+ * @brief Data structure holding the data shared by all chunks during the (parallel) initialization of the weights
+ */
+
+typedef struct WeightInitTask{
+    Network *nn;                // network whose weights are to be initialized
+    uint64_t seed;              // seed of the random numbers
+} WeightInitTask;
+
+
+
+
+/**
+ * @brief Returns the limit of the (uniform) range from which the initial weights of a layer are drawn
+ * @details The range is scaled by the number of inputs of each node (fan-in), so that the variance of the nodes'
+ * outputs neither explodes nor vanishes in deep networks. RELU layers use the He scheme (variance 2/fanIn),
+ * all other activation functions use the (fan-in) Xavier scheme (variance 1/fanIn).
+ * @param layerDef A pointer to the layer definition
  */
 
-void initNetworkWeights(Network *nn){
+Weight getWeightInitLimit(LayerDefinition *layerDef){
     
-    // Init weights in the weight block
-    for (int i=0; i<nn->weightCount; i++){
-        Weight *w = &nn->weightsPtr[i];
-        *w = 0.4 * (Weight)rand() / RAND_MAX;   // multiplying by a number <0 results in better performance
-        if (i%2) *w = -*w;                      // make half of the weights negative (for better performance)
-    }
+    int fanIn = getNodeBackwardConnectionCount(layerDef);
+    
+    // a uniform distribution over [-limit,+limit) has a variance of limit^2/3
+    double variance = (layerDef->activationType==RELU) ? 2.0/fanIn : 1.0/fanIn;
     
-    // Init weights in the nodes' bias
-    for (int l=0; l<nn->layerCount;l++){
+    return (Weight)sqrt(3*variance);
+}
+
+
+
+
+/**
+ * @brief Initializes the weights of a range of chunks (task of runParallelFor)
+ * @details The weights of each layer are split into chunks of WEIGHT_INIT_CHUNK_SIZE weights, which are numbered
+ * across all layers. Every chunk uses its own random stream (derived from the layer id and the chunk's index in the
+ * layer), i.e. the resulting weights are the same no matter how many threads are used and which thread initializes
+ * which chunk.
+ * @param context A pointer to the WeightInitTask
+ * @param first The first chunk of the range
+ * @param last The chunk following the last chunk of the range
+ * @param threadId The index of the executing thread (not used)
+ */
+
+void initNetworkWeightChunks(void *context, int first, int last, int threadId){
+    
+    (void)threadId;
+    
+    WeightInitTask *task = (WeightInitTask*)context;
+    Network *nn = task->nn;
+    
+    int chunkId = 0;
+    
+    for (int l=1; l<nn->layerCount && chunkId<last; l++){
+        
         Layer *layer = getNetworkLayer(nn, l);
-        for (int c=0; c<layer->columnCount; c++){
-            Column *column = getLayerColumn(layer, c);
-            for (int n=0; n<column->nodeCount; n++){
-                
-                // init bias weight
-                Node *node = getColumnNode(column, n);
-                node->bias = (Weight)rand()/(RAND_MAX);
-                if (n%2) node->bias = -node->bias;  // make half of the bias weights negative
-                // alternatively can also use a constant bias, e.g.: node->bias = 0.1;
-                
-            }
+        int weightCount = getLayerWeightCount(layer->layerDef);
+        Weight limit = getWeightInitLimit(layer->layerDef);
+        
+        for (int start=0; start<weightCount; start+=WEIGHT_INIT_CHUNK_SIZE, chunkId++){
+            
+            if (chunkId<first || chunkId>=last) continue;
+            
+            int count = (weightCount-start < WEIGHT_INIT_CHUNK_SIZE) ? weightCount-start : WEIGHT_INIT_CHUNK_SIZE;
+            
+            Random rng;
+            seedRandom(&rng, task->seed, RANDOM_STREAM_WEIGHTS, ((uint64_t)l << 32) | (uint64_t)(start / WEIGHT_INIT_CHUNK_SIZE));
+            
+            Weight *w = layer->weightsPtr + start;
+            for (int i=0; i<count; i++) w[i] = (Weight)getRandomRange(&rng, -limit, limit);
         }
     }
+    
 }
 
 
 
 
+/**
+ * @brief Initializes the network's weights and biases with (reproducible) random numbers
+ * @details Weights are drawn uniformly from a range that is scaled by each layer's fan-in (He for RELU, Xavier
+ * otherwise, see getWeightInitLimit), biases start at 0. The chunks of weights are initialized in parallel by the
+ * network's thread pool (serially without a pool), but the result only depends on the seed (not on the number of
+ * threads).
+ * createNetwork() already initializes the weights using DEFAULT_WEIGHT_SEED (on the pool passed to it). Call this
+ * function to re-initialize them using a different seed.
+ * @param nn A pointer to the neural network
+ * @param seed The seed of the random numbers
+ */
+
+void initNetworkWeights(Network *nn, uint64_t seed){
+    
+    int chunkCount = 0;
+    for (int l=1; l<nn->layerCount; l++)
+        chunkCount += (getLayerWeightCount(getNetworkLayer(nn, l)->layerDef) + WEIGHT_INIT_CHUNK_SIZE-1) / WEIGHT_INIT_CHUNK_SIZE;
+    
+    WeightInitTask task = {.nn=nn, .seed=seed};
+    
+    runParallelFor(nn->threadPool, chunkCount, 1, initNetworkWeightChunks, &task);
+    
+    // Biases of all layers are stored contiguously in the node values block
+    for (int n=0; n<nn->nodeCount; n++) nn->biasesPtr[n] = 0;
+}
+
+
+
 
 /**
  * @brief Calculates the stride (number of nodes/columns that are skipped) in a convolutional kernel
@@ -816,8 +1911,7 @@ int calcStride(int tgtWidth, int filter, int srcWidth){
  * The size of the parent/calling feature map is bigger than the target feature map, 
  * i.e. each x'th (2nd) node, horizontally as well as vertically, is skipped.
  * If a filter's target node would be located outside of the target feature map, -1 is assigned as an id.
- * Later all nodes pointing to a -1 node get assigned a weight pointer to the network's "nn->nullWeight",
- * so that they are still dereferencable. (Because NULL pointers would cause an exception/termination.)
+ * Later no connections are created for such "dead" positions.
  * @param srcLayer A pointer to the convolutional layer (SOURCE) that creates connections to its previous layer
  * @param srcColId The id of the column in the convolutional (SOURCE) layer that creates the connections
  * @param tgtLayer A pointer to the TARGET layer to which the convolutional/source layer connects to
@@ -868,14 +1962,12 @@ void calcFilterColumnIds(Layer *srcLayer, int srcColId, Layer *tgtLayer, Vector
 
 
 /**
- * @brief Initializes a single convolutional node by setting its connections weights pointers
+ * @brief Initializes a single convolutional node by setting its connections' node and weight ids
  * @details Each convolutional node has connections to a filter/kernel window of nodes in the previous layer.
  * @param node A pointer to the convolutional node whose connections are to be set/initialized
  * @param srcLevel The node's level inside the column. Needed to calculate the position of the respective weight.
- * @param srcLayerWeightPtr A pointer to the weight block of this (=convolutional node's) layer
  * @param targetLayer A pointer to the target layer to which this convolutional node shall connect to
  * @param filterColIds A vector of indeces/positions of the target columns/nodes that this node connects to
- * @param nullWeight A pointer to a weight that is used (1) to initialize or (2) to link "dead" connections
  *
  * The following describes the logic/algorithm for calculating the weights' position
  *
@@ -895,189 +1987,67 @@ void calcFilterColumnIds(Layer *srcLayer, int srcColId, Layer *tgtLayer, Vector
  * then move 1 level down in the TARGET layer
  */
 
-void initNetworkBackwardConnectionsConvNode(Node *node, int srcLevel, Weight *srcLayerWeightPtr, Layer *targetLayer, Vector *filterColIds, Weight *nullWeight){
+void initNetworkBackwardConnectionsConvNode(Node *node, int srcLevel, Layer *targetLayer, Vector *filterColIds){
     
     int filterSize = filterColIds->count;
     int tgtDepth   = targetLayer->layerDef->nodeMap.depth;
     
-    for (int posInsideFilter=0; posInsideFilter<filterSize; posInsideFilter++){
-        
-        int targetColId = (int)filterColIds->vals[posInsideFilter];
-        
-        for (int tgtLevel=0; tgtLevel<tgtDepth; tgtLevel++){
-            
-            Connection *conn = &node->connections[ (tgtLevel*filterSize)+posInsideFilter];
-            
-            if (targetColId!=OUT_OF_RANGE){
-                
-                // Calculate the weight's id (=position in the weights block)
-                // @warning (need to consistently use the same logic/order
-                // (i.e. first go by target feature map, then by parent feature featureMap, then by node)
-                
-                // SHARE WEIGHTS
-                // Position the weight pointer based on srcLevel, tgtDepth, tgtLevel, filterSize and colId
-                
-                int weightPosition = (srcLevel*(tgtDepth*filterSize)) + (tgtLevel*filterSize) + posInsideFilter;
-                
-                Weight *tgtWeight = srcLayerWeightPtr + weightPosition;
-                
-                Node *tgtNode = getNetworkNode(targetLayer, targetColId, tgtLevel);
-                
-                conn->nodePtr   = tgtNode;
-                conn->weightPtr = tgtWeight;
-            
-            }
-    
-            else {
-            // if filter pixel is out of range of the target nodes then point to NODES if THIS layer
-            // this kind of pointer needs to be captured later i.e. should NOT be CALCULATED/ACTIVATED
-            conn->nodePtr   = NULL;
-            conn->weightPtr = nullWeight;
-    
-            }
-
-        }
-
-    }
-        
-}
-
-
-
-
-/**
- * @brief Initializes a node of a normal, fully connected node
- * @details Creates connections with pointers towards all nodes of the previous layer (=fully connected)
- * @attention The node's bias weight is not initialized here but together with the weights
- * @param thisNode A pointer to the node whose connections are to be added/initialized
- * @param prevLayer A pointer to the PREVIOUS layer which this node will connect to
- * @param nodeWeightPtr A pointer to the memory block that is to store the weights of this node
- */
-
-void initNetworkBackwardConnectionsFCNode(Node *thisNode, Layer *prevLayer, Weight *nodeWeightPtr){
-    
-    // Actually the counters for connId and nodeWeightId are the same (because layer is fully connected)
-    // but I still use 2 different variables to express the different meanings
-    int connId = 0;
-    int nodeWeightId = 0;
-    
-    ByteSize columnSize = getColumnSize(prevLayer->layerDef);
-    
-    uint8_t *sbptr_column = (uint8_t*) prevLayer->columns;
+    int connCount = 0;
     
-    // loop through the columns of the previous layer
-    for (int col=0; col<prevLayer->columnCount;col++){
+    for (int tgtLevel=0; tgtLevel<tgtDepth; tgtLevel++){
         
-        Column *column = (Column *)sbptr_column;
-        
-        uint8_t *sbptr_node = (uint8_t*) column->nodes;
-
-        // loop through the nodes of the column
-        for (int n=0; n<column->nodeCount; n++){
-
-            // @attention Only the backwardConnections are set here. Forward connections need to be set elsewhere.
-            Connection *conn = &thisNode->connections[connId];
+        for (int posInsideFilter=0; posInsideFilter<filterSize; posInsideFilter++){
             
-            // Create a pointer to the next available weight in the network's memory block behind the layers
-            conn->weightPtr = nodeWeightPtr + nodeWeightId;
+            int targetColId = (int)filterColIds->vals[posInsideFilter];
             
-            // Set target node pointer
-            conn->nodePtr = (Node *)sbptr_node;
+            // Skip filter pixels that are out of range of the target nodes
+            if (targetColId==OUT_OF_RANGE) continue;
             
-            sbptr_node += getNodeSize(prevLayer->layerDef);
-
-            connId++;
-            nodeWeightId++;
+            // Calculate the weight's id (=position in the layer's weights)
+            // @warning (need to consistently use the same logic/order
+            // (i.e. first go by target feature map, then by parent feature featureMap, then by node)
             
-        }
-        
-        sbptr_column += columnSize;
-        
-    }
-    
-}
-
-
-
-
-/*
- * @brief Initializes the forward connections of a given node
- * @details Loops through all backward connections of the following layer to find out all nodes
- * that link back to this node. Then creates forward connections from this node to those nodes in
- * the next layer and points to the same weight. Forward connections are strictly speaking not required
- * but useful for increasing performance during back propagation.
- * @param thisNode A pointer to the node whose forward connections are to be initialized
- * @param nextLayer A pointer to the following layer to which this node's forward connections point to
- */
-
-void initNetworkForwardConnectionsAnyNode(Node *thisNode, Layer *nextLayer) {
-    
-    int maxForwardConnCount = thisNode->forwardConnCount;
-    
-    int forwardConnStart = thisNode->backwardConnCount;
-    
-    int forwardConnCount = 0;
-    
-    for (int o=0;o<nextLayer->columnCount;o++){
-        
-        for (int n=0; n<nextLayer->columns[0].nodeCount; n++){
+            // SHARE WEIGHTS
+            // Position the weight based on srcLevel, tgtDepth, tgtLevel, filterSize and colId
             
-            Node *nextLayerNode = getNetworkNode(nextLayer,o, n);
+            Connection *conn = &node->connections[connCount++];
             
-            for (int c=0;c<nextLayerNode->backwardConnCount;c++){
-                
-                // If the connection of the node in the next layer points back to this node
-                // then store this nextNode as a target in the forwardConnections of this node
-                // and point the connection to the same weight
-                if (nextLayerNode->connections[c].nodePtr == thisNode) {
-                    thisNode->connections[forwardConnStart + forwardConnCount].nodePtr = nextLayerNode;
-                    thisNode->connections[forwardConnStart + forwardConnCount].weightPtr = nextLayerNode->connections[c].weightPtr;
-                    forwardConnCount++;
-                    
-                    if (forwardConnCount>maxForwardConnCount) {
-                        printf("Maximum forward connections exceeded! ABORT!\n\n");
-                        exit(1);
-                    }
-                    
-                }
-                
-            }
+            conn->nodeId   = (targetColId * tgtDepth) + tgtLevel;
+            conn->weightId = (srcLevel*(tgtDepth*filterSize)) + (tgtLevel*filterSize) + posInsideFilter;
             
         }
         
-        
     }
     
-    thisNode->forwardConnCount = forwardConnCount;
-    
+    node->backwardConnCount = connCount;
+        
 }
 
 
 
 
-/*
- * @brief Initializes the forward connections in a layer
- * @param nn A pointer to the neural network
- * @param nn The id of the layer to be initialized
+/**
+ * @brief Initializes a node of a normal, fully connected node
+ * @details Creates connections towards all nodes of the previous layer (=fully connected)
+ * @attention The node's bias weight is not initialized here but together with the weights
+ * @param thisNode A pointer to the node whose connections are to be added/initialized
+ * @param prevLayer A pointer to the PREVIOUS layer which this node will connect to
+ * @param nodeWeightId The id of the node's first weight inside the layer's weights
  */
 
-void initNetworkForwardConnections(Network *nn, int layerId) {
+void initNetworkBackwardConnectionsFCNode(Node *thisNode, Layer *prevLayer, int nodeWeightId){
     
-    // Skip the first=INPUT and the last=OUTPUT layer because they don't have forward connections
-    if (layerId==0 || layerId==nn->layerCount-1) return;
+    int prevNodeCount = getLayerNodeCount(prevLayer->layerDef);
     
-    Layer *thisLayer = getNetworkLayer(nn, layerId);
-    Layer *nextLayer = getNetworkLayer(nn, layerId+1);
-    
-    for (int c=0; c<thisLayer->columnCount; c++){
+    // loop through the nodes of the previous layer (ordered by column, then by level)
+    for (int n=0; n<prevNodeCount; n++){
         
-        Column *column = getLayerColumn(thisLayer, c);
+        // @attention Only the backwardConnections are set here. Forward connections need to be set elsewhere.
+        Connection *conn = &thisNode->connections[n];
         
-        for (int n=0; n<column->nodeCount; n++){
-            Node *node = getColumnNode(column, n);
-            initNetworkForwardConnectionsAnyNode(node, nextLayer);
-            
-        }
+        // Point to the previous layer's node and to the next weight of this node
+        conn->nodeId   = n;
+        conn->weightId = nodeWeightId + n;
         
     }
     
@@ -1087,25 +2057,21 @@ void initNetworkForwardConnections(Network *nn, int layerId) {
 
 
 /**
- * @brief Creates and returns an array of FILTER-many column ids representing a moving x*y kernel window
- * @details The actual calculation of the target column ids takes place in a subfunction. 
+ * @brief Creates and returns an (empty) array that can hold FILTER-many column ids representing a moving x*y kernel window
+ * @details The array is created once per layer and then filled for each column via calcFilterColumnIds()
  * @param thisLayer A pointer to the convolutional layer (SOURCE) that creates connections to its previous layer
- * @param columnId The id of the column in the source layer
- * @param prevLayer A pointer to the PREVIOUS=TARGET layer to which the convolutional/source layer connects to
  */
 
-Vector *createFilterColumnIds(Layer *thisLayer, int columnId, Layer *prevLayer){
+Vector *createFilterColumnIds(Layer *thisLayer){
     
     // create an empty vector for storing the target node ids of the filter window
     // number of values in the vector equals the size of the filter window
     // @attention This is done even for non-convolutional layer because their filter is 0 thus no impact
     int colIdCount = thisLayer->layerDef->filter * thisLayer->layerDef->filter;
-    ByteSize vectorSize = sizeof(Vector) + (colIdCount * sizeof(double));  // TODO don't need "double" here
+    ByteSize vectorSize = sizeof(Vector) + (colIdCount * sizeof(Real));    // TODO don't need "Real" here
     
-    // Calculate a matrix of column/node ids depicting a moving filter/kernel window in the target layer
     Vector *filterColIds = (Vector*)malloc(vectorSize);
     filterColIds->count = colIdCount;
-    calcFilterColumnIds(thisLayer, columnId, prevLayer, filterColIds);
     
     return filterColIds;
 }
@@ -1118,26 +2084,26 @@ Vector *createFilterColumnIds(Layer *thisLayer, int columnId, Layer *prevLayer){
  * @param thisLayer A pointer to the layer in which the node is located
  * @param column A pointer to the column in which the node is located
  * @param node A pointer to the node whose values are to be (re)set
- * @param nullWeight A pointer to the network's null weight
+ * @param nodeId The index of the node inside its layer (column * depth + level)
  */
 
-void setNetworkNodeDefaults(Layer *thisLayer, Column *column, Node *node, Weight *nullWeight){
+void setNetworkNodeDefaults(Layer *thisLayer, Column *column, Node *node, int nodeId){
     
     ByteSize nodeSize   = getNodeSize(thisLayer->layerDef);
     
     // Set default values of a node
     node->size     = nodeSize;
-    node->bias     = 0;
-    node->output   = 0;
-    node->errorSum = 0;
+    node->id       = nodeId;
+    thisLayer->biases[nodeId]    = 0;
+    thisLayer->outputs[nodeId]   = 0;
+    thisLayer->errorSums[nodeId] = 0;
     node->backwardConnCount= getNodeBackwardConnectionCount(thisLayer->layerDef);
-    node->forwardConnCount = getNodeForwardConnectionCount(thisLayer->layerDef);
     
-    // Resest ALL (backward + forward) connections of a node to avoid any undefined pointers
+    // Resest ALL connections of a node to avoid any undefined ids
     for (int c=0; c<column->maxConnCountPerNode; c++){
         Connection *conn = node->connections + c;
-        conn->nodePtr   = NULL;
-        conn->weightPtr = nullWeight;
+        conn->nodeId   = 0;
+        conn->weightId = 0;
     }
     
 }
@@ -1148,24 +2114,23 @@ void setNetworkNodeDefaults(Layer *thisLayer, Column *column, Node *node, Weight
 /**
  * @brief Initializes the nodes in a given network column
  * @details Creates the column/node structure inside the network's respective memory block.
- * Connections will be initialized with a NULL pointer and a default ->nullWeight pointer
- * (for null weights I don't use NULL to avoid exceptions if it is (mistakenly?) dereferenced)
- * @param nn A pointer to the network
- * @param layerId The index of the layer whose column=nodes are to be initialized
+ * Connections are initialized with the ids of their target nodes in the previous layer and of their weights
+ * (each connection is written exactly once, i.e. the work is linear in the number of connections)
+ * @param thisLayer A pointer to the layer whose column=nodes are to be initialized
+ * @param prevLayer A pointer to the previous layer to which the nodes connect to (NULL for the INPUT layer)
  * @param columnId The index of the column whose nodes are to be initialized
+ * @param filterColIds A vector that receives the ids of the target columns (used by conv layers only)
  */
 
-void initNetworkNodes(Network *nn, int layerId, int columnId){
+void initNetworkNodes(Layer *thisLayer, Layer *prevLayer, int columnId, Vector *filterColIds){
     
-    Layer *thisLayer    = getNetworkLayer(nn, layerId);
-    Layer *prevLayer    = getNetworkLayer(nn, layerId-1);
     Column *column      = getLayerColumn(thisLayer, columnId);
     ByteSize nodeSize   = getNodeSize(thisLayer->layerDef);
     
     uint8_t *sbptr = (uint8_t*) column->nodes;
 
-    // Create a vector containing the ids of the target columns (conv layers only)
-    Vector *filterColIds = createFilterColumnIds(thisLayer, columnId, prevLayer);
+    // Calculate the ids of the target columns inside this column's filter window (conv layers only)
+    if (thisLayer->layerDef->layerType==CONVOLUTIONAL) calcFilterColumnIds(thisLayer, columnId, prevLayer, filterColIds);
     
     // Init all nodes attached to this column
     for (int n=0; n<column->nodeCount; n++){
@@ -1174,30 +2139,28 @@ void initNetworkNodes(Network *nn, int layerId, int columnId){
         Node *node = (Node*) sbptr;
         sbptr += nodeSize;
 
+        int nodeId = (columnId * column->nodeCount) + n;
+
         // Reset node's defaults
-        setNetworkNodeDefaults(thisLayer, column, node, &nn->nullWeight);
+        setNetworkNodeDefaults(thisLayer, column, node, nodeId);
         
         // Initialize backward connections of fully-connected layer node
         if (thisLayer->layerDef->layerType==FULLY_CONNECTED || thisLayer->layerDef->layerType==OUTPUT){
-            
-            int nodeId = (columnId * column->nodeCount) + n;
 
             // @attention When calculating the weightsId, only consider backwardConnections
             int layerWeightsId = nodeId * getNodeBackwardConnectionCount(thisLayer->layerDef);
-            Weight *nodeWeight = thisLayer->weightsPtr + layerWeightsId;
             
-            initNetworkBackwardConnectionsFCNode(node, prevLayer, nodeWeight);
+            initNetworkBackwardConnectionsFCNode(node, prevLayer, layerWeightsId);
         }
         
         // Initialize backward conections of convolutional layer node
         if (thisLayer->layerDef->layerType==CONVOLUTIONAL){
             // @attention Nodes on the same level share the same weight block
-            initNetworkBackwardConnectionsConvNode(node, n, thisLayer->weightsPtr, prevLayer, filterColIds, &nn->nullWeight);
+            initNetworkBackwardConnectionsConvNode(node, n, prevLayer, filterColIds);
         }
     
     }
 
-    free(filterColIds);
 }
 
 
@@ -1214,12 +2177,15 @@ void initNetworkNodes(Network *nn, int layerId, int columnId){
 void initNetworkColumns(Network *nn, int layerId){
     
     Layer *layer = getNetworkLayer(nn, layerId);
+    Layer *prevLayer = (layerId>0) ? getNetworkLayer(nn, layerId-1) : NULL;
     
     int backwardConnCount = getNodeBackwardConnectionCount(layer->layerDef);
-    int forwardConnCount  = getNodeForwardConnectionCount(layer->layerDef);
     
     ByteSize columnSize = getColumnSize(layer->layerDef);
     
+    // Create a vector for the ids of the target columns (re-used by all columns of this layer)
+    Vector *filterColIds = createFilterColumnIds(layer);
+    
     // Init all columns attached to this layer
     for (int c=0; c<layer->columnCount; c++){
         
@@ -1231,8 +2197,9 @@ void initNetworkColumns(Network *nn, int layerId){
         
         // Set default values of a node
         column->size     = columnSize;
+        column->nodeSize = getNodeSize(layer->layerDef);
         column->nodeCount= layer->layerDef->nodeMap.depth;
-        column->maxConnCountPerNode = backwardConnCount+forwardConnCount;
+        column->maxConnCountPerNode = backwardConnCount;
         
         // Built-in cross checking to confirm initialization is progressing correctly
         Column *testColumn = getLayerColumn(layer, c);
@@ -1242,10 +2209,11 @@ void initNetworkColumns(Network *nn, int layerId){
         }
         
         // Initialize all nodes of a column
-        initNetworkNodes(nn, layerId, c);
+        initNetworkNodes(layer, prevLayer, c, filterColIds);
         
     }
     
+    free(filterColIds);
 }
 
 
@@ -1268,21 +2236,37 @@ void initNetworkLayer(Network *nn, int layerId, LayerDefinition *layerDefs){
     for (int l=0; l<layerId; l++) sbptr1 += getLayerSize(layerDefs+l);
     Layer *layer = (Layer*) sbptr1;
     
+    // Store the layer's position in the layer table (used for all further layer lookups)
+    nn->layerTable[layerId] = layer;
+    
     // Calculate the position of this layer's weights block
     uint8_t *sbptr2 = (uint8_t*) nn->weightsPtr;
     for (int l=0; l<layerId; l++) sbptr2 += getLayerWeightBlockSize(layerDefs+l);
     Weight *w = (Weight*) sbptr2;
     
+    // The layer's gradients are located at the same position inside the gradients block
+    Weight *g = nn->gradientsPtr + (w - nn->weightsPtr);
+    
+    // The layer's node values (and bias gradients) follow the values of all previous layers' nodes
+    int nodeOffset = getNetworkNodeCount(layerId, layerDefs);
+    
     // Set default values for this layer
     layer->id              = layerId;
     layer->layerDef        = layerDef;
     layer->weightsPtr      = w;
+    layer->gradientsPtr    = g;
+    layer->biasGradientsPtr= nn->biasGradientsPtr + nodeOffset;
+    layer->biases          = nn->biasesPtr + nodeOffset;
+    layer->outputs         = nn->outputsPtr + nodeOffset;
+    layer->errorSums       = nn->errorSumsPtr + nodeOffset;
     layer->size            = getLayerSize(layerDef);
+    layer->columnSize      = getColumnSize(layerDef);
     layer->columnCount     = getColumnCount(layerDef);
     
     // Built-in cross checking to confirm initialization is progressing correctly
-    Layer *testLayer = getNetworkLayer(nn, layerId);
-    if (testLayer != layer) {
+    // (the layer must start right after the end of the previous layer)
+    Layer *prevLayer = (layerId>0) ? getNetworkLayer(nn, layerId-1) : NULL;
+    if (prevLayer!=NULL && (uint8_t*)prevLayer + prevLayer->size != (uint8_t*)layer) {
         printf("Error during layer initialization! ABORT!\n");
         exit(1);
     }
@@ -1298,7 +2282,7 @@ void initNetworkLayer(Network *nn, int layerId, LayerDefinition *layerDefs){
 /*
  * @brief Initialize the network
  * @details Creates the structure of layers/columns/nodes/connections/ weights inside the net's memory block.
- * Most importantly, it sets each node's connections and pointers to their target node weights.
+ * Most importantly, it sets each node's connections to their target nodes and weights.
  * @param nn A pointer to the neural network
  * @param layerCount The number of layers of this network
  * @param layerDefs A pointer to an array of the layer definitions for this network
@@ -1307,15 +2291,10 @@ void initNetwork(Network *nn, int layerCount, LayerDefinition *layerDefs){
     
     // Init the network's layers including their backward connections
     // Backward connections point to target nodes in the PREVIOUS layer and are used during FEED FORWARD
-    // (i.e. during calculating node outputs = node activation)
+    // (i.e. during calculating node outputs = node activation) as well as during BACK PROPAGATION
+    // (where errors are pushed back through the same connections/weights, i.e. no forward connections are needed)
     for (int l=0; l<layerCount; l++) initNetworkLayer(nn, l, layerDefs);
     
-    // Init the network's forward connections
-    // Forward connections point to target nodes in the FOLLOWING layer that point back to this node, and
-    // and are used during BACK PROPAGATION (to speed-up calculating the proportional error)
-    // @attention This must be done AFTER(!) the above layer initialization because each layer needs its following layer to have been initialized already!
-    for (int l=0; l<layerCount; l++) initNetworkForwardConnections(nn, l);
-    
 }
 
 
@@ -1332,19 +2311,51 @@ void initNetwork(Network *nn, int layerCount, LayerDefinition *layerDefs){
 
 void setNetworkDefaults(Network *nn, int layerCount, LayerDefinition *layerDefs, ByteSize netSize){
     
-    // get size of weight memory block (located within network, after layers)
+    // get size of weight memory block (located within network, after the layer table)
     ByteSize weightBlockSize = getNetworkWeightBlockSize(layerCount, layerDefs);
     
+    // get size of the mini-batch gradients (located within network, after weights)
+    ByteSize gradientBlockSize = getNetworkGradientBlockSize(layerCount, layerDefs);
+    
+    // get size of the nodes' biases, outputs and errorSums (located within network, after gradients)
+    ByteSize nodeValuesBlockSize = getNetworkNodeValuesBlockSize(layerCount, layerDefs);
+    
+    // get size of the dense scratch buffer (located within network, after the node values)
+    ByteSize denseBufferSize = getNetworkDenseBufferSize(layerCount, layerDefs);
+    
     // Calculate the exact position of the weightBlock and create a pointer pointing to it
     uint8_t *sbptr = (uint8_t*) nn;
-    sbptr += netSize - weightBlockSize;
+    sbptr += netSize - denseBufferSize - nodeValuesBlockSize - gradientBlockSize - weightBlockSize;
     
     // Set the network's default values
     nn->size         = netSize;
     nn->layerCount   = layerCount;
     nn->weightsPtr   = (Weight*)sbptr;
-    nn->nullWeight   = 0;
+    nn->layerTable   = (Layer**)(sbptr - (layerCount * sizeof(Layer*)));
     nn->learningRate = 0.001;      // @attention This value should be chosen based on the activation fct.
+    nn->engine       = DENSE_ENGINE;
+    nn->batchSize    = 1;          // update weights after every sample (plain stochastic gradient descent)
+    nn->batchSampleCount = 0;
+    
+    // The gradients block is split into the weights' gradients and the biases' gradients
+    nn->gradientsPtr     = (Weight*)(sbptr + weightBlockSize);
+    nn->biasGradientsPtr = nn->gradientsPtr + (weightBlockSize / sizeof(Weight));
+    memset(nn->gradientsPtr, 0, gradientBlockSize);
+    
+    // The node values block is split into the biases, the outputs and the errorSums of all nodes
+    nn->nodeCount    = getNetworkNodeCount(layerCount, layerDefs);
+    nn->biasesPtr    = (Weight*)(sbptr + weightBlockSize + gradientBlockSize);
+    nn->outputsPtr   = nn->biasesPtr  + nn->nodeCount;
+    nn->errorSumsPtr = nn->outputsPtr + nn->nodeCount;
+    
+    // The scratch buffer holds a convolution patch
+    nn->densePatchPtr = (Weight*)(sbptr + weightBlockSize + gradientBlockSize + nodeValuesBlockSize);
+    
+    // Layers are calculated serially unless a thread pool is set (see setNetworkThreadPool)
+    nn->threadPool       = NULL;
+    nn->grainSize        = DEFAULT_GRAIN_SIZE;
+    nn->threadPatchesPtr = NULL;
+    nn->threadPatchSize  = 0;
     
     // Calculate the network's number of weights by adding up the layers
     nn->weightCount = 0;
@@ -1361,15 +2372,43 @@ void setNetworkDefaults(Network *nn, int layerCount, LayerDefinition *layerDefs,
 
 
 
+/**
+ * @brief Returns the number of (backward) connections of all nodes in the network
+ * @details Convolutional nodes at the border of a feature map have less connections than the maximum
+ * because connections to positions outside of the previous layer's node map are not stored.
+ * @param nn A pointer to the neural network
+ */
+
+long getNetworkConnectionCount(Network *nn){
+    
+    long connCount = 0;
+    
+    for (int l=0; l<nn->layerCount; l++){
+        Layer *layer = getNetworkLayer(nn, l);
+        for (int c=0; c<layer->columnCount; c++){
+            Column *column = getLayerColumn(layer, c);
+            for (int n=0; n<column->nodeCount; n++) connCount += getColumnNode(column, n)->backwardConnCount;
+        }
+    }
+    
+    return connCount;
+}
+
+
+
+
 /**
  * @brief Creates the neural network based on a given array of layer definitions
  * @details Creates a reserved memory block for this network based on the given layer definitions,
  * and then initializes this memory with the respective layer/node/connection/weights structure.
+ * The network calculates its layers using the given thread pool (see setNetworkThreadPool), which also initializes
+ * the weights in parallel.
  * @param layerCount The number of layer definitions inside the layer-definition-array (2nd param)
  * @param layerDefs A pointer to an array of layer definitions
+ * @param pool A pointer to the thread pool (NULL = calculate all layers serially)
  */
 
-Network *createNetwork(int layerCount, LayerDefinition *layerDefs){
+Network *createNetwork(int layerCount, LayerDefinition *layerDefs, ThreadPool *pool){
     
     // Calculate network size
     ByteSize netSize = getNetworkSize(layerCount, layerDefs);
@@ -1380,14 +2419,27 @@ Network *createNetwork(int layerCount, LayerDefinition *layerDefs){
     // Set network's default values
     setNetworkDefaults(nn, layerCount, layerDefs, netSize);
 
+    // Select the fastest math kernels supported by this CPU (unless selected explicitly before)
+    initKernels();
+    
     // Output message to inform user in case the initialization process takes longer (large network)
     printf("Initializing network... \n\n");
     
+    double startTime = getWallClockTime();
+    
     // Initialize the network's layers, nodes, connections and weights
     initNetwork(nn, layerCount, layerDefs);
     
+    // The pool is set before the weights are built, so that large layers are initialized in parallel
+    setNetworkThreadPool(nn, pool, DEFAULT_GRAIN_SIZE);
+    
     // Init all weights -- located in the network's weights block after the last layer
-    initNetworkWeights(nn);
+    initNetworkWeights(nn, DEFAULT_WEIGHT_SEED);
+    
+    double initTime = getWallClockTime() - startTime;
+    
+    printf("Network initialized in %.3f sec (%'d nodes, %'ld connections, %'d weights, %'lu bytes)\n\n",
+           initTime, nn->nodeCount, getNetworkConnectionCount(nn), nn->weightCount, nn->size);
     
     return nn;
 }
@@ -1395,6 +2447,108 @@ Network *createNetwork(int layerCount, LayerDefinition *layerDefs){
 
 
 
+/**
+ * @brief Lets the network calculate the columns/nodes of each layer in parallel, using the threads of a thread pool
+ * @details Each additional thread of the pool gets its own convolution patch (the calling thread uses the one
+ * inside the network's memory block).
+ * @param nn A pointer to the neural network
+ * @param pool A pointer to the thread pool (NULL = calculate all layers serially)
+ * @param grainSize Minimum number of multiply-adds per parallel task (e.g. DEFAULT_GRAIN_SIZE)
+ */
+
+void setNetworkThreadPool(Network *nn, ThreadPool *pool, int grainSize){
+    
+    free(nn->threadPatchesPtr);
+    
+    nn->threadPool       = pool;
+    nn->grainSize        = grainSize;
+    nn->threadPatchesPtr = NULL;
+    
+    // The patch size is stored, so that tasks can find their thread's patch without walking the layers
+    nn->threadPatchSize  = getNetworkMaxPatchSize(nn->layerCount, nn->layers->layerDef);
+    
+    int extraThreadCount = getThreadCount(pool) - 1;
+    
+    if (nn->threadPatchSize>0 && extraThreadCount>0) nn->threadPatchesPtr = (Weight*)malloc(extraThreadCount * nn->threadPatchSize * sizeof(Weight));
+    
+}
+
+
+
+
+/**
+ * @brief Creates a replica of a network that shares the network's weights and biases, but has its own node outputs,
+ * errorSums, gradients and convolution patch
+ * @details A replica consists of a copy of the network's header, layers and layer table (i.e. of everything located
+ * before the weights block) followed by its own gradients, node values and scratch blocks. All pointers into these
+ * regions are moved to the replica's own memory, except the pointers to the weights and biases, which still point to
+ * the original network. Several threads can therefore feed forward and back propagate different samples at the same
+ * time, each using its own replica, while all of them update the same weights (without any locking).
+ * The replica calculates its layers serially, i.e. without a thread pool. Delete it via deleteNetwork().
+ * @param nn A pointer to the neural network whose weights and biases are shared
+ */
+
+Network *createNetworkReplica(Network *nn){
+    
+    // The network block consists of the header region (network, layers, layer table), the shared weights block
+    // and the per-sample region (gradients, node values, scratch buffer)
+    ByteSize headerSize = (uint8_t*)nn->weightsPtr - (uint8_t*)nn;
+    ByteSize sharedSize = (uint8_t*)nn->gradientsPtr - (uint8_t*)nn->weightsPtr;
+    ByteSize ownSize    = nn->size - headerSize - sharedSize;
+    
+    Network *replica = (Network*)malloc(headerSize + ownSize);
+    
+    memcpy(replica, nn, headerSize);
+    memset((uint8_t*)replica + headerSize, 0, ownSize);
+    
+    // Distances by which pointers into the header region and into the per-sample region are moved
+    ptrdiff_t headerShift = (uint8_t*)replica - (uint8_t*)nn;
+    ptrdiff_t ownShift    = ((uint8_t*)replica + headerSize) - (uint8_t*)nn->gradientsPtr;
+    
+    replica->size             = headerSize + ownSize;
+    replica->batchSampleCount = 0;
+    replica->layerTable       = (Layer**)((uint8_t*)nn->layerTable + headerShift);
+    replica->gradientsPtr     = (Weight*)((uint8_t*)nn->gradientsPtr + ownShift);
+    replica->biasGradientsPtr = (Weight*)((uint8_t*)nn->biasGradientsPtr + ownShift);
+    replica->outputsPtr       = (Real*)((uint8_t*)nn->outputsPtr + ownShift);
+    replica->errorSumsPtr     = (Real*)((uint8_t*)nn->errorSumsPtr + ownShift);
+    replica->densePatchPtr    = (Weight*)((uint8_t*)nn->densePatchPtr + ownShift);
+    replica->threadPool       = NULL;
+    replica->threadPatchesPtr = NULL;
+    
+    // @attention The layers' weights and biases are NOT moved, i.e. they remain shared with the original network
+    for (int l=0; l<nn->layerCount; l++){
+        
+        Layer *layer = (Layer*)((uint8_t*)nn->layerTable[l] + headerShift);
+        
+        replica->layerTable[l]   = layer;
+        layer->gradientsPtr      = (Weight*)((uint8_t*)layer->gradientsPtr + ownShift);
+        layer->biasGradientsPtr  = (Weight*)((uint8_t*)layer->biasGradientsPtr + ownShift);
+        layer->outputs           = (Real*)((uint8_t*)layer->outputs + ownShift);
+        layer->errorSums         = (Real*)((uint8_t*)layer->errorSums + ownShift);
+    }
+    
+    return replica;
+}
+
+
+
+
+/**
+ * @brief Releases the memory of a neural network (but not its layer definitions or its thread pool)
+ * @param nn A pointer to the neural network
+ */
+
+void deleteNetwork(Network *nn){
+    
+    free(nn->threadPatchesPtr);
+    free(nn);
+    
+}
+
+
+
+
 /**
  * @brief Validates the network definition based on a number of rules and best practices
  * @details Checks whether the provided layer definitions define a proper/feasible a neural network
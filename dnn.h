@@ -12,8 +12,13 @@
 // Include project libraries
 #include "util/mnist-utils.h"
 #include "util/mnist-stats.h"
+#include "threadpool.h"
 
 #define MAX_CONVOLUTIONAL_FILTER 10     // check mechanism to avoid users defining wrong conv models
+#define DEFAULT_WEIGHT_SEED 1           // seed of the random weights of a newly created network
+#define WEIGHT_INIT_CHUNK_SIZE 65536    // number of weights sharing one random stream (independent of the thread count)
+#define DEFAULT_GRAIN_SIZE 16384        // minimum number of multiply-adds per parallel task (smaller layers are calculated serially)
+#define GRADIENT_REDUCTION_CHUNK_SIZE 4096  // number of gradients per task of the parallel gradient reduction
 
 typedef struct LayerDefinition LayerDefinition;
 typedef struct Vector3D Vector3D;
@@ -25,11 +30,12 @@ typedef struct Column Column;
 typedef struct Node Node;
 typedef struct Connection Connection;
 
-typedef double Weight;
+typedef Real Weight;
 typedef unsigned long ByteSize;
 
 typedef enum LayerType {EMPTY, INPUT, CONVOLUTIONAL, FULLY_CONNECTED, OUTPUT} LayerType;
 typedef enum ActFctType {SIGMOID, TANH, RELU, NONE} ActFctType;
+typedef enum EngineType {GRAPH_ENGINE, DENSE_ENGINE} EngineType;
 
 
 
@@ -63,14 +69,17 @@ struct LayerDefinition{
 
 /**
  * @brief Data structure attached to a node and pointing to another node as well as to a weight
- * @details Every node has 2 types of connections: forward and backward.
- * Backward connections are used during feed forward to locate the normalized output in the previous layer.
- * Forward connections are used during back propagation to locate the partial errors in the following layer.
+ * @details Nodes only store BACKWARD connections, i.e. connections to nodes in the previous layer.
+ * They are used during feed forward to locate the normalized output in the previous layer, and during
+ * back propagation to push the node's error back to the same nodes (via the transposed weights).
+ * Instead of pointers, a connection stores 32-bit offsets: the target node's index inside its layer and
+ * the weight's index inside the weights of the node's layer.
+ * Connections to positions outside of the target layer's node map ("dead" edges) are not stored at all.
  */
 
 struct Connection{
-    Node *nodePtr;              // pointer to the target node
-    Weight *weightPtr;          // pointer to a weight that is applied to this connection
+    uint32_t nodeId;            // index of the target node inside its layer (column * depth + level)
+    uint32_t weightId;          // index of the weight that is applied to this connection inside its layer's weights
 };
 
 
@@ -78,15 +87,14 @@ struct Connection{
 
 /**
  * @brief Variably-sized data structure modeling a neuron with a variable number of connections/weights
+ * @details A node's bias, output and errorSum are not stored in the node itself but in its layer's
+ * contiguous biases/outputs/errorSums arrays, at the position given by the node's id.
  */
 
 struct Node{
     ByteSize size;              // actual byte size of this structure in run-time
-    Weight bias;                // value of the bias weight of this node
-    double output;              // result of activation function applied to this node
-    double errorSum;            // result of error back propagation applied to this node
+    int id;                     // index of this node inside its layer (column * depth + level)
     int backwardConnCount;      // number of connections to the previous layer
-    int forwardConnCount;       // number of connections to the following layer
     Connection connections[];   // array of connections
 };
 
@@ -99,6 +107,7 @@ struct Node{
 
 struct Column{
     ByteSize size;              // actual byte size of this structure in run-time
+    ByteSize nodeSize;          // byte size of each node in this column (=distance between 2 nodes)
     int maxConnCountPerNode;    // maximum number of connections per node in this layer
     int nodeCount;              // number of nodes in this column
     Node nodes[];               // array of nodes
@@ -115,7 +124,13 @@ struct Layer{
     int id;                         // index of this layer in the network
     ByteSize size;                  // actual byte size of this structure in run-time
     LayerDefinition *layerDef;      // pointer to the definition of this layer
+    ByteSize columnSize;            // byte size of each column in this layer (=distance between 2 columns)
     Weight *weightsPtr;             // pointer to the weights of this layer
+    Weight *gradientsPtr;           // pointer to the accumulated weight gradients of this layer (same layout as weights)
+    Weight *biasGradientsPtr;       // pointer to the accumulated bias gradients of this layer (one per node)
+    Weight *biases;                 // bias weights of all nodes of this layer (ordered by column, then by level)
+    Real *outputs;                  // results of the activation function of all nodes of this layer (same order)
+    Real *errorSums;                // back propagated errors of all nodes of this layer (same order)
     int columnCount;                // number of columns in this layer
     Column columns[];               // array of columns
 };
@@ -130,9 +145,23 @@ struct Layer{
 struct Network{
     ByteSize size;                  // actual byte size of this structure in run-time
     double learningRate;            // factor by which connection weight changes are applied
+    EngineType engine;              // how layers are computed (dense matrix kernels or connection graph)
+    int batchSize;                  // number of samples whose gradients are accumulated before weights are updated
+    int batchSampleCount;           // number of samples accumulated in the current batch
     int weightCount;                // number of weights in the net's weight block
+    int nodeCount;                  // number of nodes of all layers in the network
     Weight *weightsPtr;             // pointer to the start of the network's weights block
-    Weight nullWeight;              // memory slot for a weight pointed to by dead connections
+    Weight *gradientsPtr;           // pointer to the accumulated weight gradients (same layout as the weights block)
+    Weight *biasGradientsPtr;       // pointer to the accumulated bias gradients (one per node, ordered by layer)
+    Weight *biasesPtr;              // pointer to the bias weights of all nodes (ordered by layer, column and level)
+    Real *outputsPtr;               // pointer to the outputs of all nodes (same order)
+    Real *errorSumsPtr;             // pointer to the errorSums of all nodes (same order)
+    Weight *densePatchPtr;          // scratch vector holding one convolution window (im2col patch)
+    ThreadPool *threadPool;         // threads calculating the columns/nodes of a layer in parallel (NULL = serial)
+    int grainSize;                  // minimum number of multiply-adds per parallel task
+    Weight *threadPatchesPtr;       // one convolution patch per additional thread of the thread pool
+    int threadPatchSize;            // number of weights per convolution patch (=distance between 2 thread patches)
+    Layer **layerTable;             // pointers to all layers, indexed by layer id (located after the layers)
     int layerCount;                 // number of layers in the network
     Layer layers[];                 // array of layers (of different sizes)
 };
@@ -209,6 +238,29 @@ int calcStride(int tgtWidth, int filter, int srcWidth);
 
 
 
+/**
+ * @brief Returns a pointer to a specific layer defined by its id from the network
+ * @param nn A pointer to the NN
+ * @param layerId The id of the layer that is to be returned
+ */
+
+Layer *getNetworkLayer(Network *nn, int layerId);
+
+
+
+
+/**
+ * @brief Returns a pointer to a specific node defined by its layer, column and node id
+ * @param layer A pointer to a network layer
+ * @param columnId The id of the column inside this layer
+ * @param nodeId The id of the node inside this column
+ */
+
+Node *getNetworkNode(Layer *layer, int columnId, int nodeId);
+
+
+
+
 /**
  * @brief Feeds some Vector data into the INPUT layer of the network
  * @param nn A pointer to the neural network
@@ -220,6 +272,19 @@ void feedInput(Network *nn, Vector *v);
 
 
 
+/**
+ * @brief Returns a pointer to the activations of the INPUT layer, so that input data can be written into them directly
+ * @details This is the allocation-free alternative to feedInput(): the returned buffer is part of the network and is
+ * reused for every sample, e.g. normalizeImage(&img, getNetworkInputBuffer(nn, MNIST_IMG_WIDTH*MNIST_IMG_HEIGHT))
+ * @param nn A pointer to the neural network
+ * @param count The number of values that are to be written (must be the number of nodes in the INPUT layer)
+ */
+
+Real *getNetworkInputBuffer(Network *nn, int count);
+
+
+
+
 /**
  * @brief Feeds forward (=calculating a node's output value and applying an activation function) layer by layer
  * @details Feeds forward from 2nd=#1 layer (i.e. skips input layer) to output layer
@@ -231,6 +296,19 @@ void feedForwardNetwork(Network *nn);
 
 
 
+/**
+ * @brief Feeds forward a range of layers (e.g. one stage of a layer pipeline)
+ * @details The outputs of the layer preceding the range must have been calculated before.
+ * @param nn A pointer to the NN
+ * @param firstLayer The id of the first layer of the range (at least 1)
+ * @param lastLayer The id of the layer following the last layer of the range (at most nn->layerCount)
+ */
+
+void feedForwardLayers(Network *nn, int firstLayer, int lastLayer);
+
+
+
+
 /**
  * @brief Backpropagates the output nodes' errors from output layer backwards to first layer
  *
@@ -243,6 +321,9 @@ void feedForwardNetwork(Network *nn);
  * a. Update the nodes weights based on actual output and accumulated errorsum
  * b. Calculate the errorsums in all TARGET cells based on errorsum in this layer (calculated in 3)
  *
+ * If the network's batchSize is larger than 1, the weight changes are accumulated as gradients instead
+ * and applied (via updateNetworkWeights) once batchSize samples have been back propagated.
+ *
  * @param nn A pointer to the neural network
  * @param targetClassification The correct/desired classification (=label) of this recognition/image
  */
@@ -252,6 +333,73 @@ void backPropagateNetwork(Network *nn, int targetClassification);
 
 
 
+/**
+ * @brief Back propagates a range of layers, starting with the last one (e.g. one stage of a layer pipeline)
+ * @details If the range includes the OUTPUT layer, its errors are calculated from the targetClassification first.
+ * Otherwise the errorSums of the layer following the range must have been calculated before.
+ * backPropagateNetwork() is the same as back propagating the range 1 to nn->layerCount.
+ * @param nn A pointer to the neural network
+ * @param firstLayer The id of the first layer of the range (at least 1)
+ * @param lastLayer The id of the layer following the last layer of the range (at most nn->layerCount)
+ * @param targetClassification The correct/desired classification (=label) of this recognition/image
+ */
+
+void backPropagateLayers(Network *nn, int firstLayer, int lastLayer, int targetClassification);
+
+
+
+
+/**
+ * @brief Applies the gradients accumulated during the current mini-batch to the network's weights and biases
+ * @details Weights are moved by learningRate times the average gradient of the batch's samples.
+ * This is called automatically by backPropagateNetwork() after each batchSize samples. Call it once more
+ * after the last sample to apply a partially filled batch. Does nothing if no gradients are accumulated.
+ * @param nn A pointer to the neural network
+ */
+
+void updateNetworkWeights(Network *nn);
+
+
+
+
+/**
+ * @brief Applies the gradients accumulated by several replicas of a network (synchronous data-parallel training)
+ * @details Each replica back propagates a different shard of the same mini-batch into its own gradients (with a
+ * batchSize so large that the replica never applies them itself). This function then reduces the replicas'
+ * gradients in a fixed (tree) order, using the network's thread pool, and moves the weights and biases once by
+ * learningRate times the average gradient. Results are bit-identical for a fixed number of replicas.
+ * @param nn A pointer to the neural network whose weights and biases are updated
+ * @param replicas An array of pointers to the replicas of the network (see createNetworkReplica)
+ * @param replicaCount Number of replicas
+ */
+
+void applyReplicaGradients(Network *nn, Network **replicas, int replicaCount);
+
+
+
+
+/**
+ * @brief Trains a network on one mini-batch by splitting it into shards that are back propagated in parallel by
+ * replicas of the network (synchronous data-parallel training) and returns the number of misclassified images
+ * @details Shard s consists of the images s*count/shardCount to (s+1)*count/shardCount-1 and is always back
+ * propagated by replica s (whose batchSize must be large enough to never apply the gradients itself). The
+ * gradients are then applied by applyReplicaGradients(). For a fixed number of shards the trained weights are
+ * bit-identical, no matter how many threads the network's pool has. A single shard gives the same weights as
+ * serial training with batchSize = count.
+ * @param nn A pointer to the neural network whose weights and biases are updated
+ * @param replicas An array of shardCount pointers to the replicas of the network (see createNetworkReplica)
+ * @param shardCount Number of shards (=replicas)
+ * @param inputs A pointer to the normalized images of the mini-batch (count x imageSize values)
+ * @param imageSize Number of values per image (must be the number of nodes in the INPUT layer)
+ * @param labels A pointer to the labels of the mini-batch's images
+ * @param count Number of images in the mini-batch
+ */
+
+int trainNetworkShards(Network *nn, Network **replicas, int shardCount, const Real *inputs, int imageSize, const MNIST_Label *labels, int count);
+
+
+
+
 /**
  * @brief Returns the network's classification of the input image by choosing the node with the hightest output
  * @param nn A pointer to the neural network
@@ -262,15 +410,71 @@ int getNetworkClassification(Network *nn);
 
 
 
+/**
+ * @brief Initializes the network's weights and biases with (reproducible) random numbers
+ * @details Weights are scaled by each layer's fan-in (He for RELU, Xavier otherwise), biases are set to 0.
+ * The weights are initialized in parallel by the network's thread pool (serially without a pool), with the same
+ * result for any number of threads. createNetwork() already initializes the weights using DEFAULT_WEIGHT_SEED.
+ * Call this function to re-initialize them using a different seed.
+ * @param nn A pointer to the neural network
+ * @param seed The seed of the random numbers
+ */
+
+void initNetworkWeights(Network *nn, uint64_t seed);
+
+
+
+
+/**
+ * @brief Lets the network calculate the columns/nodes of each layer in parallel, using the threads of a thread pool
+ * @details Each layer is split into ranges of columns (or nodes) of at least grainSize multiply-adds, so that tiny
+ * layers are still calculated serially. The pool is owned by the caller and can be shared with other networks
+ * (but not used by 2 networks at the same time).
+ * @param nn A pointer to the neural network
+ * @param pool A pointer to the thread pool (NULL = calculate all layers serially)
+ * @param grainSize Minimum number of multiply-adds per parallel task (e.g. DEFAULT_GRAIN_SIZE)
+ */
+
+void setNetworkThreadPool(Network *nn, ThreadPool *pool, int grainSize);
+
+
+
+
 /**
  * @brief Creates the neural network based on a given array of layer definitions
  * @details Creates a reserved memory block for this network based on the given layer definitions,
  * and then initializes this memory with the respective layer/node/connection/weights structure.
+ * The network calculates its layers using the given thread pool (see setNetworkThreadPool), which also initializes
+ * the weights in parallel.
  * @param layerCount The number of layer definitions inside the layer-definition-array (2nd param)
  * @param layerDefs A pointer to an array of layer definitions
+ * @param pool A pointer to the thread pool (NULL = calculate all layers serially)
+ */
+
+Network *createNetwork(int layerCount, LayerDefinition *layerDefs, ThreadPool *pool);
+
+
+
+
+/**
+ * @brief Creates a replica of a network that shares the network's weights and biases, but has its own node outputs,
+ * errorSums, gradients and convolution patch
+ * @details Used for training a network with several threads at the same time (one replica per thread, e.g. Hogwild).
+ * The replica must be deleted (via deleteNetwork) before the original network.
+ * @param nn A pointer to the neural network whose weights and biases are shared
+ */
+
+Network *createNetworkReplica(Network *nn);
+
+
+
+
+/**
+ * @brief Releases the memory of a neural network (but not its layer definitions or its thread pool)
+ * @param nn A pointer to the neural network
  */
 
-Network *createNetwork(int layerCount, LayerDefinition *layerDefs);
+void deleteNetwork(Network *nn);
 
 
 
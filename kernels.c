@@ -0,0 +1,1005 @@
+/**
+ * @file kernels.c
+ * @brief Vectorized math kernels (dot products, matrix-vector products, activation functions) used by the network
+ * @details Each kernel exists as a scalar reference implementation and as hand-vectorized AVX2 and AVX-512
+ * implementations. The vectorized kernels are written once, using GCC vector extensions, and are then
+ * compiled separately for each instruction set (via the "target" function attribute).
+ */
+
+
+// Include external libraries
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+// Include project libraries
+#include "kernels.h"
+
+
+
+
+#if defined(__x86_64__) || defined(__i386__)
+#define X86_KERNELS         // AVX2 and AVX-512 kernels are only available on x86 CPUs
+#endif
+
+
+
+
+/**
+ * @brief Set of function pointers to one implementation (scalar, AVX2 or AVX-512) of all kernels
+ */
+
+typedef struct KernelSet KernelSet;
+
+struct KernelSet{
+    Weight (*dotProduct)(const Weight *a, const Weight *b, int count);
+    void (*addScaledVector)(Weight *y, const Weight *x, Weight factor, int count);
+    void (*matrixVectorProduct)(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result);
+    void (*transposedMatrixVectorProduct)(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result);
+    void (*activateVector)(Weight *vals, int count, ActFctType actType);
+    void (*scaleByDerivative)(Weight *errors, const Weight *outputs, int count, ActFctType actType);
+    void (*sampleBilinear)(const Weight *image, int width, int height, const Weight *xs, const Weight *ys, int count, Weight *result);
+};
+
+
+
+
+/**
+ * @brief Returns the result of applying an activation function to a single value
+ * @param val The value that is to be "activated"
+ * @param actType The type of activation function to be applied (SIGMOID/TANH/RELU)
+ */
+
+Weight activateValue(Weight val, ActFctType actType){
+
+    switch (actType) {
+        case SIGMOID:
+            val = 1 / (1 + (exp((Weight)-val)) );
+            break;
+
+        case TANH:
+            val = tanh(val);
+            break;
+
+        case RELU:
+            val = log(1 + pow(M_E,val));
+            break;
+
+        case NONE:
+            break;
+
+        default:
+            printf("Undefined activation function! ABORT!\n");
+            exit(1);
+            break;
+    }
+
+    return val;
+}
+
+
+
+
+/**
+ * @brief Returns the result of applying the given outputValue to the derivate of the activation function
+ * @param outVal Output value that is to be back propagated
+ * @param actType The type of activation function that was applied during feed forward (SIGMOID/TANH/RELU)
+ */
+
+Weight getDerivative(Weight outVal, ActFctType actType){
+
+    Weight d = 0;
+
+    switch (actType) {
+        case SIGMOID:
+            d = outVal * (1-outVal);
+            break;
+
+        case TANH:
+            d = 1-pow(tanh(outVal),2);
+            break;
+
+        case RELU:
+            d = 1 / (1 + pow(M_E,-outVal));
+            break;
+
+        case NONE:
+            d = 1;
+            break;
+
+        default:
+            printf("Undefined derivative function! ABORT!\n");
+            exit(1);
+            break;
+    }
+
+    return d;
+}
+
+
+
+
+/*
+ * SCALAR (REFERENCE) KERNELS
+ */
+
+
+
+
+/**
+ * @brief Scalar reference implementation of calcDotProduct()
+ */
+
+Weight dotProductScalar(const Weight *a, const Weight *b, int count){
+
+    Weight sum = 0;
+
+    for (int i=0; i<count; i++) sum += a[i] * b[i];
+
+    return sum;
+}
+
+
+
+
+/**
+ * @brief Scalar reference implementation of addScaledVector()
+ */
+
+void addScaledVectorScalar(Weight *y, const Weight *x, Weight factor, int count){
+
+    for (int i=0; i<count; i++) y[i] += factor * x[i];
+
+}
+
+
+
+
+/**
+ * @brief Scalar reference implementation of calcMatrixVectorProduct()
+ */
+
+void matrixVectorProductScalar(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result){
+
+    for (int r=0; r<rowCount; r++) result[r] = dotProductScalar(matrix + (r * colCount), vec, colCount);
+
+}
+
+
+
+
+/**
+ * @brief Scalar reference implementation of calcTransposedMatrixVectorProduct()
+ */
+
+void transposedMatrixVectorProductScalar(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result){
+
+    for (int c=0; c<colCount; c++) result[c] = 0;
+
+    for (int r=0; r<rowCount; r++) addScaledVectorScalar(result, matrix + (r * colCount), vec[r], colCount);
+
+}
+
+
+
+
+/**
+ * @brief Scalar reference implementation of activateVector()
+ */
+
+void activateVectorScalar(Weight *vals, int count, ActFctType actType){
+
+    for (int i=0; i<count; i++) vals[i] = activateValue(vals[i], actType);
+
+}
+
+
+
+
+/**
+ * @brief Scalar reference implementation of scaleByDerivative()
+ */
+
+void scaleByDerivativeScalar(Weight *errors, const Weight *outputs, int count, ActFctType actType){
+
+    for (int i=0; i<count; i++) errors[i] *= getDerivative(outputs[i], actType);
+
+}
+
+
+
+
+/**
+ * @brief Scalar reference implementation of sampleBilinear()
+ */
+
+void sampleBilinearScalar(const Weight *image, int width, int height, const Weight *xs, const Weight *ys, int count, Weight *result){
+
+    int stride = width + 2;
+
+    for (int i=0; i<count; i++){
+
+        // Move into the padded image and clamp to its border (which holds the background value)
+        Weight x = xs[i] + 1, y = ys[i] + 1;
+        if (!(x > 0)) x = 0;        // also catches NaN
+        if (!(y > 0)) y = 0;
+        if (x > width)  x = width;
+        if (y > height) y = height;
+
+        int x0 = (int)x, y0 = (int)y;
+        Weight fx = x - x0, fy = y - y0;
+
+        const Weight *p = image + (y0 * stride) + x0;
+
+        Weight top    = p[0]      + fx * (p[1]        - p[0]);
+        Weight bottom = p[stride] + fx * (p[stride+1] - p[stride]);
+
+        result[i] = top + fy * (bottom - top);
+    }
+
+}
+
+
+
+
+static const KernelSet scalarKernels = {
+    dotProductScalar,
+    addScaledVectorScalar,
+    matrixVectorProductScalar,
+    transposedMatrixVectorProductScalar,
+    activateVectorScalar,
+    scaleByDerivativeScalar,
+    sampleBilinearScalar
+};
+
+
+
+
+#ifdef X86_KERNELS
+
+/*
+ * VECTORIZED KERNELS
+ *
+ * The kernel bodies below use 64-byte vectors and are force-inlined into one wrapper function per
+ * instruction set. When compiled for AVX-512 each vector maps to one zmm register, when compiled
+ * for AVX2 GCC splits each vector into two ymm registers (i.e. the loops are unrolled twice).
+ */
+
+#define SIMD_BYTES 64
+#define SIMD_WIDTH ((int)(SIMD_BYTES / sizeof(Weight)))     // number of weights per vector
+
+#define SIMD_INLINE static inline __attribute__((always_inline))
+
+// The helpers below pass 64-byte vectors by value. They are always inlined, hence the ABI note does not apply.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+// Allow multiply-adds to be fused into FMA instructions (ISO C modes turn contraction off by default)
+#pragma GCC optimize ("fp-contract=fast")
+
+#ifdef USE_FLOAT
+#define fusedMultiplyAdd fmaf   // x*y+z rounded once (inlined as an FMA instruction)
+typedef int32_t WeightBits;     // integer type of the same size as a weight (to access its IEEE-754 bits)
+
+#define WEIGHT_MANTISSA_BITS 23
+#define WEIGHT_EXPONENT_BIAS 127
+#define WEIGHT_EXP_MIN_ARG  -87.0      // smallest argument for which exp() still returns a normal number
+#define WEIGHT_EXP_SHIFTER  12582912.0 // 1.5 * 2^23: adding it rounds to the nearest integer
+#else
+#define fusedMultiplyAdd fma    // x*y+z rounded once (inlined as an FMA instruction)
+typedef int64_t WeightBits;     // integer type of the same size as a weight (to access its IEEE-754 bits)
+
+#define WEIGHT_MANTISSA_BITS 52
+#define WEIGHT_EXPONENT_BIAS 1023
+#define WEIGHT_EXP_MIN_ARG  -708.0     // smallest argument for which exp() still returns a normal number
+#define WEIGHT_EXP_SHIFTER  6755399441055744.0 // 1.5 * 2^52: adding it rounds to the nearest integer
+#endif
+
+// @attention Vectors are declared with the alignment of a single weight so that they can load from any weight
+typedef Weight     SimdVector __attribute__((vector_size(SIMD_BYTES), aligned(sizeof(Weight)), may_alias));
+typedef WeightBits SimdBits   __attribute__((vector_size(SIMD_BYTES), aligned(sizeof(Weight)), may_alias));
+
+
+
+
+/**
+ * @brief Returns the sum of all values inside a vector (horizontal add)
+ */
+
+SIMD_INLINE Weight sumSimdVector(SimdVector v){
+
+    Weight sum = 0;
+    for (int i=0; i<SIMD_WIDTH; i++) sum += v[i];
+
+    return sum;
+}
+
+
+
+
+/**
+ * @brief Returns the values of a where the mask is set and the values of b elsewhere
+ */
+
+SIMD_INLINE SimdVector selectSimdVector(SimdBits mask, SimdVector a, SimdVector b){
+
+    return (SimdVector)(((SimdBits)a & mask) | ((SimdBits)b & ~mask));
+}
+
+
+
+
+/**
+ * @brief Returns the absolute values of a vector
+ */
+
+SIMD_INLINE SimdVector absSimdVector(SimdVector x){
+
+    SimdVector zero = {0};
+
+    return selectSimdVector(x < zero, -x, x);
+}
+
+
+
+
+/**
+ * @brief Splits exp(x) for x <= 0 into a power of 2 and the remainder exp(r)-1, i.e. exp(x) = scale * (1 + remainder)
+ * @details x is split into n*ln(2) + r with |r| <= ln(2)/2, exp(r)-1 is approximated by a polynomial of degree 13
+ * and 2^n is created by writing n directly into the exponent bits of the scale. Arguments below the smallest
+ * normal result are flushed to a scale of 0.
+ */
+
+SIMD_INLINE void splitExpSimdVector(SimdVector x, SimdVector *scale, SimdVector *remainder){
+
+    const Weight shifter = WEIGHT_EXP_SHIFTER;
+    const Weight ln2Hi   = 6.93145751953125E-1;
+    const Weight ln2Lo   = 1.42860682030941723212E-6;
+
+    SimdVector zero   = {0};
+    SimdVector minArg = zero + (Weight)WEIGHT_EXP_MIN_ARG;
+    SimdBits underflow = x < minArg;
+    x = selectSimdVector(underflow, minArg, x);
+
+    SimdVector shifted = (x * (Weight)M_LOG2E) + shifter;
+    SimdVector n = shifted - shifter;
+    SimdVector r = (x - (n * ln2Hi)) - (n * ln2Lo);
+
+    // Taylor polynomial r + r^2/2! + ... + r^13/13!
+    SimdVector p = zero + (Weight)(1.0/6227020800.0);
+    p = (p * r) + (Weight)(1.0/479001600.0);
+    p = (p * r) + (Weight)(1.0/39916800.0);
+    p = (p * r) + (Weight)(1.0/3628800.0);
+    p = (p * r) + (Weight)(1.0/362880.0);
+    p = (p * r) + (Weight)(1.0/40320.0);
+    p = (p * r) + (Weight)(1.0/5040.0);
+    p = (p * r) + (Weight)(1.0/720.0);
+    p = (p * r) + (Weight)(1.0/120.0);
+    p = (p * r) + (Weight)(1.0/24.0);
+    p = (p * r) + (Weight)(1.0/6.0);
+    p = (p * r) + (Weight)0.5;
+    p = (p * r) + 1;
+    *remainder = p * r;
+
+    // The integer n is stored in the lowest bits of "shifted"
+    SimdBits exponent = ((SimdBits)shifted - (SimdBits)(zero + shifter)) + WEIGHT_EXPONENT_BIAS;
+    *scale = selectSimdVector(underflow, zero, (SimdVector)(exponent << WEIGHT_MANTISSA_BITS));
+
+}
+
+
+
+
+/**
+ * @brief Returns exp(x) for x <= 0
+ */
+
+SIMD_INLINE SimdVector expNegativeSimdVector(SimdVector x){
+
+    SimdVector scale, remainder;
+    splitExpSimdVector(x, &scale, &remainder);
+
+    return scale + (scale * remainder);
+}
+
+
+
+
+/**
+ * @brief Returns exp(x)-1 for x <= 0 (without losing precision for x close to 0)
+ */
+
+SIMD_INLINE SimdVector expm1NegativeSimdVector(SimdVector x){
+
+    SimdVector scale, remainder;
+    splitExpSimdVector(x, &scale, &remainder);
+
+    return (scale * remainder) + (scale - 1);
+}
+
+
+
+
+/**
+ * @brief Returns log(1+e) for 0 <= e <= 1
+ * @details Uses log(1+e) = 2*atanh(e/(2+e)). For e > sqrt(2)-1 the argument is halved first (adding ln(2)),
+ * so that the atanh series is only evaluated for |s| < 0.172.
+ */
+
+SIMD_INLINE SimdVector log1pSimdVector(SimdVector e){
+
+    SimdVector one = {0};
+    one += 1;
+
+    SimdBits isLarge = e > (Weight)(M_SQRT2 - 1);
+
+    SimdVector s = selectSimdVector(isLarge, (e - one) / (e + 3), e / (e + 2));
+    SimdVector z = s * s;
+
+    // atanh(s)/s = 1 + z/3 + z^2/5 + ... + z^10/21
+    SimdVector p = {0};
+    p += (Weight)(1.0/21);
+    p = (p * z) + (Weight)(1.0/19);
+    p = (p * z) + (Weight)(1.0/17);
+    p = (p * z) + (Weight)(1.0/15);
+    p = (p * z) + (Weight)(1.0/13);
+    p = (p * z) + (Weight)(1.0/11);
+    p = (p * z) + (Weight)(1.0/9);
+    p = (p * z) + (Weight)(1.0/7);
+    p = (p * z) + (Weight)(1.0/5);
+    p = (p * z) + (Weight)(1.0/3);
+    p = (p * z) + 1;
+
+    SimdVector zero = {0};
+    SimdVector offset = selectSimdVector(isLarge, zero + (Weight)M_LN2, zero);
+
+    return offset + (2 * s * p);
+}
+
+
+
+
+/**
+ * @brief Applies an activation function to each value of a vector (same semantics as activateValue())
+ */
+
+SIMD_INLINE SimdVector activateSimdVector(SimdVector x, ActFctType actType){
+
+    SimdVector zero = {0};
+
+    switch (actType) {
+        case SIGMOID: {
+            SimdVector e = expNegativeSimdVector(-absSimdVector(x));
+            x = selectSimdVector(x < zero, e / (1 + e), 1 / (1 + e));
+            break;
+        }
+        case TANH: {
+            // tanh(|x|) = (1-exp(-2|x|)) / (1+exp(-2|x|))
+            SimdVector e = expm1NegativeSimdVector(-2 * absSimdVector(x));
+            SimdVector t = -e / (2 + e);
+            x = selectSimdVector(x < zero, -t, t);
+            break;
+        }
+        case RELU: {
+            // softplus: log(1+exp(x)) = max(x,0) + log(1+exp(-|x|))
+            SimdVector e = expNegativeSimdVector(-absSimdVector(x));
+            x = selectSimdVector(x < zero, zero, x) + log1pSimdVector(e);
+            break;
+        }
+        default:
+            break;
+    }
+
+    return x;
+}
+
+
+
+
+/**
+ * @brief Returns the derivative of the activation function for each value of a vector (same semantics as getDerivative())
+ */
+
+SIMD_INLINE SimdVector getDerivativeSimdVector(SimdVector outVal, ActFctType actType){
+
+    SimdVector d = {0};
+
+    switch (actType) {
+        case SIGMOID:
+            d = outVal * (1 - outVal);
+            break;
+
+        case TANH: {
+            SimdVector t = activateSimdVector(outVal, TANH);
+            d = 1 - (t * t);
+            break;
+        }
+        case RELU:
+            d = activateSimdVector(outVal, SIGMOID);
+            break;
+
+        default:
+            d += 1;
+            break;
+    }
+
+    return d;
+}
+
+
+
+
+/**
+ * @brief Vectorized implementation of calcDotProduct()
+ */
+
+SIMD_INLINE Weight dotProductSimd(const Weight *a, const Weight *b, int count){
+
+    SimdVector sum0 = {0};
+    SimdVector sum1 = {0};
+
+    int i=0;
+
+    for (; i+(2*SIMD_WIDTH)<=count; i+=2*SIMD_WIDTH){
+        sum0 += *(const SimdVector*)(a+i) * *(const SimdVector*)(b+i);
+        sum1 += *(const SimdVector*)(a+i+SIMD_WIDTH) * *(const SimdVector*)(b+i+SIMD_WIDTH);
+    }
+
+    for (; i+SIMD_WIDTH<=count; i+=SIMD_WIDTH) sum0 += *(const SimdVector*)(a+i) * *(const SimdVector*)(b+i);
+
+    Weight sum = sumSimdVector(sum0 + sum1);
+
+    for (; i<count; i++) sum += a[i] * b[i];
+
+    return sum;
+}
+
+
+
+
+/**
+ * @brief Vectorized implementation of addScaledVector()
+ */
+
+SIMD_INLINE void addScaledVectorSimd(Weight *y, const Weight *x, Weight factor, int count){
+
+    int i=0;
+
+    for (; i+SIMD_WIDTH<=count; i+=SIMD_WIDTH) *(SimdVector*)(y+i) += factor * *(const SimdVector*)(x+i);
+
+    for (; i<count; i++) y[i] += factor * x[i];
+
+}
+
+
+
+
+/**
+ * @brief Vectorized implementation of calcMatrixVectorProduct()
+ */
+
+SIMD_INLINE void matrixVectorProductSimd(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result){
+
+    int r=0;
+
+    // The input vector is re-used for 4 rows at a time so that it is loaded only once per 4 rows
+    for (; r+4<=rowCount; r+=4){
+
+        const Weight *row0 = matrix + (r * colCount);
+        const Weight *row1 = row0 + colCount;
+        const Weight *row2 = row1 + colCount;
+        const Weight *row3 = row2 + colCount;
+
+        SimdVector sum0 = {0}, sum1 = {0}, sum2 = {0}, sum3 = {0};
+
+        int c=0;
+
+        for (; c+SIMD_WIDTH<=colCount; c+=SIMD_WIDTH){
+            SimdVector v = *(const SimdVector*)(vec+c);
+            sum0 += *(const SimdVector*)(row0+c) * v;
+            sum1 += *(const SimdVector*)(row1+c) * v;
+            sum2 += *(const SimdVector*)(row2+c) * v;
+            sum3 += *(const SimdVector*)(row3+c) * v;
+        }
+
+        Weight s0 = sumSimdVector(sum0), s1 = sumSimdVector(sum1), s2 = sumSimdVector(sum2), s3 = sumSimdVector(sum3);
+
+        // @attention fp-contract does not reliably fuse these scalar multiply-adds, hence the explicit FMA
+        for (; c<colCount; c++){
+            s0 = fusedMultiplyAdd(row0[c], vec[c], s0);
+            s1 = fusedMultiplyAdd(row1[c], vec[c], s1);
+            s2 = fusedMultiplyAdd(row2[c], vec[c], s2);
+            s3 = fusedMultiplyAdd(row3[c], vec[c], s3);
+        }
+
+        result[r]   = s0;
+        result[r+1] = s1;
+        result[r+2] = s2;
+        result[r+3] = s3;
+    }
+
+    // remaining rows (summed in the same order as above, so that a row's result doesn't depend on its position, e.g.
+    // on how the rows of a layer are split over the threads)
+    for (; r<rowCount; r++){
+
+        const Weight *row = matrix + (r * colCount);
+
+        SimdVector sum = {0};
+
+        int c=0;
+
+        for (; c+SIMD_WIDTH<=colCount; c+=SIMD_WIDTH) sum += *(const SimdVector*)(row+c) * *(const SimdVector*)(vec+c);
+
+        Weight s = sumSimdVector(sum);
+
+        for (; c<colCount; c++) s = fusedMultiplyAdd(row[c], vec[c], s);
+
+        result[r] = s;
+    }
+
+}
+
+
+
+
+/**
+ * @brief Vectorized implementation of calcTransposedMatrixVectorProduct()
+ */
+
+SIMD_INLINE void transposedMatrixVectorProductSimd(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result){
+
+    for (int c=0; c<colCount; c++) result[c] = 0;
+
+    int r=0;
+
+    // 4 scaled rows are added at a time so that the result vector is loaded and stored only once per 4 rows
+    for (; r+4<=rowCount; r+=4){
+
+        const Weight *row0 = matrix + (r * colCount);
+        const Weight *row1 = row0 + colCount;
+        const Weight *row2 = row1 + colCount;
+        const Weight *row3 = row2 + colCount;
+
+        Weight f0 = vec[r], f1 = vec[r+1], f2 = vec[r+2], f3 = vec[r+3];
+
+        int c=0;
+
+        for (; c+SIMD_WIDTH<=colCount; c+=SIMD_WIDTH){
+            SimdVector sum = *(SimdVector*)(result+c);
+            sum += f0 * *(const SimdVector*)(row0+c);
+            sum += f1 * *(const SimdVector*)(row1+c);
+            sum += f2 * *(const SimdVector*)(row2+c);
+            sum += f3 * *(const SimdVector*)(row3+c);
+            *(SimdVector*)(result+c) = sum;
+        }
+
+        for (; c<colCount; c++) result[c] += (f0 * row0[c]) + (f1 * row1[c]) + (f2 * row2[c]) + (f3 * row3[c]);
+    }
+
+    // remaining rows
+    for (; r<rowCount; r++) addScaledVectorSimd(result, matrix + (r * colCount), vec[r], colCount);
+
+}
+
+
+
+
+/**
+ * @brief Vectorized implementation of activateVector()
+ */
+
+SIMD_INLINE void activateVectorSimd(Weight *vals, int count, ActFctType actType){
+
+    if (actType==NONE) return;
+
+    int i=0;
+
+    for (; i+SIMD_WIDTH<=count; i+=SIMD_WIDTH) *(SimdVector*)(vals+i) = activateSimdVector(*(SimdVector*)(vals+i), actType);
+
+    // remaining values are padded into one (partial) vector so that they use the same approximation
+    if (i<count){
+        SimdVector tail = {0};
+        for (int t=0; i+t<count; t++) tail[t] = vals[i+t];
+        tail = activateSimdVector(tail, actType);
+        for (int t=0; i+t<count; t++) vals[i+t] = tail[t];
+    }
+
+}
+
+
+
+
+/**
+ * @brief Vectorized implementation of scaleByDerivative()
+ */
+
+SIMD_INLINE void scaleByDerivativeSimd(Weight *errors, const Weight *outputs, int count, ActFctType actType){
+
+    int i=0;
+
+    for (; i+SIMD_WIDTH<=count; i+=SIMD_WIDTH) *(SimdVector*)(errors+i) *= getDerivativeSimdVector(*(const SimdVector*)(outputs+i), actType);
+
+    if (i<count){
+        SimdVector tail = {0};
+        for (int t=0; i+t<count; t++) tail[t] = outputs[i+t];
+        tail = getDerivativeSimdVector(tail, actType);
+        for (int t=0; i+t<count; t++) errors[i+t] *= tail[t];
+    }
+
+}
+
+
+
+
+/**
+ * @brief Vectorized implementation of sampleBilinear()
+ * @details Coordinates, interpolation weights and the interpolation itself are computed for SIMD_WIDTH
+ * samples at once; only the 4 neighboring pixels of each sample are gathered lane by lane.
+ */
+
+SIMD_INLINE void sampleBilinearSimd(const Weight *image, int width, int height, const Weight *xs, const Weight *ys, int count, Weight *result){
+
+    int stride = width + 2;
+
+    SimdVector zero = {0};
+    SimdVector maxX = zero + (Weight)width;
+    SimdVector maxY = zero + (Weight)height;
+
+    int i=0;
+
+    for (; i+SIMD_WIDTH<=count; i+=SIMD_WIDTH){
+
+        // Move into the padded image and clamp to its border (which holds the background value)
+        SimdVector x = *(const SimdVector*)(xs+i) + 1;
+        SimdVector y = *(const SimdVector*)(ys+i) + 1;
+        x = selectSimdVector(x > zero, x, zero);
+        y = selectSimdVector(y > zero, y, zero);
+        x = selectSimdVector(x > maxX, maxX, x);
+        y = selectSimdVector(y > maxY, maxY, y);
+
+        // Coordinates are non-negative, i.e. truncation equals floor()
+        SimdBits x0 = __builtin_convertvector(x, SimdBits);
+        SimdBits y0 = __builtin_convertvector(y, SimdBits);
+        SimdVector fx = x - __builtin_convertvector(x0, SimdVector);
+        SimdVector fy = y - __builtin_convertvector(y0, SimdVector);
+
+        SimdBits offset = (y0 * stride) + x0;
+
+        SimdVector p00, p01, p10, p11;
+        for (int l=0; l<SIMD_WIDTH; l++){
+            const Weight *p = image + offset[l];
+            p00[l] = p[0];
+            p01[l] = p[1];
+            p10[l] = p[stride];
+            p11[l] = p[stride+1];
+        }
+
+        SimdVector top    = p00 + fx * (p01 - p00);
+        SimdVector bottom = p10 + fx * (p11 - p10);
+
+        *(SimdVector*)(result+i) = top + fy * (bottom - top);
+    }
+
+    // remaining samples
+    sampleBilinearScalar(image, width, height, xs+i, ys+i, count-i, result+i);
+
+}
+
+
+
+
+/*
+ * AVX2 KERNELS
+ */
+
+#define AVX2_KERNEL __attribute__((target("avx2,fma")))
+
+AVX2_KERNEL Weight dotProductAvx2(const Weight *a, const Weight *b, int count){
+    return dotProductSimd(a, b, count);
+}
+
+AVX2_KERNEL void addScaledVectorAvx2(Weight *y, const Weight *x, Weight factor, int count){
+    addScaledVectorSimd(y, x, factor, count);
+}
+
+AVX2_KERNEL void matrixVectorProductAvx2(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result){
+    matrixVectorProductSimd(matrix, vec, rowCount, colCount, result);
+}
+
+AVX2_KERNEL void transposedMatrixVectorProductAvx2(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result){
+    transposedMatrixVectorProductSimd(matrix, vec, rowCount, colCount, result);
+}
+
+AVX2_KERNEL void activateVectorAvx2(Weight *vals, int count, ActFctType actType){
+    activateVectorSimd(vals, count, actType);
+}
+
+AVX2_KERNEL void scaleByDerivativeAvx2(Weight *errors, const Weight *outputs, int count, ActFctType actType){
+    scaleByDerivativeSimd(errors, outputs, count, actType);
+}
+
+AVX2_KERNEL void sampleBilinearAvx2(const Weight *image, int width, int height, const Weight *xs, const Weight *ys, int count, Weight *result){
+    sampleBilinearSimd(image, width, height, xs, ys, count, result);
+}
+
+static const KernelSet avx2Kernels = {
+    dotProductAvx2,
+    addScaledVectorAvx2,
+    matrixVectorProductAvx2,
+    transposedMatrixVectorProductAvx2,
+    activateVectorAvx2,
+    scaleByDerivativeAvx2,
+    sampleBilinearAvx2
+};
+
+
+
+
+/*
+ * AVX-512 KERNELS
+ */
+
+#define AVX512_KERNEL __attribute__((target("avx512f,avx512dq,fma")))
+
+AVX512_KERNEL Weight dotProductAvx512(const Weight *a, const Weight *b, int count){
+    return dotProductSimd(a, b, count);
+}
+
+AVX512_KERNEL void addScaledVectorAvx512(Weight *y, const Weight *x, Weight factor, int count){
+    addScaledVectorSimd(y, x, factor, count);
+}
+
+AVX512_KERNEL void matrixVectorProductAvx512(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result){
+    matrixVectorProductSimd(matrix, vec, rowCount, colCount, result);
+}
+
+AVX512_KERNEL void transposedMatrixVectorProductAvx512(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result){
+    transposedMatrixVectorProductSimd(matrix, vec, rowCount, colCount, result);
+}
+
+AVX512_KERNEL void activateVectorAvx512(Weight *vals, int count, ActFctType actType){
+    activateVectorSimd(vals, count, actType);
+}
+
+AVX512_KERNEL void scaleByDerivativeAvx512(Weight *errors, const Weight *outputs, int count, ActFctType actType){
+    scaleByDerivativeSimd(errors, outputs, count, actType);
+}
+
+AVX512_KERNEL void sampleBilinearAvx512(const Weight *image, int width, int height, const Weight *xs, const Weight *ys, int count, Weight *result){
+    sampleBilinearSimd(image, width, height, xs, ys, count, result);
+}
+
+static const KernelSet avx512Kernels = {
+    dotProductAvx512,
+    addScaledVectorAvx512,
+    matrixVectorProductAvx512,
+    transposedMatrixVectorProductAvx512,
+    activateVectorAvx512,
+    scaleByDerivativeAvx512,
+    sampleBilinearAvx512
+};
+
+#endif
+
+
+
+
+/*
+ * KERNEL SELECTION
+ */
+
+static const KernelSet *kernels = &scalarKernels;
+static KernelType kernelType    = SCALAR_KERNELS;
+static bool isKernelSelected    = false;
+
+
+
+
+/**
+ * @brief Returns the fastest kernel type that is supported by the CPU this program is running on
+ */
+
+KernelType getBestKernelType(void){
+
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) return AVX512_KERNELS;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return AVX2_KERNELS;
+#endif
+
+    return SCALAR_KERNELS;
+}
+
+
+
+
+/**
+ * @brief Returns the kernel type that is currently used
+ */
+
+KernelType getKernelType(void){
+    return kernelType;
+}
+
+
+
+
+/**
+ * @brief Selects the kernel implementation that is used by all following kernel calls
+ * @details If the requested kernel type is not supported by the CPU, the scalar kernels are selected instead.
+ * @param type The type of kernels to be used (SCALAR/AVX2/AVX512)
+ */
+
+void selectKernels(KernelType type){
+
+    KernelType bestType = getBestKernelType();
+
+    // Kernel types are ordered by instruction set, i.e. a CPU supporting AVX-512 also supports AVX2
+    if (type > bestType) type = SCALAR_KERNELS;
+
+    switch (type) {
+#ifdef X86_KERNELS
+        case AVX512_KERNELS:
+            kernels = &avx512Kernels;
+            break;
+        case AVX2_KERNELS:
+            kernels = &avx2Kernels;
+            break;
+#endif
+        default:
+            type = SCALAR_KERNELS;
+            kernels = &scalarKernels;
+            break;
+    }
+
+    kernelType = type;
+    isKernelSelected = true;
+}
+
+
+
+
+/**
+ * @brief Selects the fastest supported kernels unless a kernel type has been selected explicitly before
+ */
+
+void initKernels(void){
+
+    if (!isKernelSelected) selectKernels(getBestKernelType());
+
+}
+
+
+
+
+/*
+ * KERNEL ENTRY POINTS
+ */
+
+Weight calcDotProduct(const Weight *a, const Weight *b, int count){
+    return kernels->dotProduct(a, b, count);
+}
+
+void addScaledVector(Weight *y, const Weight *x, Weight factor, int count){
+    kernels->addScaledVector(y, x, factor, count);
+}
+
+void calcMatrixVectorProduct(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result){
+    kernels->matrixVectorProduct(matrix, vec, rowCount, colCount, result);
+}
+
+void calcTransposedMatrixVectorProduct(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result){
+    kernels->transposedMatrixVectorProduct(matrix, vec, rowCount, colCount, result);
+}
+
+void activateVector(Weight *vals, int count, ActFctType actType){
+    kernels->activateVector(vals, count, actType);
+}
+
+void scaleByDerivative(Weight *errors, const Weight *outputs, int count, ActFctType actType){
+    kernels->scaleByDerivative(errors, outputs, count, actType);
+}
+
+void sampleBilinear(const Weight *image, int width, int height, const Weight *xs, const Weight *ys, int count, Weight *result){
+    kernels->sampleBilinear(image, width, height, xs, ys, count, result);
+}
@@ -0,0 +1,183 @@
+/**
+ * @file kernels.h
+ * @brief Vectorized math kernels (dot products, matrix-vector products, activation functions) used by the network
+ * @details Each kernel exists as a scalar reference implementation and as hand-vectorized AVX2 and AVX-512
+ * implementations. Which implementation is used is chosen at run-time based on the CPU's capabilities (CPUID),
+ * but can be overridden (e.g. to compare the vectorized kernels against the scalar reference).
+ */
+
+
+#ifndef KERNELS_HEADER
+#define KERNELS_HEADER
+
+// Include project libraries
+#include "dnn.h"
+
+
+
+
+typedef enum KernelType {SCALAR_KERNELS, AVX2_KERNELS, AVX512_KERNELS} KernelType;
+
+
+
+
+/**
+ * @brief Returns the fastest kernel type that is supported by the CPU this program is running on
+ */
+
+KernelType getBestKernelType(void);
+
+
+
+
+/**
+ * @brief Returns the kernel type that is currently used
+ */
+
+KernelType getKernelType(void);
+
+
+
+
+/**
+ * @brief Selects the kernel implementation that is used by all following kernel calls
+ * @details If the requested kernel type is not supported by the CPU, the scalar kernels are selected instead.
+ * @param kernelType The type of kernels to be used (SCALAR/AVX2/AVX512)
+ */
+
+void selectKernels(KernelType kernelType);
+
+
+
+
+/**
+ * @brief Selects the fastest supported kernels unless a kernel type has been selected explicitly before
+ */
+
+void initKernels(void);
+
+
+
+
+/**
+ * @brief Returns the result of applying an activation function to a single value
+ * @param val The value that is to be "activated"
+ * @param actType The type of activation function to be applied (SIGMOID/TANH/RELU)
+ */
+
+Weight activateValue(Weight val, ActFctType actType);
+
+
+
+
+/**
+ * @brief Returns the result of applying the given outputValue to the derivate of the activation function
+ * @param outVal Output value that is to be back propagated
+ * @param actType The type of activation function that was applied during feed forward (SIGMOID/TANH/RELU)
+ */
+
+Weight getDerivative(Weight outVal, ActFctType actType);
+
+
+
+
+/**
+ * @brief Returns the dot product of two vectors
+ * @param a A pointer to the first vector
+ * @param b A pointer to the second vector
+ * @param count Number of values in each vector
+ */
+
+Weight calcDotProduct(const Weight *a, const Weight *b, int count);
+
+
+
+
+/**
+ * @brief Adds a scaled vector to another vector (y = y + factor * x)
+ * @param y A pointer to the vector that is to be updated
+ * @param x A pointer to the vector that is to be added
+ * @param factor The factor by which x is scaled before it is added
+ * @param count Number of values in each vector
+ */
+
+void addScaledVector(Weight *y, const Weight *x, Weight factor, int count);
+
+
+
+
+/**
+ * @brief Multiplies a row-major matrix with a vector (GEMV)
+ * @param matrix A pointer to the first value of the matrix (rowCount x colCount values)
+ * @param vec A pointer to the input vector (colCount values)
+ * @param rowCount Number of rows in the matrix (=number of values in the result vector)
+ * @param colCount Number of columns in the matrix (=number of values in the input vector)
+ * @param result A pointer to the result vector (rowCount values)
+ */
+
+void calcMatrixVectorProduct(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result);
+
+
+
+
+/**
+ * @brief Multiplies the transpose of a row-major matrix with a vector (transposed GEMV)
+ * @details Used during back propagation to push the errors of a layer back through its weights
+ * without having to store the matrix a second time in transposed (column-major) order.
+ * @param matrix A pointer to the first value of the matrix (rowCount x colCount values)
+ * @param vec A pointer to the input vector (rowCount values)
+ * @param rowCount Number of rows in the matrix (=number of values in the input vector)
+ * @param colCount Number of columns in the matrix (=number of values in the result vector)
+ * @param result A pointer to the result vector (colCount values)
+ */
+
+void calcTransposedMatrixVectorProduct(const Weight *matrix, const Weight *vec, int rowCount, int colCount, Weight *result);
+
+
+
+
+/**
+ * @brief Applies an activation function to each value of a vector
+ * @param vals A pointer to the vector whose values are to be "activated"
+ * @param count Number of values in the vector
+ * @param actType The type of activation function to be applied (SIGMOID/TANH/RELU)
+ */
+
+void activateVector(Weight *vals, int count, ActFctType actType);
+
+
+
+
+/**
+ * @brief Multiplies each value of an error vector with the derivative of the activation function
+ * @param errors A pointer to the vector of errors that are to be scaled
+ * @param outputs A pointer to the vector of (activated) outputs at which the derivative is taken
+ * @param count Number of values in each vector
+ * @param actType The type of activation function that was applied during feed forward (SIGMOID/TANH/RELU)
+ */
+
+void scaleByDerivative(Weight *errors, const Weight *outputs, int count, ActFctType actType);
+
+
+
+
+/**
+ * @brief Samples an image at arbitrary (sub-pixel) coordinates using bilinear interpolation
+ * @details The image must be padded with a 1 pixel wide border holding the background value, i.e. it consists
+ * of (height+2) rows of (width+2) values. Coordinates refer to the unpadded image (0,0 = first pixel) and
+ * coordinates outside of the image return the background value.
+ * @param image A pointer to the padded image ((width+2) x (height+2) values)
+ * @param width Width of the (unpadded) image
+ * @param height Height of the (unpadded) image
+ * @param xs A pointer to the x-coordinates of the samples
+ * @param ys A pointer to the y-coordinates of the samples
+ * @param count Number of samples
+ * @param result A pointer to the vector receiving the sampled values (count values)
+ */
+
+void sampleBilinear(const Weight *image, int width, int height, const Weight *xs, const Weight *ys, int count, Weight *result);
+
+
+
+
+#endif
@@ -27,60 +27,376 @@
 #include <stdarg.h>
 #include <math.h>
 #include <locale.h>
+#include <string.h>
+#include <limits.h>
 
 // Include project libraries
 #include "dnn.h"
+#include "random.h"
+#include "pipeline.h"
 #include "util/mnist-utils.h"
+#include "util/mnist-loader.h"
 #include "util/mnist-stats.h"
 #include "util/screen.h"
 
 
 
 
+typedef enum TrainingMode {SERIAL_TRAINING, HOGWILD_TRAINING, DATA_PARALLEL_TRAINING, PIPELINE_TRAINING} TrainingMode;
+
+
+
+
+/**
+ * @brief Data structure holding the order in which the images of a training set are visited, epoch by epoch
+ */
+
+typedef struct TrainingEpochs{
+    MNIST_Dataset *dataset;             // training set
+    MNIST_Augmentation *augmentation;   // random distortions applied to the training images (NULL = none)
+    int *order;                         // sample order that is re-shuffled for each epoch
+    const int *epochOrder;              // order passed to the loaders (order, the cache's fixed order or NULL = sequential)
+    Random rng;                         // random number generator shuffling the order
+} TrainingEpochs;
+
+
+
+
+/**
+ * @brief Data structure of a worker training a network together with other workers (Hogwild)
+ */
+
+typedef struct HogwildWorker{
+    Network *nn;                // replica of the trained network (own outputs/errorSums, shared weights)
+    MNIST_Loader *loader;       // loader shared by all workers (each batch is trained by one worker)
+    int *imgCount;              // number of images trained by all workers in this epoch (shared)
+    int *errCount;              // number of misclassified images of all workers in this epoch (shared)
+    int imgTotal;               // number of images per epoch
+    bool isDisplaying;          // flag whether this worker displays the training progress
+} HogwildWorker;
+
+
+
+
+/**
+ * @brief Creates the epochs of a training run, i.e. the (per epoch shuffled) order in which the images are visited
+ * @details The images are re-shuffled for each epoch, unless a cache file defines a fixed order or the data set is
+ * a (gzip-compressed) stream which can only be read sequentially.
+ * @param dataset A pointer to the training set
+ * @param augmentation A pointer to the random distortions applied to the training images (NULL = none)
+ * @param seed Seed of the random training order
+ */
+
+TrainingEpochs *createTrainingEpochs(MNIST_Dataset *dataset, MNIST_Augmentation *augmentation, uint64_t seed){
+    
+    TrainingEpochs *epochs = (TrainingEpochs*)malloc(sizeof(TrainingEpochs));
+    
+    epochs->dataset      = dataset;
+    epochs->augmentation = augmentation;
+    epochs->order        = createSampleOrder(dataset->count);
+    epochs->epochOrder   = (dataset->order != NULL) ? dataset->order : isStreamedDataset(dataset) ? NULL : epochs->order;
+    
+    seedRandom(&epochs->rng, seed, RANDOM_STREAM_SHUFFLE, 0);
+    
+    return epochs;
+}
+
+
+
+
+/**
+ * @brief Prepares the next epoch (shuffles the order, selects the epoch's distortions) and returns a loader that
+ * starts loading its images in the background
+ * @details Epochs must be started in order (0...epochCount-1). The returned loader must be deleted by the caller.
+ * @param epochs A pointer to the epochs of the training run
+ * @param epoch Number of the epoch
+ * @param batchSize Number of images per loader batch
+ * @param bufferCount Number of batch buffers of the loader
+ * @param pool A pointer to the thread pool filling the loader's batches (NULL = own loader thread)
+ */
+
+MNIST_Loader *startTrainingEpoch(TrainingEpochs *epochs, int epoch, int batchSize, int bufferCount, ThreadPool *pool){
+    
+    MNIST_Dataset *dataset = epochs->dataset;
+    
+    if (epochs->epochOrder == epochs->order) shuffleSampleOrder(epochs->order, dataset->count, &epochs->rng);
+    
+    // Distort the images differently in each epoch
+    if (epochs->augmentation != NULL) epochs->augmentation->epoch = epoch;
+    
+    return createMNISTPoolLoader(dataset, epochs->epochOrder, epochs->augmentation, dataset->count, batchSize, bufferCount, pool);
+}
+
+
+
+
+/**
+ * @brief Releases the memory of the epochs of a training run
+ * @param epochs A pointer to the epochs
+ */
+
+void deleteTrainingEpochs(TrainingEpochs *epochs){
+    
+    free(epochs->order);
+    free(epochs);
+    
+}
+
+
+
+
 /**
- * @brief Trains a network on the MNIST training set
+ * @brief Trains a network on a training set
  * @details Trains the network by feeding input, calculating and backpropaging the error, updating weights
+ * (after every image, or once per mini-batch of nn->batchSize images). The training set is processed
+ * epochCount times, each time in a different random order.
  * @param nn A pointer to the network
+ * @param dataset A pointer to the training set
+ * @param augmentation A pointer to the random distortions applied to the training images (NULL = none)
+ * @param epochCount Number of passes (epochs) over the training set
+ * @param seed Seed of the random training order
  */
 
-void trainNetwork(Network *nn){
+void trainNetwork(Network *nn, MNIST_Dataset *dataset, MNIST_Augmentation *augmentation, int epochCount, uint64_t seed){
     
-    // open MNIST files
-    FILE *imageFile, *labelFile;
-    imageFile = openMNISTImageFile(MNIST_TRAINING_SET_IMAGE_FILE_NAME);
-    labelFile = openMNISTLabelFile(MNIST_TRAINING_SET_LABEL_FILE_NAME);
+    // The input layer's activations are re-used as the input buffer for all images
+    Real *inputBuffer = getNetworkInputBuffer(nn, dataset->imageSize);
     
-    int errCount = 0;
+    // Order in which the images are visited (re-shuffled for each epoch)
+    TrainingEpochs *epochs = createTrainingEpochs(dataset, augmentation, seed);
+    
+    for (int epoch=0; epoch<epochCount; epoch++){
+        
+        double epochStartTime = getWallClockTime();
+        
+        // Start loading (and normalizing) images in the background while the network is computing
+        MNIST_Loader *loader = startTrainingEpoch(epochs, epoch, MNIST_LOADER_BATCH_SIZE, MNIST_LOADER_BUFFER_COUNT, nn->threadPool);
+        
+        int errCount = 0;
+        
+        // Loop through all images in the file (batch by batch, as prefetched by the loader)
+        MNIST_Batch *batch;
+        while ((batch = getNextMNISTBatch(loader)) != NULL){
+            for (int i=0; i<batch->count; i++){
+                
+                int imgCount = batch->first + i;
+                MNIST_Label lbl = batch->labels[i];
+                
+                // Copy the already normalized image into the network's input layer
+                memcpy(inputBuffer, batch->inputs + (i * batch->imageSize), batch->imageSize * sizeof(Real));
+                
+                // Feed forward all layers (from input to hidden to output) calculating all nodes' output
+                feedForwardNetwork(nn);
+                
+                // Back propagate the error and adjust weights in all layers accordingly
+                // (in mini-batch mode the weights are adjusted once per nn->batchSize images)
+                backPropagateNetwork(nn, lbl);
+                
+                // Classify image by choosing output cell with highest output
+                int classification = getNetworkClassification(nn);
+                if (classification!=lbl) errCount++;
+                
+                // Display progress during training
+                displayTrainingProgress(imgCount, dataset->count, errCount);
+            }
+            
+            // Hand the batch's buffer back to the loader for prefetching a following batch
+            releaseMNISTBatch(loader, batch);
+        }
+        
+        deleteMNISTLoader(loader);
+        
+        // Apply the gradients of a last, partially filled mini-batch (if any)
+        updateNetworkWeights(nn);
+        
+        displayEpochResult(epoch, epochCount, dataset->count, errCount, getWallClockTime()-epochStartTime);
+    }
+    
+    deleteTrainingEpochs(epochs);
+    
+}
+
+
+
+
+/**
+ * @brief Runs a range of Hogwild workers (parallel task): each worker trains its replica on batches until all are taken
+ * @details The replica's weight updates are written to the shared weights without any locking, i.e. updates of
+ * different workers may overwrite each other. Since each sample only changes the weights by a small amount and
+ * lost updates are rare, this hardly affects the accuracy (Hogwild).
+ * @param context A pointer to the array of HogwildWorkers
+ * @param first The first worker
+ * @param last The worker following the last worker
+ * @param threadId The index of the executing thread (unused)
+ */
+
+void runHogwildWorkers(void *context, int first, int last, int threadId){
+    
+    for (int w=first; w<last; w++){
+        
+        HogwildWorker *worker = (HogwildWorker*)context + w;
+        Network *nn = worker->nn;
+        
+        Real *inputBuffer = getNetworkInputBuffer(nn, worker->loader->dataset->imageSize);
+        
+        MNIST_Batch *batch;
+        while ((batch = getNextMNISTBatch(worker->loader)) != NULL){
+            for (int i=0; i<batch->count; i++){
+                
+                MNIST_Label lbl = batch->labels[i];
+                
+                memcpy(inputBuffer, batch->inputs + (i * batch->imageSize), batch->imageSize * sizeof(Real));
+                
+                feedForwardNetwork(nn);
+                backPropagateNetwork(nn, lbl);
+                
+                int isError = (getNetworkClassification(nn)!=lbl) ? 1 : 0;
+                
+                int errCount = __atomic_add_fetch(worker->errCount, isError, __ATOMIC_RELAXED);
+                int imgCount = __atomic_add_fetch(worker->imgCount, 1, __ATOMIC_RELAXED);
+                
+                if (worker->isDisplaying) displayTrainingProgress(imgCount-1, worker->imgTotal, errCount);
+            }
+            
+            releaseMNISTBatch(worker->loader, batch);
+        }
+        
+        // Apply the gradients of the worker's last, partially filled mini-batch (if any)
+        updateNetworkWeights(nn);
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Trains a network on a training set using several threads at the same time, without locking (Hogwild)
+ * @details Each worker trains its own replica of the network (own node outputs and errorSums) on different
+ * batches of images, and all of them update the network's shared weights at the same time. The workers are run as
+ * tasks of the network's thread pool (i.e. at most one worker per thread of the pool). This scales almost
+ * linearly with the number of workers, but (since updates may race) results are not reproducible.
+ * In mini-batch mode each worker accumulates its own gradients and applies them once per nn->batchSize images.
+ * @param nn A pointer to the network
+ * @param dataset A pointer to the training set
+ * @param augmentation A pointer to the random distortions applied to the training images (NULL = none)
+ * @param epochCount Number of passes (epochs) over the training set
+ * @param seed Seed of the random training order
+ * @param workerCount Number of workers (e.g. the number of threads of the network's thread pool)
+ */
+
+void trainNetworkHogwild(Network *nn, MNIST_Dataset *dataset, MNIST_Augmentation *augmentation, int epochCount, uint64_t seed, int workerCount){
     
-    // Loop through all images in the file
-    for (int imgCount=0; imgCount<MNIST_MAX_TRAINING_IMAGES; imgCount++){
+    // Order in which the images are visited (see trainNetwork)
+    TrainingEpochs *epochs = createTrainingEpochs(dataset, augmentation, seed);
+    
+    // Each worker holds one batch, so there must be enough buffers for the loader to stay ahead of all workers
+    int bufferCount = (2 * workerCount > MNIST_LOADER_BUFFER_COUNT) ? 2 * workerCount : MNIST_LOADER_BUFFER_COUNT;
+    
+    HogwildWorker *workers = (HogwildWorker*)malloc(workerCount * sizeof(HogwildWorker));
+    
+    for (int w=0; w<workerCount; w++) workers[w].nn = createNetworkReplica(nn);
+    
+    for (int epoch=0; epoch<epochCount; epoch++){
+        
+        double epochStartTime = getWallClockTime();
         
-        // Reading next image and its corresponding label
-        MNIST_Image img = getImage(imageFile);
-        MNIST_Label lbl = getLabel(labelFile);
+        MNIST_Loader *loader = startTrainingEpoch(epochs, epoch, MNIST_LOADER_BATCH_SIZE, bufferCount, nn->threadPool);
         
-        // Convert the MNIST image to a standardized vector format and feed into the network
-        Vector *inpVector = getVectorFromImage(&img);
-        feedInput(nn, inpVector);
+        int imgCount = 0;
+        int errCount = 0;
+        
+        for (int w=0; w<workerCount; w++){
+            workers[w].loader       = loader;
+            workers[w].imgCount     = &imgCount;
+            workers[w].errCount     = &errCount;
+            workers[w].imgTotal     = dataset->count;
+            workers[w].isDisplaying = (w==0);
+        }
+        
+        // One task per worker, the calling thread works as one of the workers
+        runParallelFor(nn->threadPool, workerCount, 1, runHogwildWorkers, workers);
+        
+        deleteMNISTLoader(loader);
+        
+        displayTrainingProgress(dataset->count-1, dataset->count, errCount);
+        displayEpochResult(epoch, epochCount, dataset->count, errCount, getWallClockTime()-epochStartTime);
+    }
+    
+    for (int w=0; w<workerCount; w++) deleteNetwork(workers[w].nn);
+    
+    free(workers);
+    deleteTrainingEpochs(epochs);
+    
+}
 
-        // Feed forward all layers (from input to hidden to output) calculating all nodes' output
-        feedForwardNetwork(nn);
 
-        // Back propagate the error and adjust weights in all layers accordingly
-        backPropagateNetwork(nn, lbl);
 
-        // Classify image by choosing output cell with highest output
-        int classification = getNetworkClassification(nn);
-        if (classification!=lbl) errCount++;
 
-        // Display progress during training
-        displayTrainingProgress(imgCount, errCount);
+/**
+ * @brief Trains a network on a training set by splitting each mini-batch into shards that are processed in parallel
+ * (synchronous data-parallel training)
+ * @details The loader hands out mini-batches of nn->batchSize images. Each mini-batch is split into shardCount
+ * shards, and each shard is back propagated by its own replica of the network into the replica's private gradients.
+ * Once all shards are done, the gradients are reduced in a fixed tree order and applied to the weights (see
+ * trainNetworkShards). Unlike Hogwild, there are no racing updates: for a fixed number of shards the trained weights
+ * are bit-identical in every run, no matter how many threads the network's pool has. The shards and the replicas'
+ * layers are calculated by the network's thread pool, i.e. threads that have finished their own shard steal ranges
+ * of the large layers of the remaining shards.
+ * @param nn A pointer to the network
+ * @param dataset A pointer to the training set
+ * @param augmentation A pointer to the random distortions applied to the training images (NULL = none)
+ * @param epochCount Number of passes (epochs) over the training set
+ * @param seed Seed of the random training order
+ * @param shardCount Number of shards per mini-batch (e.g. the number of threads of the network's thread pool)
+ */
 
+void trainNetworkDataParallel(Network *nn, MNIST_Dataset *dataset, MNIST_Augmentation *augmentation, int epochCount, uint64_t seed, int shardCount){
+    
+    // Shards beyond the mini-batch size stay empty, i.e. their threads have nothing to do
+    if (nn->batchSize < shardCount)
+        printf("Warning: mini-batch size (%d) is smaller than the number of shards (%d), some shards stay empty!\n\n", nn->batchSize, shardCount);
+    
+    // Order in which the images are visited (see trainNetwork)
+    TrainingEpochs *epochs = createTrainingEpochs(dataset, augmentation, seed);
+    
+    Network **replicas = (Network**)malloc(shardCount * sizeof(Network*));
+    
+    // @attention The replicas only accumulate gradients, which are applied by trainNetworkShards() once per mini-batch
+    for (int s=0; s<shardCount; s++){
+        replicas[s] = createNetworkReplica(nn);
+        replicas[s]->batchSize = INT_MAX;
+        setNetworkThreadPool(replicas[s], nn->threadPool, nn->grainSize);
+    }
+    
+    for (int epoch=0; epoch<epochCount; epoch++){
+        
+        double epochStartTime = getWallClockTime();
+        
+        // Each loader batch is one mini-batch
+        MNIST_Loader *loader = startTrainingEpoch(epochs, epoch, nn->batchSize, MNIST_LOADER_BUFFER_COUNT, nn->threadPool);
+        
+        int errCount = 0;
+        
+        MNIST_Batch *batch;
+        while ((batch = getNextMNISTBatch(loader)) != NULL){
+            
+            errCount += trainNetworkShards(nn, replicas, shardCount, batch->inputs, batch->imageSize, batch->labels, batch->count);
+            
+            displayTrainingProgress(batch->first + batch->count - 1, dataset->count, errCount);
+            
+            releaseMNISTBatch(loader, batch);
+        }
+        
+        deleteMNISTLoader(loader);
+        
+        displayEpochResult(epoch, epochCount, dataset->count, errCount, getWallClockTime()-epochStartTime);
     }
     
-    // Close files
-    fclose(imageFile);
-    fclose(labelFile);
+    for (int s=0; s<shardCount; s++) deleteNetwork(replicas[s]);
+    
+    free(replicas);
+    deleteTrainingEpochs(epochs);
     
 }
 
@@ -88,45 +404,116 @@ void trainNetwork(Network *nn){
 
 
 /**
- * @brief Tests an already trained network on the MNIST testing set
- * @details Follows same steps as training process but without backpropagation and updating weights
+ * @brief Trains a network on a training set by streaming the images through a layer pipeline
+ * @details The layers are split into stageCount groups, each of them fed forward and back propagated by its own
+ * thread, i.e. while one group works on an image, the following group works on the previous image (see pipeline.h).
+ * Like Hogwild, this trains asynchronously and results are not reproducible.
  * @param nn A pointer to the network
+ * @param dataset A pointer to the training set
+ * @param augmentation A pointer to the random distortions applied to the training images (NULL = none)
+ * @param epochCount Number of passes (epochs) over the training set
+ * @param seed Seed of the random training order
+ * @param stageCount Number of pipeline stages (=threads)
  */
 
-void testNetwork(Network *nn){
+void trainNetworkPipelined(Network *nn, MNIST_Dataset *dataset, MNIST_Augmentation *augmentation, int epochCount, uint64_t seed, int stageCount){
     
-    // open MNIST files
-    FILE *imageFile, *labelFile;
-    imageFile = openMNISTImageFile(MNIST_TESTING_SET_IMAGE_FILE_NAME);
-    labelFile = openMNISTLabelFile(MNIST_TESTING_SET_LABEL_FILE_NAME);
+    // Order in which the images are visited (see trainNetwork)
+    TrainingEpochs *epochs = createTrainingEpochs(dataset, augmentation, seed);
     
-    int errCount = 0;
+    NetworkPipeline *pipeline = createNetworkPipeline(nn, stageCount);
     
-    // Loop through all images in the file
-    for (int imgCount=0; imgCount<MNIST_MAX_TESTING_IMAGES; imgCount++){
+    for (int epoch=0; epoch<epochCount; epoch++){
+        
+        double epochStartTime = getWallClockTime();
         
-        // Reading next image and its corresponding label
-        MNIST_Image img = getImage(imageFile);
-        MNIST_Label lbl = getLabel(labelFile);
+        MNIST_Loader *loader = startTrainingEpoch(epochs, epoch, MNIST_LOADER_BATCH_SIZE, MNIST_LOADER_BUFFER_COUNT, nn->threadPool);
         
-        // Convert the MNIST image to a standardized vector format and feed into the network
-        Vector *inpVector = getVectorFromImage(&img);
-        feedInput(nn, inpVector);
+        int errCount = runNetworkPipeline(pipeline, loader, true, displayTrainingProgress);
         
-        // Feed forward all layers (from input to hidden to output) calculating all nodes' output
-        feedForwardNetwork(nn);
+        deleteMNISTLoader(loader);
         
-        // Classify image by choosing output cell with highest output
-        int classification = getNetworkClassification(nn);
-        if (classification!=lbl) errCount++;
+        displayEpochResult(epoch, epochCount, dataset->count, errCount, getWallClockTime()-epochStartTime);
+    }
+    
+    deleteNetworkPipeline(pipeline);
+    
+    deleteTrainingEpochs(epochs);
+    
+}
+
+
+
+
+/**
+ * @brief Tests an already trained network on a testing set
+ * @details Follows same steps as training process but without backpropagation and updating weights
+ * @param nn A pointer to the network
+ * @param dataset A pointer to the testing set
+ */
+
+void testNetwork(Network *nn, MNIST_Dataset *dataset){
+    
+    // Start loading (and normalizing) images in the background while the network is computing
+    MNIST_Loader *loader = createMNISTPoolLoader(dataset, NULL, NULL, dataset->count, MNIST_LOADER_BATCH_SIZE, MNIST_LOADER_BUFFER_COUNT, nn->threadPool);
+    
+    // The input layer's activations are re-used as the input buffer for all images
+    Real *inputBuffer = getNetworkInputBuffer(nn, dataset->imageSize);
+    
+    int errCount = 0;
+    
+    // Loop through all images in the file (batch by batch, as prefetched by the loader)
+    MNIST_Batch *batch;
+    while ((batch = getNextMNISTBatch(loader)) != NULL){
+        for (int i=0; i<batch->count; i++){
+            
+            int imgCount = batch->first + i;
+            MNIST_Label lbl = batch->labels[i];
+            
+            // Copy the already normalized image into the network's input layer
+            memcpy(inputBuffer, batch->inputs + (i * batch->imageSize), batch->imageSize * sizeof(Real));
+            
+            // Feed forward all layers (from input to hidden to output) calculating all nodes' output
+            feedForwardNetwork(nn);
+            
+            // Classify image by choosing output cell with highest output
+            int classification = getNetworkClassification(nn);
+            if (classification!=lbl) errCount++;
+            
+            // Display progress during testing
+            displayTestingProgress(imgCount, dataset->count, errCount);
+        }
         
-        // Display progress during testing
-        displayTestingProgress(imgCount, errCount);
+        // Hand the batch's buffer back to the loader for prefetching a following batch
+        releaseMNISTBatch(loader, batch);
     }
     
-    // Close files
-    fclose(imageFile);
-    fclose(labelFile);
+    deleteMNISTLoader(loader);
+    
+}
+
+
+
+
+/**
+ * @brief Tests an already trained network on a testing set by streaming the images through a layer pipeline
+ * @details Gives the same results as testNetwork, but the layer groups of consecutive images are calculated
+ * at the same time by different threads (see pipeline.h).
+ * @param nn A pointer to the network
+ * @param dataset A pointer to the testing set
+ * @param stageCount Number of pipeline stages (=threads)
+ */
+
+void testNetworkPipelined(Network *nn, MNIST_Dataset *dataset, int stageCount){
+    
+    MNIST_Loader *loader = createMNISTPoolLoader(dataset, NULL, NULL, dataset->count, MNIST_LOADER_BATCH_SIZE, MNIST_LOADER_BUFFER_COUNT, nn->threadPool);
+    
+    NetworkPipeline *pipeline = createNetworkPipeline(nn, stageCount);
+    
+    runNetworkPipeline(pipeline, loader, false, displayTestingProgress);
+    
+    deleteNetworkPipeline(pipeline);
+    deleteMNISTLoader(loader);
     
 }
 
@@ -135,6 +522,8 @@ void testNetwork(Network *nn){
 
 /**
  * @details Run a demo that creates a network using a sample network design and ouputs result to console
+ * Usage: mnist-dnn [trainImageFile trainLabelFile testImageFile testLabelFile]
+ * (any unsigned byte IDX files can be used instead of the MNIST files, e.g. EMNIST or Fashion-MNIST)
  */
 
 int main(int argc, const char * argv[]) {
@@ -149,6 +538,23 @@ int main(int argc, const char * argv[]) {
     clearScreen();
     printf("MNIST-DNN: A deep neural network for MNIST image recognition \n\n");
 
+    // Map the data set files given on the command line, or else the MNIST files (or their pre-normalized cache)
+    MNIST_Dataset *trainingSet, *testingSet;
+    
+    if (argc == 5){
+        trainingSet = openMNISTDataset((char*)argv[1], (char*)argv[2]);
+        testingSet  = openMNISTDataset((char*)argv[3], (char*)argv[4]);
+    }
+    else {
+        trainingSet = openCachedMNISTDataset(MNIST_TRAINING_SET_CACHE_FILE_NAME, MNIST_TRAINING_SET_IMAGE_FILE_NAME, MNIST_TRAINING_SET_LABEL_FILE_NAME);
+        testingSet  = openCachedMNISTDataset(MNIST_TESTING_SET_CACHE_FILE_NAME, MNIST_TESTING_SET_IMAGE_FILE_NAME, MNIST_TESTING_SET_LABEL_FILE_NAME);
+    }
+    
+    if (testingSet->imgWidth != trainingSet->imgWidth || testingSet->imgHeight != trainingSet->imgHeight) {
+        printf("Training and testing images differ in size. ABORT!\n");
+        exit(1);
+    }
+    
     // Define the network's overall architecture (layers, nodes, activation function, etc.)
     
     // Define how many layers
@@ -157,7 +563,7 @@ int main(int argc, const char * argv[]) {
     // Define the network model as individual layers (layer by layer)
     LayerDefinition inputLayer = {
         .layerType       = INPUT,
-        .nodeMap         = (Volume){.width=MNIST_IMG_WIDTH, .height=MNIST_IMG_HEIGHT}
+        .nodeMap         = (Volume){.width=trainingSet->imgWidth, .height=trainingSet->imgHeight}   // sized from the data
     };
     
     LayerDefinition hiddenLayer = {
@@ -186,22 +592,53 @@ int main(int argc, const char * argv[]) {
     // Display details of the network definition/architecture on the screen
     outputNetworkDefinition(numberOfLayers, layerDefs);
     
-    // Create a neural network based on the above definition
-    Network *nn = createNetwork(numberOfLayers, layerDefs);
+    // Calculate the columns/nodes of large layers in parallel (layers below the grain size stay serial)
+    int threadCount = getCoreCount();   // number of threads calculating each layer's columns (1 = serial)
+    ThreadPool *threadPool = createThreadPool(threadCount);
+    
+    // Create a neural network based on the above definition (its weights are initialized by the thread pool)
+    Network *nn = createNetwork(numberOfLayers, layerDefs, threadPool);
     
     // Define additional hyper-parameters (optional)
-    nn->learningRate = 0.0004;
+    nn->learningRate = 0.0001;  // step size of the weight updates (0.0002 and above diverge for some initial weights)
+    nn->batchSize    = 1;       // number of images per weight update (1 = update after every image)
+    int epochCount   = 1;       // number of passes over the (shuffled) training set
+    uint64_t seed    = 1;       // seed of the random training order and distortions (same seed = same results)
+    int shardCount   = threadCount;     // number of shards per mini-batch (DATA_PARALLEL_TRAINING, needs batchSize >= shardCount)
+    TrainingMode trainingMode = SERIAL_TRAINING;  // HOGWILD_TRAINING = one image per thread, racy weight updates,
+                                                  // DATA_PARALLEL_TRAINING = mini-batch split into shardCount shards, deterministic
+                                                  // PIPELINE_TRAINING = layer groups per thread, also used for testing
+    
+    // Define random distortions of the training images (data augmentation, all disabled by default)
+    MNIST_Augmentation augmentation = getDefaultAugmentation(seed);
+    augmentation.useShift    = false;
+    augmentation.useRotation = false;
+    augmentation.useScaling  = false;
+    augmentation.useElastic  = false;
     
     // Train the network
-    trainNetwork(nn);
+    if (trainingMode==HOGWILD_TRAINING) trainNetworkHogwild(nn, trainingSet, &augmentation, epochCount, seed, threadCount);
+    else if (trainingMode==DATA_PARALLEL_TRAINING) trainNetworkDataParallel(nn, trainingSet, &augmentation, epochCount, seed, shardCount);
+    else if (trainingMode==PIPELINE_TRAINING) trainNetworkPipelined(nn, trainingSet, &augmentation, epochCount, seed, threadCount);
+    else trainNetwork(nn, trainingSet, &augmentation, epochCount, seed);
     printf("\n");
     
     // Test the network
-    testNetwork(nn);
+    if (trainingMode==PIPELINE_TRAINING) testNetworkPipelined(nn, testingSet, threadCount);
+    else testNetwork(nn, testingSet);
+    
+    // Display how evenly the work was spread over the threads
+    ThreadPoolStats poolStats = getThreadPoolStats(threadPool);
+    printf("\n\nThread pool: %d threads, %lld tasks, %lld steals, %.1f sec idle", getThreadCount(threadPool), poolStats.taskCount, poolStats.stealCount, poolStats.idleTime / 1e9);
     
     // Free the manually allocated memory for this network
-    free(nn);
+    deleteNetwork(nn);
+    deleteThreadPool(threadPool);
     free(layerDefs);
+    
+    // Unmap the data set files
+    closeMNISTDataset(trainingSet);
+    closeMNISTDataset(testingSet);
 
     // Calculate and print the program's total execution time
     time_t endTime = time(NULL);
@@ -0,0 +1,351 @@
+/**
+ * @file pipeline.c
+ * @brief Layer pipeline that streams images through groups of layers, each group calculated by its own thread
+ */
+
+
+// Include external libraries
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Include project libraries
+#include "pipeline.h"
+
+
+
+
+/**
+ * @brief Returns the number of multiply-adds needed to feed forward a layer (used to balance the stages)
+ * @param layerDef A pointer to the layer's definition
+ */
+
+double getPipelineLayerCost(LayerDefinition *layerDef){
+
+    return (double)getLayerNodeCount(layerDef) * getNodeBackwardConnectionCount(layerDef);
+}
+
+
+
+
+/**
+ * @brief Appends a slot to a queue
+ * @param queue A pointer to the queue
+ * @param slotCount The capacity of the queue (=number of slots of the pipeline)
+ * @param slot A pointer to the slot
+ */
+
+void pushPipelineSlot(SlotQueue *queue, int slotCount, PipelineSlot *slot){
+
+    queue->slots[(queue->first + queue->count) % slotCount] = slot;
+    queue->count++;
+}
+
+
+
+
+/**
+ * @brief Removes the first slot from a (non-empty) queue and returns it
+ * @param queue A pointer to the queue
+ * @param slotCount The capacity of the queue (=number of slots of the pipeline)
+ */
+
+PipelineSlot *popPipelineSlot(SlotQueue *queue, int slotCount){
+
+    PipelineSlot *slot = queue->slots[queue->first];
+
+    queue->first = (queue->first + 1) % slotCount;
+    queue->count--;
+
+    return slot;
+}
+
+
+
+
+/**
+ * @brief Hands a slot over to another stage and wakes up the stage's thread
+ * @param stage A pointer to the stage receiving the slot
+ * @param isBackward Flag whether the slot is to be back propagated (or fed forward)
+ * @param slot A pointer to the slot
+ */
+
+void sendPipelineSlot(PipelineStage *stage, bool isBackward, PipelineSlot *slot){
+
+    pthread_mutex_lock(&stage->lock);
+
+    pushPipelineSlot(isBackward ? &stage->backward : &stage->forward, stage->pipeline->slotCount, slot);
+
+    pthread_cond_signal(&stage->changed);
+    pthread_mutex_unlock(&stage->lock);
+}
+
+
+
+
+/**
+ * @brief Copies the next image (in loading order) and its label from the loader into a slot
+ * @param pipeline A pointer to the pipeline
+ * @param slot A pointer to the slot
+ */
+
+void loadPipelineImage(NetworkPipeline *pipeline, PipelineSlot *slot){
+
+    // Hand a completely copied batch back to the loader for prefetching a following batch
+    if (pipeline->batch!=NULL && pipeline->batchPosition==pipeline->batch->count){
+        releaseMNISTBatch(pipeline->loader, pipeline->batch);
+        pipeline->batch = NULL;
+    }
+
+    if (pipeline->batch==NULL){
+        pipeline->batch = getNextMNISTBatch(pipeline->loader);
+        pipeline->batchPosition = 0;
+    }
+
+    if (pipeline->batch==NULL){
+        printf("Loader holds fewer images than expected by the pipeline! ABORT!\n");
+        exit(1);
+    }
+
+    MNIST_Batch *batch = pipeline->batch;
+    int i = pipeline->batchPosition++;
+
+    Real *inputBuffer = getNetworkInputBuffer(slot->nn, batch->imageSize);
+
+    memcpy(inputBuffer, batch->inputs + (i * batch->imageSize), batch->imageSize * sizeof(Real));
+    slot->label = batch->labels[i];
+}
+
+
+
+
+/**
+ * @brief Runs a stage of the pipeline until it has processed all images of the current run
+ * @details Slots waiting to be back propagated are preferred over new images, so that slots become free as early
+ * as possible. The first stage takes free slots from its forward queue and fills them with the next image. The last
+ * stage classifies the images and (during training) starts back propagating them right away. Once a slot has been
+ * back propagated by the first stage (or classified by the last stage during testing) it is free again.
+ * @param stage A pointer to the stage
+ */
+
+void runPipelineStage(PipelineStage *stage){
+
+    NetworkPipeline *pipeline = stage->pipeline;
+
+    bool isFirstStage = (stage->stageNo==0);
+    bool isLastStage  = (stage->stageNo==pipeline->stageCount-1);
+
+    int forwardCount  = 0;
+    int backwardCount = 0;
+    int backwardTotal = pipeline->isTraining ? pipeline->sampleCount : 0;
+
+    while (forwardCount<pipeline->sampleCount || backwardCount<backwardTotal){
+
+        pthread_mutex_lock(&stage->lock);
+
+        // @attention The first stage's forward queue still holds free slots once all images have been started
+        while (stage->backward.count==0 && (stage->forward.count==0 || forwardCount==pipeline->sampleCount)){
+            pthread_cond_wait(&stage->changed, &stage->lock);
+        }
+
+        bool isBackward = (stage->backward.count>0);
+        PipelineSlot *slot = popPipelineSlot(isBackward ? &stage->backward : &stage->forward, pipeline->slotCount);
+
+        pthread_mutex_unlock(&stage->lock);
+
+        if (!isBackward){
+
+            if (isFirstStage) loadPipelineImage(pipeline, slot);
+
+            feedForwardLayers(slot->nn, stage->firstLayer, stage->lastLayer);
+            forwardCount++;
+
+            if (!isLastStage){
+                sendPipelineSlot(stage+1, false, slot);
+                continue;
+            }
+
+            // Classify image by choosing output cell with highest output
+            if (getNetworkClassification(slot->nn)!=slot->label) pipeline->errCount++;
+
+            if (pipeline->displayProgress!=NULL) pipeline->displayProgress(pipeline->imgCount, pipeline->sampleCount, pipeline->errCount);
+            pipeline->imgCount++;
+
+            if (!pipeline->isTraining){
+                sendPipelineSlot(pipeline->stages, false, slot);
+                continue;
+            }
+        }
+
+        backPropagateLayers(slot->nn, stage->firstLayer, stage->lastLayer, slot->label);
+        backwardCount++;
+
+        // Once the first stage has back propagated a slot, it is free again
+        if (isFirstStage) sendPipelineSlot(stage, false, slot);
+        else sendPipelineSlot(stage-1, true, slot);
+    }
+
+}
+
+
+
+
+/**
+ * @brief Main function of a pipeline thread running one of the stages (following the first stage)
+ * @param arg A pointer to the PipelineStage
+ */
+
+void *runPipelineStageThread(void *arg){
+
+    runPipelineStage((PipelineStage*)arg);
+
+    return NULL;
+}
+
+
+
+
+/**
+ * @brief Creates a layer pipeline for a network
+ * @details The layers are split into stageCount stages of about the same number of multiply-adds. If the network
+ * has fewer (non-input) layers than stages, the number of stages is reduced accordingly.
+ * @param nn A pointer to the neural network
+ * @param stageCount Number of stages (=threads)
+ */
+
+NetworkPipeline *createNetworkPipeline(Network *nn, int stageCount){
+
+    // Each stage needs at least one layer (the INPUT layer isn't calculated)
+    if (stageCount > nn->layerCount-1) stageCount = nn->layerCount-1;
+    if (stageCount < 1) stageCount = 1;
+
+    NetworkPipeline *pipeline = (NetworkPipeline*)calloc(1, sizeof(NetworkPipeline));
+
+    pipeline->nn         = nn;
+    pipeline->stageCount = stageCount;
+    pipeline->slotCount  = stageCount * PIPELINE_SLOTS_PER_STAGE;
+    pipeline->stages     = (PipelineStage*)calloc(stageCount, sizeof(PipelineStage));
+    pipeline->slots      = (PipelineSlot*)calloc(pipeline->slotCount, sizeof(PipelineSlot));
+    pipeline->threads    = (pthread_t*)malloc(stageCount * sizeof(pthread_t));
+
+    double totalCost = 0;
+    for (int l=1; l<nn->layerCount; l++) totalCost += getPipelineLayerCost(nn->layerTable[l]->layerDef);
+
+    // Assign consecutive layers to each stage until it has (about) its share of the total cost
+    int layerId = 1;
+    double cost = 0;
+
+    for (int s=0; s<stageCount; s++){
+
+        PipelineStage *stage = &pipeline->stages[s];
+
+        stage->pipeline   = pipeline;
+        stage->stageNo    = s;
+        stage->firstLayer = layerId;
+
+        double targetCost = totalCost * (s+1) / stageCount;
+
+        // @attention Leave at least one layer for each of the following stages
+        int maxLayerId = nn->layerCount - (stageCount-1-s);
+
+        do {
+            cost += getPipelineLayerCost(nn->layerTable[layerId]->layerDef);
+            layerId++;
+        } while (layerId<maxLayerId && (s==stageCount-1 || cost + getPipelineLayerCost(nn->layerTable[layerId]->layerDef)/2 <= targetCost));
+
+        stage->lastLayer = layerId;
+
+        stage->forward.slots  = (PipelineSlot**)malloc(pipeline->slotCount * sizeof(PipelineSlot*));
+        stage->backward.slots = (PipelineSlot**)malloc(pipeline->slotCount * sizeof(PipelineSlot*));
+
+        pthread_mutex_init(&stage->lock, NULL);
+        pthread_cond_init(&stage->changed, NULL);
+    }
+
+    // Each slot holds its own node values (and gradients), but shares the network's weights
+    for (int i=0; i<pipeline->slotCount; i++) pipeline->slots[i].nn = createNetworkReplica(nn);
+
+    return pipeline;
+}
+
+
+
+
+/**
+ * @brief Releases the memory of a layer pipeline (but not of its network)
+ * @param pipeline A pointer to the pipeline
+ */
+
+void deleteNetworkPipeline(NetworkPipeline *pipeline){
+
+    if (pipeline==NULL) return;
+
+    for (int i=0; i<pipeline->slotCount; i++) deleteNetwork(pipeline->slots[i].nn);
+
+    for (int s=0; s<pipeline->stageCount; s++){
+
+        PipelineStage *stage = &pipeline->stages[s];
+
+        pthread_cond_destroy(&stage->changed);
+        pthread_mutex_destroy(&stage->lock);
+
+        free(stage->backward.slots);
+        free(stage->forward.slots);
+    }
+
+    free(pipeline->threads);
+    free(pipeline->slots);
+    free(pipeline->stages);
+    free(pipeline);
+}
+
+
+
+
+/**
+ * @brief Streams all images of a loader through the pipeline and returns the number of misclassified images
+ * @param pipeline A pointer to the pipeline
+ * @param loader A pointer to the loader from which the images are taken (in loading order)
+ * @param isTraining Flag whether the images are back propagated (training) or only classified (testing)
+ * @param displayProgress Function displaying the progress (or NULL)
+ */
+
+int runNetworkPipeline(NetworkPipeline *pipeline, MNIST_Loader *loader, bool isTraining, ProgressFunction displayProgress){
+
+    pipeline->loader          = loader;
+    pipeline->batch           = NULL;
+    pipeline->batchPosition   = 0;
+    pipeline->isTraining      = isTraining;
+    pipeline->sampleCount     = loader->sampleCount;
+    pipeline->displayProgress = displayProgress;
+    pipeline->imgCount        = 0;
+    pipeline->errCount        = 0;
+
+    // All slots start out free, i.e. in the first stage's forward queue
+    for (int s=0; s<pipeline->stageCount; s++){
+        pipeline->stages[s].forward.first  = 0;
+        pipeline->stages[s].forward.count  = 0;
+        pipeline->stages[s].backward.first = 0;
+        pipeline->stages[s].backward.count = 0;
+    }
+
+    for (int i=0; i<pipeline->slotCount; i++) pushPipelineSlot(&pipeline->stages[0].forward, pipeline->slotCount, &pipeline->slots[i]);
+
+    // The calling thread runs the first stage
+    for (int s=1; s<pipeline->stageCount; s++){
+        if (pthread_create(&pipeline->threads[s], NULL, runPipelineStageThread, &pipeline->stages[s]) != 0) {
+            printf("Could not start pipeline thread. ABORT!\n");
+            exit(1);
+        }
+    }
+    runPipelineStage(&pipeline->stages[0]);
+    for (int s=1; s<pipeline->stageCount; s++) pthread_join(pipeline->threads[s], NULL);
+
+    if (pipeline->batch!=NULL) releaseMNISTBatch(loader, pipeline->batch);
+    pipeline->batch = NULL;
+
+    // Apply the gradients of the slots' last, partially filled mini-batches (if any)
+    if (isTraining) for (int i=0; i<pipeline->slotCount; i++) updateNetworkWeights(pipeline->slots[i].nn);
+
+    return pipeline->errCount;
+}
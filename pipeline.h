@@ -0,0 +1,158 @@
+/**
+ * @file pipeline.h
+ * @brief Layer pipeline that streams images through groups of layers, each group calculated by its own thread
+ * @details The network's layers are split into stages (groups of consecutive layers with about the same number of
+ * multiply-adds). Each stage is calculated by its own thread, so that while stage k works on image i+1, stage k+1
+ * works on image i. Images in flight are held by slots (replicas of the network with their own node values), which
+ * are passed from stage to stage through queues. Since the number of slots is fixed, the queues are bounded and
+ * the first stage only starts a new image once a slot has become free again (backpressure).
+ * During training each stage also back propagates its layers, i.e. slots travel forward through all stages and
+ * then backward again. New images are fed forward while the errors of older images are still being back propagated,
+ * and a stage reads the weights of the following stage while these are updated (asynchronous training, like
+ * Hogwild). Results are therefore not reproducible. In mini-batch mode each slot accumulates its own gradients.
+ */
+
+#ifndef PIPELINE_HEADER
+#define PIPELINE_HEADER
+
+
+
+
+// Include external libraries
+#include <pthread.h>
+#include <stdbool.h>
+
+// Include project libraries
+#include "dnn.h"
+#include "util/mnist-loader.h"
+
+/// Define the number of slots (=images in flight) per stage
+#define PIPELINE_SLOTS_PER_STAGE 2
+
+
+
+
+typedef struct PipelineSlot PipelineSlot;
+typedef struct SlotQueue SlotQueue;
+typedef struct PipelineStage PipelineStage;
+typedef struct NetworkPipeline NetworkPipeline;
+
+
+
+
+/**
+ * @brief Function displaying the progress of a pipeline run (e.g. displayTrainingProgress or displayTestingProgress)
+ * @param imgCount Number of images already processed (minus 1)
+ * @param imgTotal Total number of images
+ * @param errCount Number of errors (images incorrectly classified)
+ */
+
+typedef void (*ProgressFunction)(int imgCount, int imgTotal, int errCount);
+
+
+
+
+/**
+ * @brief Data structure holding one image while it travels through the pipeline
+ */
+
+struct PipelineSlot{
+    Network *nn;                    // replica of the network holding the image's node values
+    MNIST_Label label;              // label of the image
+};
+
+
+
+
+/**
+ * @brief Data structure of a FIFO queue of slots (bounded by the number of slots)
+ */
+
+struct SlotQueue{
+    PipelineSlot **slots;           // ring of slot pointers (one entry per slot of the pipeline)
+    int first;                      // position of the first slot in the ring
+    int count;                      // number of slots in the queue
+};
+
+
+
+
+/**
+ * @brief Data structure of a stage of the pipeline (a group of consecutive layers calculated by one thread)
+ */
+
+struct PipelineStage{
+    NetworkPipeline *pipeline;      // pipeline the stage belongs to
+    int stageNo;                    // index of the stage (0 = first stage, run by the calling thread)
+    int firstLayer;                 // id of the stage's first layer
+    int lastLayer;                  // id of the layer following the stage's last layer
+    SlotQueue forward;              // slots waiting to be fed forward (first stage: free slots for new images)
+    SlotQueue backward;             // slots waiting to be back propagated
+    pthread_mutex_t lock;           // lock protecting the stage's queues
+    pthread_cond_t changed;         // signaled when a slot is added to one of the stage's queues
+};
+
+
+
+
+/**
+ * @brief Data structure of a layer pipeline
+ */
+
+struct NetworkPipeline{
+    Network *nn;                    // network calculated by the pipeline
+    int stageCount;                 // number of stages (=threads)
+    int slotCount;                  // number of slots (=maximum number of images in flight)
+    PipelineStage *stages;          // stages (in feed forward order)
+    PipelineSlot *slots;            // slots
+    pthread_t *threads;             // threads of the stages (the calling thread runs the first stage)
+    MNIST_Loader *loader;           // loader of the images of the current run
+    MNIST_Batch *batch;             // loader batch from which the first stage currently takes its images
+    int batchPosition;              // index of the next image inside this batch
+    bool isTraining;                // flag whether the current run back propagates the images
+    int sampleCount;                // number of images of the current run
+    ProgressFunction displayProgress; // function displaying the progress of the current run (or NULL)
+    int imgCount;                   // number of images of the current run classified by the last stage
+    int errCount;                   // number of misclassified images of the current run
+};
+
+
+
+
+/**
+ * @brief Creates a layer pipeline for a network
+ * @details The layers are split into stageCount stages of about the same number of multiply-adds. If the network
+ * has fewer (non-input) layers than stages, the number of stages is reduced accordingly.
+ * @param nn A pointer to the neural network
+ * @param stageCount Number of stages (=threads)
+ */
+
+NetworkPipeline *createNetworkPipeline(Network *nn, int stageCount);
+
+
+
+
+/**
+ * @brief Releases the memory of a layer pipeline (but not of its network)
+ * @param pipeline A pointer to the pipeline
+ */
+
+void deleteNetworkPipeline(NetworkPipeline *pipeline);
+
+
+
+
+/**
+ * @brief Streams all images of a loader through the pipeline and returns the number of misclassified images
+ * @param pipeline A pointer to the pipeline
+ * @param loader A pointer to the loader from which the images are taken (in loading order)
+ * @param isTraining Flag whether the images are back propagated (training) or only classified (testing)
+ * @param displayProgress Function displaying the progress (or NULL)
+ */
+
+int runNetworkPipeline(NetworkPipeline *pipeline, MNIST_Loader *loader, bool isTraining, ProgressFunction displayProgress);
+
+
+
+
+#endif
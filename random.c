@@ -0,0 +1,143 @@
+/**
+ * @file random.c
+ * @brief Fast, reproducible pseudo random number generator (xoshiro256**) with independent streams
+ */
+
+
+// Include project libraries
+#include "random.h"
+
+
+
+
+/**
+ * @brief Returns the next value of a splitmix64 sequence (used to expand seeds into generator states)
+ * @param x A pointer to the state of the sequence
+ */
+
+uint64_t getNextSplitMix(uint64_t *x){
+    
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    
+    return z ^ (z >> 31);
+}
+
+
+
+
+/**
+ * @brief Initializes a generator with a seed, a purpose and a stream number
+ * @details First a sub-seed per purpose is derived from the seed, then the sub-seed and the (scrambled) stream number
+ * are expanded via splitmix64 into the 256bit state, which is how the xoshiro authors recommend seeding the generator.
+ * @param rng A pointer to the generator
+ * @param seed The seed (e.g. of a whole training run)
+ * @param purpose The consumer of the random numbers (e.g. RANDOM_STREAM_WEIGHTS)
+ * @param stream The number of the stream (e.g. of a thread, a chunk of weights or a sample)
+ */
+
+void seedRandom(Random *rng, uint64_t seed, RandomPurpose purpose, uint64_t stream){
+    
+    // Scramble the purpose into the seed, so that the streams of different purposes are unrelated
+    uint64_t x = (uint64_t)purpose;
+    uint64_t subSeed = seed ^ getNextSplitMix(&x);
+    subSeed = getNextSplitMix(&subSeed);
+    
+    x = stream;
+    uint64_t s = subSeed ^ getNextSplitMix(&x);
+    
+    for (int i=0; i<4; i++) rng->state[i] = getNextSplitMix(&s);
+}
+
+
+
+
+/**
+ * @brief Returns a 64bit value rotated to the left by k bits
+ */
+
+static inline uint64_t rotateLeft(uint64_t x, int k){
+    
+    return (x << k) | (x >> (64 - k));
+}
+
+
+
+
+/**
+ * @brief Returns the next 64 random bits of a generator
+ * @param rng A pointer to the generator
+ */
+
+uint64_t getRandomBits(Random *rng){
+    
+    uint64_t *s = rng->state;
+    
+    uint64_t result = rotateLeft(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotateLeft(s[3], 45);
+    
+    return result;
+}
+
+
+
+
+/**
+ * @brief Returns a uniformly distributed random number from 0 (inclusive) to 1 (exclusive)
+ * @param rng A pointer to the generator
+ */
+
+double getRandomUniform(Random *rng){
+    
+    // Use the upper 53 bits (=precision of a double)
+    return (getRandomBits(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+
+
+/**
+ * @brief Returns a uniformly distributed random number from min (inclusive) to max (exclusive)
+ * @param rng A pointer to the generator
+ * @param min Lower bound of the random number
+ * @param max Upper bound of the random number
+ */
+
+double getRandomRange(Random *rng, double min, double max){
+    
+    return min + (getRandomUniform(rng) * (max - min));
+}
+
+
+
+
+/**
+ * @brief Returns a uniformly distributed random integer from 0 to bound-1 (without modulo bias)
+ * @details Uses Lemire's multiply-and-shift method, rejecting the few values that would introduce a bias.
+ * @param rng A pointer to the generator
+ * @param bound Number of possible values (1 to INT32_MAX)
+ */
+
+int getRandomInt(Random *rng, int bound){
+    
+    uint64_t m = (getRandomBits(rng) >> 32) * (uint64_t)bound;
+    uint32_t low = (uint32_t)m;
+    
+    if (low < (uint32_t)bound){
+        uint32_t threshold = (uint32_t)(-(uint32_t)bound) % (uint32_t)bound;
+        while (low < threshold){
+            m = (getRandomBits(rng) >> 32) * (uint64_t)bound;
+            low = (uint32_t)m;
+        }
+    }
+    
+    return (int)(m >> 32);
+}
@@ -0,0 +1,100 @@
+/**
+ * @file random.h
+ * @brief Fast, reproducible pseudo random number generator (xoshiro256**) with independent streams
+ * @details Each generator's state is owned by its caller (e.g. one generator per thread or per work item), i.e.
+ * there is no hidden global state and no locking. A generator is seeded with a seed, a purpose and a stream number:
+ * the same seed, purpose and stream always produce the same sequence, different ones produce independent sequences.
+ * The purpose separates the consumers of a seed, e.g. chunk 0 of the weights and image 0 of the distortions never
+ * share a sequence, even if the run's seed equals DEFAULT_WEIGHT_SEED.
+ * Work that is split into fixed items with one stream per item therefore produces bit-identical results no
+ * matter how many threads process the items.
+ * @see http://prng.di.unimi.it/
+ */
+
+#ifndef RANDOM_HEADER
+#define RANDOM_HEADER
+
+
+
+
+// Include external libraries
+#include <stdint.h>
+
+
+
+
+typedef struct Random Random;
+
+typedef enum RandomPurpose {RANDOM_STREAM_WEIGHTS, RANDOM_STREAM_SHUFFLE, RANDOM_STREAM_AUGMENT, RANDOM_STREAM_CHECK} RandomPurpose;
+
+
+
+
+/**
+ * @brief State of a pseudo random number generator
+ */
+
+struct Random{
+    uint64_t state[4];
+};
+
+
+
+
+/**
+ * @brief Initializes a generator with a seed, a purpose and a stream number
+ * @param rng A pointer to the generator
+ * @param seed The seed (e.g. of a whole training run)
+ * @param purpose The consumer of the random numbers (e.g. RANDOM_STREAM_WEIGHTS)
+ * @param stream The number of the stream (e.g. of a thread, a chunk of weights or a sample)
+ */
+
+void seedRandom(Random *rng, uint64_t seed, RandomPurpose purpose, uint64_t stream);
+
+
+
+
+/**
+ * @brief Returns the next 64 random bits of a generator
+ * @param rng A pointer to the generator
+ */
+
+uint64_t getRandomBits(Random *rng);
+
+
+
+
+/**
+ * @brief Returns a uniformly distributed random number from 0 (inclusive) to 1 (exclusive)
+ * @param rng A pointer to the generator
+ */
+
+double getRandomUniform(Random *rng);
+
+
+
+
+/**
+ * @brief Returns a uniformly distributed random number from min (inclusive) to max (exclusive)
+ * @param rng A pointer to the generator
+ * @param min Lower bound of the random number
+ * @param max Upper bound of the random number
+ */
+
+double getRandomRange(Random *rng, double min, double max);
+
+
+
+
+/**
+ * @brief Returns a uniformly distributed random integer from 0 to bound-1 (without modulo bias)
+ * @param rng A pointer to the generator
+ * @param bound Number of possible values (1 to INT32_MAX)
+ */
+
+int getRandomInt(Random *rng, int bound);
+
+
+
+
+#endif
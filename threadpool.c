@@ -0,0 +1,547 @@
+/**
+ * @file threadpool.c
+ * @brief Work-stealing pool of worker threads that execute tasks, e.g. the ranges of a parallel loop (the columns of a
+ * layer, the shards of a mini-batch) or the filling of a loader batch
+ */
+
+
+// Include external libraries
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+
+// Include project libraries
+#include "threadpool.h"
+
+
+
+
+// Pool and index of the current thread (NULL for threads that aren't workers of a pool)
+static __thread ThreadPool *currentThreadPool = NULL;
+static __thread int currentThreadId = 0;
+
+
+
+
+/**
+ * @brief Returns the number of cores (logical processors) of this computer
+ */
+
+int getCoreCount(void){
+
+    int coreCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (coreCount<1) ? 1 : coreCount;
+}
+
+
+
+
+/**
+ * @brief Returns the current time (in nanoseconds) of a monotonic clock, used to measure the threads' idle time
+ */
+
+long long getThreadPoolTime(void){
+
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (long long)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+
+
+
+/**
+ * @brief Returns the index of the current thread in a pool (0 if it isn't one of the pool's worker threads)
+ * @param pool A pointer to the thread pool (or NULL)
+ */
+
+int getCurrentThreadId(ThreadPool *pool){
+
+    return (pool!=NULL && currentThreadPool==pool) ? currentThreadId : 0;
+}
+
+
+
+
+/**
+ * @brief Adds a task to the back of a deque, doubling the deque's capacity if it is full
+ * @param deque A pointer to the deque
+ * @param task A pointer to the task
+ */
+
+void pushTaskDeque(TaskDeque *deque, ThreadPoolTask *task){
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->count==deque->capacity){
+
+        ThreadPoolTask *tasks = (ThreadPoolTask*)malloc(2 * deque->capacity * sizeof(ThreadPoolTask));
+
+        // Unwrap the ring while copying, i.e. the front task moves to position 0
+        for (int i=0; i<deque->count; i++) tasks[i] = deque->tasks[(deque->first + i) % deque->capacity];
+
+        free(deque->tasks);
+
+        deque->tasks    = tasks;
+        deque->capacity = 2 * deque->capacity;
+        deque->first    = 0;
+    }
+
+    deque->tasks[(deque->first + deque->count) % deque->capacity] = *task;
+    __atomic_add_fetch(&deque->count, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&deque->lock);
+}
+
+
+
+
+/**
+ * @brief Removes a task from a deque, either the newest one (back) or the oldest one (front)
+ * @details Returns false if the deque is empty.
+ * @param deque A pointer to the deque
+ * @param isStealing Flag whether the task is taken from the front (by another thread) or from the back (by the owner)
+ * @param task A pointer to the task receiving the removed task
+ */
+
+bool popTaskDeque(TaskDeque *deque, bool isStealing, ThreadPoolTask *task){
+
+    // Skip empty deques without locking them
+    if (__atomic_load_n(&deque->count, __ATOMIC_RELAXED)==0) return false;
+
+    pthread_mutex_lock(&deque->lock);
+
+    bool isFound = (deque->count>0);
+
+    if (isFound){
+
+        if (isStealing){
+            *task = deque->tasks[deque->first];
+            deque->first = (deque->first + 1) % deque->capacity;
+        }
+        else *task = deque->tasks[(deque->first + deque->count - 1) % deque->capacity];
+
+        __atomic_sub_fetch(&deque->count, 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return isFound;
+}
+
+
+
+
+/**
+ * @brief Pushes a task onto the deque of a thread (without waking up any sleeping worker threads)
+ * @param pool A pointer to the thread pool
+ * @param threadId The index of the thread whose deque receives the task
+ * @param task A pointer to the task
+ */
+
+void pushThreadPoolTask(ThreadPool *pool, int threadId, ThreadPoolTask *task){
+
+    pushTaskDeque(&pool->threads[threadId].deque, task);
+
+    // @attention Must be sequentially consistent with the check of sleepingThreadCount (see wakeThreadPoolWorkers)
+    __atomic_add_fetch(&pool->queuedTaskCount, 1, __ATOMIC_SEQ_CST);
+}
+
+
+
+
+/**
+ * @brief Wakes up sleeping worker threads after tasks have been pushed
+ * @param pool A pointer to the thread pool
+ * @param taskCount Number of tasks that have been pushed
+ */
+
+void wakeThreadPoolWorkers(ThreadPool *pool, int taskCount){
+
+    if (__atomic_load_n(&pool->sleepingThreadCount, __ATOMIC_SEQ_CST)==0) return;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (taskCount==1) pthread_cond_signal(&pool->taskAdded);
+    else pthread_cond_broadcast(&pool->taskAdded);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+
+
+/**
+ * @brief Takes the next task for a thread: the newest task of its own deque or else the oldest task of another deque
+ * @details Returns false if all deques are empty. Background tasks are never returned (see runThreadPoolWorker).
+ * @param pool A pointer to the thread pool
+ * @param threadId The index of the thread looking for a task
+ * @param task A pointer to the task receiving the found task
+ */
+
+bool findThreadPoolTask(ThreadPool *pool, int threadId, ThreadPoolTask *task){
+
+    ThreadPoolThread *thread = &pool->threads[threadId];
+
+    bool isFound = popTaskDeque(&thread->deque, false, task);
+
+    // Try to steal from the other threads, starting with the following one (so that thieves spread over the victims)
+    for (int t=1; !isFound && t<pool->threadCount; t++){
+        isFound = popTaskDeque(&pool->threads[(threadId + t) % pool->threadCount].deque, true, task);
+        if (isFound) __atomic_add_fetch(&thread->stats.stealCount, 1, __ATOMIC_RELAXED);
+    }
+
+    if (isFound) __atomic_sub_fetch(&pool->queuedTaskCount, 1, __ATOMIC_SEQ_CST);
+
+    return isFound;
+}
+
+
+
+
+/**
+ * @brief Executes a task and notifies the task's group that it is finished
+ * @param pool A pointer to the thread pool
+ * @param threadId The index of the executing thread
+ * @param task A pointer to the task
+ */
+
+void runThreadPoolTask(ThreadPool *pool, int threadId, ThreadPoolTask *task){
+
+    task->task(task->context, task->first, task->last, threadId);
+
+    __atomic_add_fetch(&pool->threads[threadId].stats.taskCount, 1, __ATOMIC_RELAXED);
+
+    // @attention Release the task's results to the thread waiting for the group
+    __atomic_sub_fetch(&task->group->pendingCount, 1, __ATOMIC_RELEASE);
+}
+
+
+
+
+/**
+ * @brief Main function of a worker thread: executes (own or stolen) tasks and sleeps while there are none
+ * @param arg A pointer to the worker's ThreadPoolThread
+ */
+
+void *runThreadPoolWorker(void *arg){
+
+    ThreadPoolThread *thread = (ThreadPoolThread*)arg;
+    ThreadPool *pool = thread->pool;
+
+    currentThreadPool = pool;
+    currentThreadId   = thread->threadId;
+
+    for (;;){
+
+        ThreadPoolTask task;
+
+        if (findThreadPoolTask(pool, thread->threadId, &task)){
+            runThreadPoolTask(pool, thread->threadId, &task);
+            continue;
+        }
+
+        // Background tasks are only started once there is nothing else to do
+        if (popTaskDeque(&pool->backgroundTasks, true, &task)){
+            __atomic_sub_fetch(&pool->queuedTaskCount, 1, __ATOMIC_SEQ_CST);
+            runThreadPoolTask(pool, thread->threadId, &task);
+            continue;
+        }
+
+        long long idleStart = getThreadPoolTime();
+
+        // Stay awake for a moment, since new tasks usually follow soon (e.g. the next layer's ranges)
+        for (int i=0; i<THREAD_POOL_SPIN_COUNT; i++){
+            if (__atomic_load_n(&pool->queuedTaskCount, __ATOMIC_SEQ_CST)>0 || __atomic_load_n(&pool->stopped, __ATOMIC_RELAXED)) break;
+            sched_yield();
+        }
+
+        pthread_mutex_lock(&pool->lock);
+
+        __atomic_add_fetch(&pool->sleepingThreadCount, 1, __ATOMIC_SEQ_CST);
+
+        while (!pool->stopped && __atomic_load_n(&pool->queuedTaskCount, __ATOMIC_SEQ_CST)==0) pthread_cond_wait(&pool->taskAdded, &pool->lock);
+
+        __atomic_sub_fetch(&pool->sleepingThreadCount, 1, __ATOMIC_SEQ_CST);
+
+        bool isStopped = pool->stopped && __atomic_load_n(&pool->queuedTaskCount, __ATOMIC_SEQ_CST)==0;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        __atomic_add_fetch(&thread->stats.idleTime, getThreadPoolTime() - idleStart, __ATOMIC_RELAXED);
+
+        if (isStopped) break;
+    }
+
+    return NULL;
+}
+
+
+
+
+/**
+ * @brief Creates a thread pool and starts its worker threads
+ * @param threadCount Total number of threads (including the thread that calls runParallelFor)
+ */
+
+ThreadPool *createThreadPool(int threadCount){
+
+    if (threadCount<1) threadCount = 1;
+
+    ThreadPool *pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+
+    pool->threadCount = threadCount;
+    pool->threads = (ThreadPoolThread*)calloc(threadCount, sizeof(ThreadPoolThread));
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->taskAdded, NULL);
+
+    pool->backgroundTasks.tasks    = (ThreadPoolTask*)malloc(THREAD_POOL_DEQUE_CAPACITY * sizeof(ThreadPoolTask));
+    pool->backgroundTasks.capacity = THREAD_POOL_DEQUE_CAPACITY;
+    pthread_mutex_init(&pool->backgroundTasks.lock, NULL);
+
+    for (int t=0; t<threadCount; t++){
+
+        ThreadPoolThread *thread = &pool->threads[t];
+
+        thread->pool           = pool;
+        thread->threadId       = t;
+        thread->deque.tasks    = (ThreadPoolTask*)malloc(THREAD_POOL_DEQUE_CAPACITY * sizeof(ThreadPoolTask));
+        thread->deque.capacity = THREAD_POOL_DEQUE_CAPACITY;
+
+        pthread_mutex_init(&thread->deque.lock, NULL);
+    }
+
+    // Thread 0 is the thread using the pool, i.e. only the other threads are started
+    for (int t=1; t<threadCount; t++){
+        if (pthread_create(&pool->threads[t].thread, NULL, runThreadPoolWorker, &pool->threads[t]) != 0) {
+            printf("Error creating thread pool worker! ABORT!\n");
+            exit(1);
+        }
+    }
+
+    return pool;
+}
+
+
+
+
+/**
+ * @brief Stops the worker threads of a thread pool and releases its memory
+ * @details All submitted tasks must have been waited for before.
+ * @param pool A pointer to the thread pool
+ */
+
+void deleteThreadPool(ThreadPool *pool){
+
+    if (pool==NULL) return;
+
+    pthread_mutex_lock(&pool->lock);
+    __atomic_store_n(&pool->stopped, true, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&pool->taskAdded);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int t=1; t<pool->threadCount; t++) pthread_join(pool->threads[t].thread, NULL);
+
+    for (int t=0; t<pool->threadCount; t++){
+        pthread_mutex_destroy(&pool->threads[t].deque.lock);
+        free(pool->threads[t].deque.tasks);
+    }
+
+    pthread_mutex_destroy(&pool->backgroundTasks.lock);
+    free(pool->backgroundTasks.tasks);
+
+    pthread_cond_destroy(&pool->taskAdded);
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool->threads);
+    free(pool);
+}
+
+
+
+
+/**
+ * @brief Returns the number of threads of a thread pool (1 if the pool is NULL)
+ * @param pool A pointer to the thread pool (or NULL)
+ */
+
+int getThreadCount(ThreadPool *pool){
+    return (pool==NULL) ? 1 : pool->threadCount;
+}
+
+
+
+
+/**
+ * @brief Submits a background task to the pool without waiting for it (e.g. to fill a loader batch)
+ * @details The task is counted in the group until it is finished. It is only executed by a worker thread that has
+ * no other task to do, never by a thread waiting for a group (e.g. inside a parallel loop). Without a (multithreaded)
+ * pool the task is executed right away.
+ * @param pool A pointer to the thread pool (NULL = serial execution)
+ * @param group A pointer to the group the task belongs to
+ * @param task The function executing the task
+ * @param context A pointer to the data of the task
+ * @param first The first iteration passed to the task
+ * @param last The iteration following the last iteration passed to the task
+ */
+
+void submitThreadPoolTask(ThreadPool *pool, TaskGroup *group, ParallelTask task, void *context, int first, int last){
+
+    // Single-threaded pools have no worker that could execute the task in the background
+    if (getThreadCount(pool)==1){
+        task(context, first, last, 0);
+        return;
+    }
+
+    __atomic_add_fetch(&group->pendingCount, 1, __ATOMIC_RELAXED);
+
+    ThreadPoolTask poolTask = {.task=task, .context=context, .first=first, .last=last, .group=group};
+
+    pushTaskDeque(&pool->backgroundTasks, &poolTask);
+
+    // @attention Must be sequentially consistent with the check of sleepingThreadCount (see wakeThreadPoolWorkers)
+    __atomic_add_fetch(&pool->queuedTaskCount, 1, __ATOMIC_SEQ_CST);
+
+    wakeThreadPoolWorkers(pool, 1);
+}
+
+
+
+
+/**
+ * @brief Waits until all tasks of a group are finished, executing tasks of the pool in the meantime
+ * @details Background tasks are left to the worker threads, i.e. a group of background tasks must not be waited for
+ * by a worker thread while all other worker threads are busy with tasks that wait for it.
+ * @param pool A pointer to the thread pool (or NULL)
+ * @param group A pointer to the group
+ */
+
+void waitForThreadPoolTasks(ThreadPool *pool, TaskGroup *group){
+
+    if (getThreadCount(pool)==1) return;
+
+    int threadId = getCurrentThreadId(pool);
+
+    long long idleStart = 0;
+
+    while (__atomic_load_n(&group->pendingCount, __ATOMIC_ACQUIRE)>0){
+
+        ThreadPoolTask task;
+
+        // @attention The found task may belong to another group, e.g. to the loop of an enclosing task (but it is never
+        // a background task, see findThreadPoolTask)
+        if (findThreadPoolTask(pool, threadId, &task)){
+            if (idleStart!=0) __atomic_add_fetch(&pool->threads[threadId].stats.idleTime, getThreadPoolTime() - idleStart, __ATOMIC_RELAXED);
+            idleStart = 0;
+            runThreadPoolTask(pool, threadId, &task);
+            continue;
+        }
+
+        // The group's remaining tasks are being executed by other threads
+        if (idleStart==0) idleStart = getThreadPoolTime();
+        sched_yield();
+    }
+
+    if (idleStart!=0) __atomic_add_fetch(&pool->threads[threadId].stats.idleTime, getThreadPoolTime() - idleStart, __ATOMIC_RELAXED);
+
+}
+
+
+
+
+/**
+ * @brief Executes the iterations 0...count-1 of a loop in parallel and returns once all of them are done
+ * @details The loop is split into THREAD_POOL_RANGES_PER_THREAD ranges per thread, but each range has at least
+ * grainSize iterations. Loops that would result in a single range are executed serially. The ranges are pushed onto
+ * the calling thread's deque, from which it takes them front to back while idle threads steal them back to front.
+ * @param pool A pointer to the thread pool (NULL = serial execution)
+ * @param count Number of iterations
+ * @param grainSize Minimum number of iterations per range (loops with no more iterations are executed serially)
+ * @param task The function executing a range of iterations
+ * @param context A pointer to the data shared by all iterations (passed to the task)
+ */
+
+void runParallelFor(ThreadPool *pool, int count, int grainSize, ParallelTask task, void *context){
+
+    if (count<=0) return;
+
+    int threadCount = getThreadCount(pool);
+    int threadId    = getCurrentThreadId(pool);
+
+    int rangeSize = (count + (threadCount * THREAD_POOL_RANGES_PER_THREAD) - 1) / (threadCount * THREAD_POOL_RANGES_PER_THREAD);
+    if (rangeSize < grainSize) rangeSize = grainSize;
+
+    // Serial fallback for single-threaded pools and tiny loops
+    if (threadCount==1 || rangeSize>=count){
+        task(context, 0, count, threadId);
+        return;
+    }
+
+    int rangeCount = (count + rangeSize - 1) / rangeSize;
+
+    TaskGroup group = {.pendingCount = rangeCount};
+
+    // Push the last range first, so that the first range ends up at the back of the deque
+    for (int r=rangeCount-1; r>=0; r--){
+
+        ThreadPoolTask range = {.task=task, .context=context, .first=r*rangeSize, .last=(r+1)*rangeSize, .group=&group};
+        if (range.last > count) range.last = count;
+
+        pushThreadPoolTask(pool, threadId, &range);
+    }
+
+    wakeThreadPoolWorkers(pool, rangeCount);
+
+    // The calling thread works on the loop as well
+    waitForThreadPoolTasks(pool, &group);
+
+}
+
+
+
+
+/**
+ * @brief Returns the sum of the counters (executed tasks, steals, idle time) of all threads of a pool
+ * @param pool A pointer to the thread pool (or NULL)
+ */
+
+ThreadPoolStats getThreadPoolStats(ThreadPool *pool){
+
+    ThreadPoolStats stats = {0};
+
+    if (pool==NULL) return stats;
+
+    for (int t=0; t<pool->threadCount; t++){
+        stats.taskCount  += __atomic_load_n(&pool->threads[t].stats.taskCount, __ATOMIC_RELAXED);
+        stats.stealCount += __atomic_load_n(&pool->threads[t].stats.stealCount, __ATOMIC_RELAXED);
+        stats.idleTime   += __atomic_load_n(&pool->threads[t].stats.idleTime, __ATOMIC_RELAXED);
+    }
+
+    return stats;
+}
+
+
+
+
+/**
+ * @brief Resets the counters of all threads of a pool
+ * @param pool A pointer to the thread pool (or NULL)
+ */
+
+void resetThreadPoolStats(ThreadPool *pool){
+
+    if (pool==NULL) return;
+
+    for (int t=0; t<pool->threadCount; t++){
+        __atomic_store_n(&pool->threads[t].stats.taskCount, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&pool->threads[t].stats.stealCount, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&pool->threads[t].stats.idleTime, 0, __ATOMIC_RELAXED);
+    }
+
+}
@@ -0,0 +1,262 @@
+/**
+ * @file threadpool.h
+ * @brief Work-stealing pool of worker threads that execute tasks, e.g. the ranges of a parallel loop (the columns of a
+ * layer, the shards of a mini-batch) or the filling of a loader batch
+ * @details Each thread of the pool owns a deque (double-ended queue) of tasks. A thread pushes the tasks it creates
+ * onto the back of its own deque and also takes its next task from there (newest first, i.e. the data it has just
+ * touched is still in the cache). A thread whose deque is empty steals the oldest task from the front of another
+ * thread's deque. This way, idle threads automatically take over the work of busy threads, no matter how unevenly
+ * sized the tasks are (e.g. a large convolutional layer followed by a small OUTPUT layer).
+ * A parallel loop splits its iterations 0...count-1 into ranges of at least grainSize iterations and pushes them as
+ * tasks. The calling thread then executes tasks until all ranges are done. Since waiting threads keep executing
+ * tasks, tasks may start parallel loops themselves (nested parallelism, e.g. the layers of a mini-batch shard).
+ * Loops with no more than grainSize iterations, and all loops of a pool with a single thread (or of a NULL pool),
+ * are executed serially by the calling thread without any synchronization.
+ * Background tasks (e.g. the filling of a loader batch) are kept in a separate queue, which only worker threads take
+ * from once there is no other task left. Threads waiting for a group never execute them, i.e. a background task
+ * can't delay the end of a loop.
+ * @attention Tasks must never block (e.g. wait for a lock held by another task), since a waiting thread may execute
+ * any other task of the pool. All threads that aren't workers of the pool share index 0, i.e. only one of them may
+ * run loops that use per-thread scratch buffers (threadId) at a time.
+ */
+
+#ifndef THREADPOOL_HEADER
+#define THREADPOOL_HEADER
+
+
+
+
+// Include external libraries
+#include <pthread.h>
+#include <stdbool.h>
+
+/// Define the number of ranges per thread that a loop is split into (more ranges = better load balancing)
+#define THREAD_POOL_RANGES_PER_THREAD 4
+
+/// Define the initial number of tasks that fit into a thread's deque (deques grow when needed)
+#define THREAD_POOL_DEQUE_CAPACITY 64
+
+/// Define the number of times an idle worker thread looks for a task before it goes to sleep
+#define THREAD_POOL_SPIN_COUNT 128
+
+
+
+
+typedef struct ThreadPool ThreadPool;
+typedef struct ThreadPoolTask ThreadPoolTask;
+typedef struct TaskDeque TaskDeque;
+typedef struct TaskGroup TaskGroup;
+typedef struct ThreadPoolStats ThreadPoolStats;
+typedef struct ThreadPoolThread ThreadPoolThread;
+
+
+
+
+/**
+ * @brief Function executing the iterations first...last-1 of a parallel loop
+ * @param context A pointer to the data shared by all iterations of the loop
+ * @param first The first iteration of the range
+ * @param last The iteration following the last iteration of the range
+ * @param threadId The index of the executing thread (0 = calling thread), e.g. to select a per-thread scratch buffer
+ */
+
+typedef void (*ParallelTask)(void *context, int first, int last, int threadId);
+
+
+
+
+/**
+ * @brief Data structure counting the tasks of a group that haven't been finished yet (e.g. the ranges of a loop)
+ */
+
+struct TaskGroup{
+    int pendingCount;               // number of submitted tasks that haven't been finished yet
+};
+
+
+
+
+/**
+ * @brief Data structure of a task, i.e. a range of iterations of a parallel loop
+ */
+
+struct ThreadPoolTask{
+    ParallelTask task;              // function executing the range
+    void *context;                  // data shared by all iterations of the loop
+    int first;                      // first iteration of the range
+    int last;                       // iteration following the last iteration of the range
+    TaskGroup *group;               // group that is notified once the task is finished
+};
+
+
+
+
+/**
+ * @brief Data structure of a deque of tasks (a ring buffer, the owner works at the back, thieves at the front)
+ */
+
+struct TaskDeque{
+    ThreadPoolTask *tasks;          // ring of tasks
+    int capacity;                   // number of tasks that fit into the ring
+    int first;                      // position of the front (=oldest) task in the ring
+    int count;                      // number of tasks in the deque
+    pthread_mutex_t lock;           // lock protecting the deque
+};
+
+
+
+
+/**
+ * @brief Data structure of the counters of a thread pool (see getThreadPoolStats)
+ */
+
+struct ThreadPoolStats{
+    long long taskCount;            // number of executed tasks
+    long long stealCount;           // number of tasks taken from another thread's deque
+    long long idleTime;             // time (in nanoseconds) that threads spent looking/waiting for tasks
+};
+
+
+
+
+/**
+ * @brief Data structure of a thread of a pool (index 0 = thread using the pool, 1...threadCount-1 = worker threads)
+ */
+
+struct ThreadPoolThread{
+    ThreadPool *pool;               // pool the thread belongs to
+    int threadId;                   // index of the thread
+    pthread_t thread;               // worker thread (not used for thread 0)
+    TaskDeque deque;                // tasks pushed by this thread
+    ThreadPoolStats stats;          // counters of this thread
+};
+
+
+
+
+/**
+ * @brief Data structure of a pool of worker threads executing tasks
+ */
+
+struct ThreadPool{
+    int threadCount;                // number of threads, including the thread calling runParallelFor()
+    ThreadPoolThread *threads;      // all threads of the pool (threadCount)
+    pthread_mutex_t lock;           // lock protecting the sleeping worker threads
+    pthread_cond_t taskAdded;       // signaled when a task is pushed while worker threads are sleeping
+    TaskDeque backgroundTasks;      // background tasks (only taken by idle worker threads, oldest first)
+    int queuedTaskCount;            // number of tasks in all deques (including the background tasks)
+    int sleepingThreadCount;        // number of worker threads waiting for taskAdded
+    bool stopped;                   // flag telling the worker threads to quit
+};
+
+
+
+
+/**
+ * @brief Returns the number of cores (logical processors) of this computer
+ */
+
+int getCoreCount(void);
+
+
+
+
+/**
+ * @brief Creates a thread pool and starts its worker threads
+ * @param threadCount Total number of threads (including the thread that calls runParallelFor)
+ */
+
+ThreadPool *createThreadPool(int threadCount);
+
+
+
+
+/**
+ * @brief Stops the worker threads of a thread pool and releases its memory
+ * @details All submitted tasks must have been waited for before.
+ * @param pool A pointer to the thread pool
+ */
+
+void deleteThreadPool(ThreadPool *pool);
+
+
+
+
+/**
+ * @brief Returns the number of threads of a thread pool (1 if the pool is NULL)
+ * @param pool A pointer to the thread pool (or NULL)
+ */
+
+int getThreadCount(ThreadPool *pool);
+
+
+
+
+/**
+ * @brief Submits a background task to the pool without waiting for it (e.g. to fill a loader batch)
+ * @details The task is counted in the group until it is finished. It is only executed by a worker thread that has
+ * no other task to do, never by a thread waiting for a group (e.g. inside a parallel loop). Without a (multithreaded)
+ * pool the task is executed right away.
+ * @param pool A pointer to the thread pool (NULL = serial execution)
+ * @param group A pointer to the group the task belongs to
+ * @param task The function executing the task
+ * @param context A pointer to the data of the task
+ * @param first The first iteration passed to the task
+ * @param last The iteration following the last iteration passed to the task
+ */
+
+void submitThreadPoolTask(ThreadPool *pool, TaskGroup *group, ParallelTask task, void *context, int first, int last);
+
+
+
+
+/**
+ * @brief Waits until all tasks of a group are finished, executing tasks of the pool in the meantime
+ * @details Background tasks are left to the worker threads, i.e. a group of background tasks must not be waited for
+ * by a worker thread while all other worker threads are busy with tasks that wait for it.
+ * @param pool A pointer to the thread pool (or NULL)
+ * @param group A pointer to the group
+ */
+
+void waitForThreadPoolTasks(ThreadPool *pool, TaskGroup *group);
+
+
+
+
+/**
+ * @brief Executes the iterations 0...count-1 of a loop in parallel and returns once all of them are done
+ * @details The task is called once per range. Ranges never overlap, so tasks may write to the iterations' data
+ * without locking, but must not write to data shared with other iterations (except via threadId).
+ * @param pool A pointer to the thread pool (NULL = serial execution)
+ * @param count Number of iterations
+ * @param grainSize Minimum number of iterations per range (loops with no more iterations are executed serially)
+ * @param task The function executing a range of iterations
+ * @param context A pointer to the data shared by all iterations (passed to the task)
+ */
+
+void runParallelFor(ThreadPool *pool, int count, int grainSize, ParallelTask task, void *context);
+
+
+
+
+/**
+ * @brief Returns the sum of the counters (executed tasks, steals, idle time) of all threads of a pool
+ * @param pool A pointer to the thread pool (or NULL)
+ */
+
+ThreadPoolStats getThreadPoolStats(ThreadPool *pool);
+
+
+
+
+/**
+ * @brief Resets the counters of all threads of a pool
+ * @param pool A pointer to the thread pool (or NULL)
+ */
+
+void resetThreadPoolStats(ThreadPool *pool);
+
+
+
+
+#endif
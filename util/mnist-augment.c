@@ -0,0 +1,207 @@
+/**
+ * @file mnist-augment.c
+ * @brief Random distortions (shift, rotation, scaling, elastic deformation) of MNIST images for data augmentation
+ */
+
+
+// Include external libraries
+#include <math.h>
+#include <string.h>
+
+// Include project libraries
+#include "mnist-utils.h"
+#include "mnist-augment.h"
+#include "../kernels.h"
+#include "../random.h"
+
+/// Define the maximum radius (in pixels) of the Gaussian filter smoothing the elastic displacement fields
+#define AUGMENT_MAX_FILTER_RADIUS 16
+
+
+
+
+/**
+ * @brief Returns an augmentation with typical distortion strengths for MNIST-sized images and all distortions disabled
+ * @param seed Seed of the random distortions
+ */
+
+MNIST_Augmentation getDefaultAugmentation(uint64_t seed){
+    
+    MNIST_Augmentation augmentation = {
+        .seed         = seed,
+        .epoch        = 0,
+        .useShift     = false,
+        .useRotation  = false,
+        .useScaling   = false,
+        .useElastic   = false,
+        .maxShift     = 2.0,
+        .maxRotation  = 15.0,
+        .maxScaling   = 0.1,
+        .elasticAlpha = 34.0,
+        .elasticSigma = 4.0
+    };
+    
+    return augmentation;
+}
+
+
+
+
+/**
+ * @brief Returns whether an augmentation applies any distortion at all
+ * @param augmentation A pointer to the augmentation (may be NULL)
+ */
+
+bool isAugmentationEnabled(const MNIST_Augmentation *augmentation){
+    
+    return (augmentation != NULL) &&
+           (augmentation->useShift || augmentation->useRotation || augmentation->useScaling || augmentation->useElastic);
+}
+
+
+
+
+/**
+ * @brief Returns the number of values of the scratch buffer required by augmentImage()
+ * @details The buffer holds the padded source image, the sampling coordinates (x and y) and the elastic
+ * displacement fields (x and y) plus a temporary field for filtering them.
+ * @param width Width of the images
+ * @param height Height of the images
+ */
+
+int getAugmentationScratchSize(int width, int height){
+    
+    return ((width+2) * (height+2)) + (5 * width * height);
+}
+
+
+
+
+/**
+ * @brief Smoothes a field of values (in place) with a separable Gaussian filter
+ * @details Values outside of the field are treated as 0.
+ * @param field A pointer to the field (width x height values)
+ * @param tmp A pointer to a temporary buffer (width x height values)
+ * @param width Width of the field
+ * @param height Height of the field
+ * @param sigma Standard deviation of the Gaussian filter in pixels
+ */
+
+void smoothField(Real *field, Real *tmp, int width, int height, double sigma){
+    
+    int radius = (int)ceil(3 * sigma);
+    if (radius > AUGMENT_MAX_FILTER_RADIUS) radius = AUGMENT_MAX_FILTER_RADIUS;
+    
+    Real filter[2*AUGMENT_MAX_FILTER_RADIUS+1];
+    Real filterSum = 0;
+    
+    for (int k=-radius; k<=radius; k++){
+        filter[k+radius] = (Real)exp(-(k*k) / (2 * sigma * sigma));
+        filterSum += filter[k+radius];
+    }
+    for (int k=0; k<=2*radius; k++) filter[k] /= filterSum;
+    
+    // Horizontal pass (field -> tmp), only summing up the filter taps that fall inside the row
+    for (int y=0; y<height; y++){
+        const Real *row = field + (y * width);
+        for (int x=0; x<width; x++){
+            int kFirst = (x-radius < 0)      ? -x          : -radius;
+            int kLast  = (x+radius >= width) ? width-1-x   :  radius;
+            Real sum = 0;
+            for (int k=kFirst; k<=kLast; k++) sum += filter[k+radius] * row[x+k];
+            tmp[(y * width) + x] = sum;
+        }
+    }
+    
+    // Vertical pass (tmp -> field), adding up whole rows at a time
+    for (int y=0; y<height; y++){
+        Real *row = field + (y * width);
+        int kFirst = (y-radius < 0)       ? -y           : -radius;
+        int kLast  = (y+radius >= height) ? height-1-y   :  radius;
+        memset(row, 0, width * sizeof(Real));
+        for (int k=kFirst; k<=kLast; k++) addScaledVector(row, tmp + ((y+k) * width), filter[k+radius], width);
+    }
+}
+
+
+
+
+/**
+ * @brief Randomly distorts a normalized image
+ * @details The source image is copied into the scratch buffer first, i.e. source and result may be the same array.
+ * Pixels moved in from outside of the image get the background (=normalized 0) value.
+ * @param augmentation A pointer to the augmentation defining the distortions
+ * @param sampleIndex Index of the image in loading order (determines its random distortions)
+ * @param src A pointer to the normalized values of the image (width x height values)
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param scratch A pointer to a scratch buffer of getAugmentationScratchSize() values
+ * @param result A pointer to the array receiving the distorted image (width x height values)
+ */
+
+void augmentImage(const MNIST_Augmentation *augmentation, int sampleIndex, const Real *src, int width, int height, Real *scratch, Real *result){
+    
+    int size   = width * height;
+    int stride = width + 2;
+    
+    Real *padded = scratch;
+    Real *xs     = padded + (stride * (height+2));
+    Real *ys     = xs + size;
+    Real *dx     = ys + size;
+    Real *dy     = dx + size;
+    Real *tmp    = dy + size;
+    
+    // Each image gets its own random number stream, defined by the seed, the epoch and the image's index
+    Random rng;
+    seedRandom(&rng, augmentation->seed, RANDOM_STREAM_AUGMENT, ((uint64_t)(uint32_t)augmentation->epoch << 32) | (uint32_t)sampleIndex);
+    
+    // Copy the image into the center of a frame holding the background value
+    uint8_t blackPixel = 0;
+    Real background;
+    normalizePixels(&blackPixel, 1, &background);
+    
+    for (int i=0; i<stride*(height+2); i++) padded[i] = background;
+    for (int y=0; y<height; y++) memcpy(padded + ((y+1) * stride) + 1, src + (y * width), width * sizeof(Real));
+    
+    // All parameters are drawn even if disabled, so that toggling one distortion does not change the others
+    double shiftX   = getRandomRange(&rng, -augmentation->maxShift, augmentation->maxShift);
+    double shiftY   = getRandomRange(&rng, -augmentation->maxShift, augmentation->maxShift);
+    double rotation = getRandomRange(&rng, -augmentation->maxRotation, augmentation->maxRotation) * M_PI / 180;
+    double scaling  = getRandomRange(&rng, 1-augmentation->maxScaling, 1+augmentation->maxScaling);
+    
+    if (!augmentation->useShift)    shiftX = shiftY = 0;
+    if (!augmentation->useRotation) rotation = 0;
+    if (!augmentation->useScaling)  scaling = 1;
+    
+    // Map each result pixel back to its (sub-pixel) source position: inverse rotation and scaling around the center
+    double cosA = cos(rotation) / scaling;
+    double sinA = sin(rotation) / scaling;
+    double centerX = (width-1)  / 2.0;
+    double centerY = (height-1) / 2.0;
+    
+    for (int y=0; y<height; y++){
+        for (int x=0; x<width; x++){
+            double u = x - centerX - shiftX;
+            double v = y - centerY - shiftY;
+            xs[(y * width) + x] = (Real)(( cosA * u) + (sinA * v) + centerX);
+            ys[(y * width) + x] = (Real)((-sinA * u) + (cosA * v) + centerY);
+        }
+    }
+    
+    // Elastic deformation: add a smoothed random displacement field
+    if (augmentation->useElastic){
+        
+        for (int i=0; i<size; i++){
+            dx[i] = (Real)getRandomRange(&rng, -1, 1);
+            dy[i] = (Real)getRandomRange(&rng, -1, 1);
+        }
+        
+        smoothField(dx, tmp, width, height, augmentation->elasticSigma);
+        smoothField(dy, tmp, width, height, augmentation->elasticSigma);
+        
+        addScaledVector(xs, dx, (Real)augmentation->elasticAlpha, size);
+        addScaledVector(ys, dy, (Real)augmentation->elasticAlpha, size);
+    }
+    
+    sampleBilinear(padded, width, height, xs, ys, size, result);
+}
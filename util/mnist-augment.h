@@ -0,0 +1,98 @@
+/**
+ * @file mnist-augment.h
+ * @brief Random distortions (shift, rotation, scaling, elastic deformation) of MNIST images for data augmentation
+ * @details Each image is distorted differently, but reproducibly: the random numbers of an image only depend on
+ * the seed, the epoch and the image's index in loading order (not on which loader thread processes it).
+ */
+
+#ifndef MNIST_AUGMENT_HEADER
+#define MNIST_AUGMENT_HEADER
+
+
+
+
+// Include external libraries
+#include <stdbool.h>
+
+// Include project libraries
+#include "mnist-utils.h"
+
+
+
+
+typedef struct MNIST_Augmentation MNIST_Augmentation;
+
+
+
+
+/**
+ * @brief Data structure defining which distortions are applied to the images, and how strong they are
+ */
+
+struct MNIST_Augmentation{
+    uint64_t seed;                  // seed of the random distortions
+    int epoch;                      // current epoch (each epoch gets different distortions)
+    bool useShift;                  // toggle for random shifts
+    bool useRotation;               // toggle for random rotations
+    bool useScaling;                // toggle for random scaling
+    bool useElastic;                // toggle for random elastic deformations
+    double maxShift;                // maximum shift in pixels (in x and y direction)
+    double maxRotation;             // maximum rotation in degrees (clockwise or counter-clockwise)
+    double maxScaling;              // maximum relative change of size (e.g. 0.1 = 90% to 110%)
+    double elasticAlpha;            // strength of the elastic deformation (scales the smoothed displacement field)
+    double elasticSigma;            // smoothness of the elastic deformation (std deviation of the Gaussian filter in pixels)
+};
+
+
+
+
+/**
+ * @brief Returns an augmentation with typical distortion strengths for MNIST-sized images and all distortions disabled
+ * @param seed Seed of the random distortions
+ */
+
+MNIST_Augmentation getDefaultAugmentation(uint64_t seed);
+
+
+
+
+/**
+ * @brief Returns whether an augmentation applies any distortion at all
+ * @param augmentation A pointer to the augmentation (may be NULL)
+ */
+
+bool isAugmentationEnabled(const MNIST_Augmentation *augmentation);
+
+
+
+
+/**
+ * @brief Returns the number of values of the scratch buffer required by augmentImage()
+ * @param width Width of the images
+ * @param height Height of the images
+ */
+
+int getAugmentationScratchSize(int width, int height);
+
+
+
+
+/**
+ * @brief Randomly distorts a normalized image
+ * @details The source image is copied into the scratch buffer first, i.e. source and result may be the same array.
+ * Pixels moved in from outside of the image get the background (=normalized 0) value.
+ * @param augmentation A pointer to the augmentation defining the distortions
+ * @param sampleIndex Index of the image in loading order (determines its random distortions)
+ * @param src A pointer to the normalized values of the image (width x height values)
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param scratch A pointer to a scratch buffer of getAugmentationScratchSize() values
+ * @param result A pointer to the array receiving the distorted image (width x height values)
+ */
+
+void augmentImage(const MNIST_Augmentation *augmentation, int sampleIndex, const Real *src, int width, int height, Real *scratch, Real *result);
+
+
+
+
+#endif
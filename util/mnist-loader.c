@@ -0,0 +1,467 @@
+/**
+ * @file mnist-loader.c
+ * @brief Background data loader that prefetches normalized MNIST batches while the network is computing
+ */
+
+
+// Include external libraries
+#include <stdlib.h>
+#include <string.h>
+
+// Include project libraries
+#include "mnist-utils.h"
+#include "mnist-loader.h"
+
+
+
+
+/**
+ * @brief Reads, normalizes, (optionally) distorts and stores the images and labels of a batch into the given buffer
+ * @param loader A pointer to the loader
+ * @param batch A pointer to the buffer that is to be filled
+ * @param batchNo Number of the batch (in loading order) that is to be loaded
+ */
+
+void fillMNISTBatch(MNIST_Loader *loader, MNIST_Batch *batch, int batchNo){
+    
+    batch->first = batchNo * loader->batchSize;
+    batch->count = loader->sampleCount - batch->first;
+    if (batch->count > loader->batchSize) batch->count = loader->batchSize;
+    
+    MNIST_Dataset *dataset = loader->dataset;
+    
+    // Streamed (gzip-compressed) data sets are decompressed batch by batch in loading order
+    if (isStreamedDataset(dataset)){
+        readDatasetStream(dataset, batch->count, batch->pixels, batch->labels);
+        for (int i=0; i<batch->count; i++)
+            normalizePixels(batch->pixels + (i * batch->imageSize), batch->imageSize, batch->inputs + (i * batch->imageSize));
+    }
+    else {
+        for (int i=0; i<batch->count; i++){
+            
+            int position = (loader->order==NULL) ? batch->first+i : loader->order[batch->first+i];
+            
+            Real *inputs = batch->inputs + (i * batch->imageSize);
+            
+            // Images from a cache file are already normalized
+            if (dataset->inputs != NULL) memcpy(inputs, getDatasetInputs(dataset, position), batch->imageSize * sizeof(Real));
+            else normalizePixels(getDatasetPixels(dataset, position), batch->imageSize, inputs);
+            batch->labels[i] = getDatasetLabel(dataset, position);
+        }
+    }
+    
+    // Distort the normalized images in place (depending only on their index in loading order, not on the thread)
+    if (loader->isAugmenting){
+        for (int i=0; i<batch->count; i++){
+            Real *inputs = batch->inputs + (i * batch->imageSize);
+            augmentImage(&loader->augmentation, batch->first+i, inputs, dataset->imgWidth, dataset->imgHeight, batch->augmentationScratch, inputs);
+        }
+    }
+}
+
+
+
+
+/**
+ * @brief Main function of a loader thread, filling one batch after another until all batches are loaded
+ * @details A loader thread only starts filling a batch once the batch previously held by the same buffer
+ * has been released by the consumer, i.e. it never gets more than loader->bufferCount batches ahead.
+ * @param arg A pointer to the loader
+ */
+
+void *runMNISTLoaderThread(void *arg){
+    
+    MNIST_Loader *loader = (MNIST_Loader*)arg;
+    
+    pthread_mutex_lock(&loader->lock);
+    
+    while (!loader->stopped && loader->nextBatchToFill < loader->batchCount){
+        
+        int batchNo = loader->nextBatchToFill++;
+        int bufferNo = batchNo % loader->bufferCount;
+        
+        // Wait until the consumer has released the buffer's previous batch (backpressure)
+        // @attention Batches may be released out of order (several consumers), so each buffer is checked individually
+        while (!loader->stopped && loader->releasedBatch[bufferNo] != batchNo - loader->bufferCount)
+            pthread_cond_wait(&loader->bufferFreed, &loader->lock);
+        
+        if (loader->stopped) break;
+        
+        // Fill the buffer without holding the lock so that other loader threads can work in parallel
+        pthread_mutex_unlock(&loader->lock);
+        fillMNISTBatch(loader, &loader->buffers[bufferNo], batchNo);
+        pthread_mutex_lock(&loader->lock);
+        
+        loader->bufferBatch[bufferNo] = batchNo;
+        pthread_cond_broadcast(&loader->bufferFilled);
+    }
+    
+    pthread_mutex_unlock(&loader->lock);
+    
+    return NULL;
+}
+
+
+
+
+/**
+ * @brief Claims a batch for filling and returns true, unless it has already been claimed by another thread or its
+ * buffer is still in use (pool loaders only)
+ * @details Lock-free: the claim is an atomic compare-and-swap of the buffer's claimedBatch, i.e. exactly one thread
+ * succeeds and fills the batch.
+ * @param loader A pointer to the loader
+ * @param batchNo Number of the batch (in loading order) that is to be loaded
+ */
+
+bool claimMNISTBatch(MNIST_Loader *loader, int batchNo){
+    
+    int bufferNo = batchNo % loader->bufferCount;
+    int previousBatchNo = batchNo - loader->bufferCount;
+    
+    // @attention The buffer must have been released by the consumer of its previous batch (acquires its reads)
+    if (__atomic_load_n(&loader->stopped, __ATOMIC_RELAXED) || __atomic_load_n(&loader->releasedBatch[bufferNo], __ATOMIC_ACQUIRE) != previousBatchNo) return false;
+    
+    return __atomic_compare_exchange_n(&loader->claimedBatch[bufferNo], &previousBatchNo, batchNo, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+
+
+
+/**
+ * @brief Fills the batches first...last-1 (background pool task), unless another thread has claimed them already
+ * @details The loader's lock is only taken to hand out a filled batch, i.e. the task never waits for a consumer.
+ * @param context A pointer to the loader
+ * @param first Number of the first batch
+ * @param last Number of the batch following the last batch
+ * @param threadId The index of the executing thread (unused)
+ */
+
+void runMNISTLoaderTask(void *context, int first, int last, int threadId){
+    
+    MNIST_Loader *loader = (MNIST_Loader*)context;
+    
+    for (int batchNo=first; batchNo<last; batchNo++){
+        
+        if (!claimMNISTBatch(loader, batchNo)) continue;
+        
+        int bufferNo = batchNo % loader->bufferCount;
+        
+        fillMNISTBatch(loader, &loader->buffers[bufferNo], batchNo);
+        
+        pthread_mutex_lock(&loader->lock);
+        loader->bufferBatch[bufferNo] = batchNo;
+        pthread_cond_broadcast(&loader->bufferFilled);
+        pthread_mutex_unlock(&loader->lock);
+    }
+    
+}
+
+
+
+
+/**
+ * @brief Submits the task filling a batch to the loader's thread pool (if the batch exists)
+ * @attention Must be called without holding the loader's lock (the task may be executed right away)
+ * @param loader A pointer to the loader
+ * @param batchNo Number of the batch (in loading order) that is to be loaded
+ */
+
+void submitMNISTLoaderTask(MNIST_Loader *loader, int batchNo){
+    
+    if (batchNo < loader->batchCount) submitThreadPoolTask(loader->threadPool, &loader->fillTasks, runMNISTLoaderTask, loader, batchNo, batchNo+1);
+    
+}
+
+
+
+
+/**
+ * @brief Returns a newly allocated array holding the sample positions 0 to count-1 in sequential order
+ * @details The array can be passed as loading order to createMNISTLoader() and be shuffled before each epoch.
+ * @param count Number of samples
+ */
+
+int *createSampleOrder(int count){
+    
+    int *order = (int*)malloc(count * sizeof(int));
+    
+    for (int i=0; i<count; i++) order[i] = i;
+    
+    return order;
+}
+
+
+
+
+/**
+ * @brief Randomly permutes a sample order (Fisher-Yates shuffle) so that each epoch visits the samples differently
+ * @param order A pointer to an array of sample positions
+ * @param count Number of samples in the array
+ * @param rng A pointer to the random number generator
+ */
+
+void shuffleSampleOrder(int *order, int count, Random *rng){
+    
+    for (int i=count-1; i>0; i--){
+        
+        // Pick a random position from 0 to i (inclusive)
+        int j = getRandomInt(rng, i+1);
+        
+        int tmp  = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+
+
+
+/**
+ * @brief Allocates a loader and its buffers (without starting to load any batches)
+ * @param dataset A pointer to the data set that the images and labels are read from
+ * @param order An array of sampleCount data set positions defining the loading order (NULL = sequential)
+ * @param augmentation A pointer to the distortions that are applied to the images (NULL = none)
+ * @param sampleCount Total number of images to be loaded
+ * @param batchSize Number of images per batch
+ * @param bufferCount Number of batch buffers in the ring
+ * @param threadCount Number of loader threads (0 = batches are filled by a thread pool)
+ */
+
+MNIST_Loader *allocMNISTLoader(MNIST_Dataset *dataset, const int *order, const MNIST_Augmentation *augmentation, int sampleCount, int batchSize, int bufferCount, int threadCount){
+    
+    MNIST_Loader *loader = (MNIST_Loader*)malloc(sizeof(MNIST_Loader));
+    
+    loader->dataset            = dataset;
+    loader->order              = order;
+    loader->isAugmenting       = isAugmentationEnabled(augmentation);
+    if (loader->isAugmenting) loader->augmentation = *augmentation;
+    loader->sampleCount        = sampleCount;
+    loader->batchSize          = batchSize;
+    loader->batchCount         = (sampleCount + batchSize - 1) / batchSize;
+    loader->bufferCount        = bufferCount;
+    loader->threadCount        = threadCount;
+    loader->threadPool         = NULL;
+    loader->fillTasks          = (TaskGroup){0};
+    loader->nextBatchToFill    = 0;
+    loader->nextBatchToRead    = 0;
+    loader->stopped            = 0;
+    
+    loader->bufferBatch   = (int*)malloc(bufferCount * sizeof(int));
+    loader->releasedBatch = (int*)malloc(bufferCount * sizeof(int));
+    loader->claimedBatch  = (int*)malloc(bufferCount * sizeof(int));
+    loader->buffers     = (MNIST_Batch*)malloc(bufferCount * sizeof(MNIST_Batch));
+    
+    for (int b=0; b<bufferCount; b++){
+        MNIST_Batch *batch = &loader->buffers[b];
+        batch->count     = 0;
+        batch->first     = 0;
+        batch->imageSize = dataset->imageSize;
+        batch->inputs    = (Real*)malloc(batchSize * batch->imageSize * sizeof(Real));
+        batch->labels    = (MNIST_Label*)malloc(batchSize * sizeof(MNIST_Label));
+        batch->pixels    = (uint8_t*)malloc(batchSize * batch->imageSize * sizeof(uint8_t));
+        batch->augmentationScratch = loader->isAugmenting ? (Real*)malloc(getAugmentationScratchSize(dataset->imgWidth, dataset->imgHeight) * sizeof(Real)) : NULL;
+        loader->bufferBatch[b]   = -1;
+        loader->releasedBatch[b] = b - bufferCount;     // as if the buffer's (non-existing) previous batch was released
+        loader->claimedBatch[b]  = b - bufferCount;
+    }
+    
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->bufferFreed, NULL);
+    pthread_cond_init(&loader->bufferFilled, NULL);
+    
+    loader->threads = (pthread_t*)malloc(threadCount * sizeof(pthread_t));
+    
+    return loader;
+}
+
+
+
+
+/**
+ * @brief Creates a loader and starts its threads which immediately begin prefetching batches
+ * @param dataset A pointer to the data set that the images and labels are read from
+ * @param order An array of sampleCount data set positions defining the loading order (NULL = sequential)
+ * @param augmentation A pointer to the distortions that are applied to the images (NULL = none)
+ * @param sampleCount Total number of images to be loaded
+ * @param batchSize Number of images per batch
+ * @param bufferCount Number of batch buffers in the ring
+ * @param threadCount Number of loader threads
+ */
+
+MNIST_Loader *createMNISTLoader(MNIST_Dataset *dataset, const int *order, const MNIST_Augmentation *augmentation, int sampleCount, int batchSize, int bufferCount, int threadCount){
+    
+    if (sampleCount > dataset->count || batchSize < 1 || bufferCount < 1 || threadCount < 1) {
+        printf("Invalid data loader configuration (%d images, batch size %d, %d buffers, %d threads). ABORT!\n", sampleCount, batchSize, bufferCount, threadCount);
+        exit(1);
+    }
+    
+    // Streams can only be read front to back, i.e. by a single loader thread in sequential order
+    if (isStreamedDataset(dataset)){
+        if (order != NULL) {
+            printf("Compressed data sets can only be loaded in sequential order. ABORT!\n");
+            exit(1);
+        }
+        threadCount = 1;
+        rewindDatasetStream(dataset);
+    }
+    
+    MNIST_Loader *loader = allocMNISTLoader(dataset, order, augmentation, sampleCount, batchSize, bufferCount, threadCount);
+    
+    for (int t=0; t<threadCount; t++){
+        if (pthread_create(&loader->threads[t], NULL, runMNISTLoaderThread, loader) != 0) {
+            printf("Could not start data loader thread. ABORT!\n");
+            exit(1);
+        }
+    }
+    
+    return loader;
+}
+
+
+
+
+/**
+ * @brief Creates a loader whose batches are filled by the tasks of a thread pool (instead of own loader threads)
+ * @details Whenever a buffer is free, a background task filling the buffer's next batch is submitted to the pool, i.e.
+ * the batches are prefetched by worker threads that have nothing else to do (threads waiting for the end of a layer
+ * never pick them up, see submitThreadPoolTask). If a batch has not been started by the time it is needed, the
+ * consumer fills it itself. Without a (multithreaded) pool, and for streamed data sets (which must be decompressed in
+ * order), the loader falls back to its own loader thread.
+ * @param dataset A pointer to the data set that the images and labels are read from
+ * @param order An array of sampleCount data set positions defining the loading order (NULL = sequential)
+ * @param augmentation A pointer to the distortions that are applied to the images (NULL = none)
+ * @param sampleCount Total number of images to be loaded
+ * @param batchSize Number of images per batch
+ * @param bufferCount Number of batch buffers in the ring
+ * @param pool A pointer to the thread pool (or NULL)
+ */
+
+MNIST_Loader *createMNISTPoolLoader(MNIST_Dataset *dataset, const int *order, const MNIST_Augmentation *augmentation, int sampleCount, int batchSize, int bufferCount, ThreadPool *pool){
+    
+    if (getThreadCount(pool)==1 || isStreamedDataset(dataset)) return createMNISTLoader(dataset, order, augmentation, sampleCount, batchSize, bufferCount, MNIST_LOADER_THREAD_COUNT);
+    
+    if (sampleCount > dataset->count || batchSize < 1 || bufferCount < 1) {
+        printf("Invalid data loader configuration (%d images, batch size %d, %d buffers). ABORT!\n", sampleCount, batchSize, bufferCount);
+        exit(1);
+    }
+    
+    MNIST_Loader *loader = allocMNISTLoader(dataset, order, augmentation, sampleCount, batchSize, bufferCount, 0);
+    
+    loader->threadPool = pool;
+    
+    // Start prefetching one batch per buffer
+    for (int b=0; b<bufferCount; b++) submitMNISTLoaderTask(loader, b);
+    
+    return loader;
+}
+
+
+
+
+/**
+ * @brief Stops the loader threads and frees the loader and all of its buffers
+ * @param loader A pointer to the loader
+ */
+
+void deleteMNISTLoader(MNIST_Loader *loader){
+    
+    // Wake up any loader thread that is waiting for a free buffer
+    pthread_mutex_lock(&loader->lock);
+    __atomic_store_n(&loader->stopped, 1, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&loader->bufferFreed);
+    pthread_mutex_unlock(&loader->lock);
+    
+    for (int t=0; t<loader->threadCount; t++) pthread_join(loader->threads[t], NULL);
+    
+    // Fill tasks that are still queued in the pool return right away (since the loader is stopped)
+    // @attention They are executed by the pool's worker threads, which are idle once the consumers are done
+    waitForThreadPoolTasks(loader->threadPool, &loader->fillTasks);
+    
+    pthread_cond_destroy(&loader->bufferFilled);
+    pthread_cond_destroy(&loader->bufferFreed);
+    pthread_mutex_destroy(&loader->lock);
+    
+    for (int b=0; b<loader->bufferCount; b++){
+        free(loader->buffers[b].inputs);
+        free(loader->buffers[b].labels);
+        free(loader->buffers[b].pixels);
+        free(loader->buffers[b].augmentationScratch);
+    }
+    
+    free(loader->threads);
+    free(loader->buffers);
+    free(loader->claimedBatch);
+    free(loader->releasedBatch);
+    free(loader->bufferBatch);
+    free(loader);
+}
+
+
+
+
+/**
+ * @brief Returns the next batch (in loading order), waiting for a loader thread to fill it if necessary
+ * @details Returns NULL once all batches have been handed out. Each batch must be given back via
+ * releaseMNISTBatch() so that its buffer can be re-filled.
+ * @param loader A pointer to the loader
+ */
+
+MNIST_Batch *getNextMNISTBatch(MNIST_Loader *loader){
+    
+    pthread_mutex_lock(&loader->lock);
+    
+    if (loader->nextBatchToRead >= loader->batchCount) {
+        pthread_mutex_unlock(&loader->lock);
+        return NULL;
+    }
+    
+    int batchNo = loader->nextBatchToRead++;
+    int bufferNo = batchNo % loader->bufferCount;
+    
+    while (loader->bufferBatch[bufferNo] != batchNo){
+        
+        // Rather than waiting for a pool thread to start filling the batch, the consumer fills it itself
+        if (loader->threadPool!=NULL && claimMNISTBatch(loader, batchNo)){
+            pthread_mutex_unlock(&loader->lock);
+            fillMNISTBatch(loader, &loader->buffers[bufferNo], batchNo);
+            pthread_mutex_lock(&loader->lock);
+            loader->bufferBatch[bufferNo] = batchNo;
+        }
+        else pthread_cond_wait(&loader->bufferFilled, &loader->lock);
+    }
+    
+    pthread_mutex_unlock(&loader->lock);
+    
+    return &loader->buffers[bufferNo];
+}
+
+
+
+
+/**
+ * @brief Gives a batch's buffer back to the loader so that it can be re-filled with a following batch
+ * @details Batches can be released in any order, e.g. by several consumer threads.
+ * @param loader A pointer to the loader
+ * @param batch A pointer to the batch that has been processed
+ */
+
+void releaseMNISTBatch(MNIST_Loader *loader, MNIST_Batch *batch){
+    
+    pthread_mutex_lock(&loader->lock);
+    
+    int bufferNo = (int)(batch - loader->buffers);
+    
+    int batchNo = loader->bufferBatch[bufferNo];
+    
+    // @attention Releases the consumer's reads of the buffer to the thread claiming its next batch (see claimMNISTBatch)
+    __atomic_store_n(&loader->releasedBatch[bufferNo], batchNo, __ATOMIC_RELEASE);
+    loader->bufferBatch[bufferNo] = -1;
+    pthread_cond_broadcast(&loader->bufferFreed);
+    
+    // Consumers waiting for the buffer's next batch may fill it themselves now (pool loaders only)
+    if (loader->threadPool!=NULL) pthread_cond_broadcast(&loader->bufferFilled);
+    
+    pthread_mutex_unlock(&loader->lock);
+    
+    if (loader->threadPool!=NULL) submitMNISTLoaderTask(loader, batchNo + loader->bufferCount);
+}
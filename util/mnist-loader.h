@@ -0,0 +1,190 @@
+/**
+ * @file mnist-loader.h
+ * @brief Background data loader that prefetches normalized MNIST batches while the network is computing
+ * @details One or more loader threads (or the threads of a thread pool shared with the network) read images and
+ * labels from a (memory-mapped) data set, normalize them, optionally distort them (data augmentation) and write them
+ * into a ring of batch buffers. The training/testing loop consumes the batches in order.
+ * Since the ring has a fixed number of buffers, the loader threads block once all buffers are filled
+ * (backpressure) and continue as soon as the consumer releases a batch. Batches can also be consumed by several
+ * threads at the same time (e.g. parallel training workers), each of them taking the next batch in loading order.
+ */
+
+#ifndef MNIST_LOADER_HEADER
+#define MNIST_LOADER_HEADER
+
+
+
+
+// Include external libraries
+#include <pthread.h>
+
+// Include project libraries
+#include "mnist-utils.h"
+#include "mnist-augment.h"
+#include "../random.h"
+#include "../threadpool.h"
+
+/// Define default number of images per loader batch
+#define MNIST_LOADER_BATCH_SIZE 64
+
+/// Define default number of batch buffers in the loader's ring (=maximum number of batches prefetched ahead)
+#define MNIST_LOADER_BUFFER_COUNT 4
+
+/// Define default number of loader threads
+#define MNIST_LOADER_THREAD_COUNT 1
+
+
+
+
+typedef struct MNIST_Batch MNIST_Batch;
+typedef struct MNIST_Loader MNIST_Loader;
+
+
+
+
+/**
+ * @brief Data structure holding a batch of normalized images and their labels
+ */
+
+struct MNIST_Batch{
+    int count;                      // number of images in this batch
+    int first;                      // index (in loading order) of the batch's first image
+    int imageSize;                  // number of values per image (=dataset->imageSize)
+    Real *inputs;                   // normalized pixels of all images (count x imageSize values)
+    MNIST_Label *labels;            // labels of all images (count values)
+    uint8_t *pixels;                // raw pixels of all images, e.g. as decompressed from a stream (count x imageSize values)
+    Real *augmentationScratch;      // scratch buffer used for distorting the images (or NULL if not augmenting)
+};
+
+
+
+
+/**
+ * @brief Data structure of a background loader prefetching batches from a data set into a ring of buffers
+ */
+
+struct MNIST_Loader{
+    MNIST_Dataset *dataset;         // data set that the images and labels are read from
+    const int *order;               // positions of the images in loading order (NULL = sequential)
+    MNIST_Augmentation augmentation;// distortions applied to the images (copied from the caller)
+    bool isAugmenting;              // flag whether any distortion is enabled
+    int sampleCount;                // total number of images to be loaded
+    int batchSize;                  // (maximum) number of images per batch
+    int batchCount;                 // total number of batches to be loaded
+    int bufferCount;                // number of batch buffers in the ring
+    int threadCount;                // number of loader threads (0 = batches are filled by the thread pool)
+    ThreadPool *threadPool;         // pool whose threads fill the batches (NULL = own loader threads)
+    TaskGroup fillTasks;            // fill tasks submitted to the pool that haven't been finished yet
+    int *claimedBatch;              // number of the batch last claimed for filling in each buffer (pool only, atomic)
+    int nextBatchToFill;            // number of the next batch that a loader thread will fill
+    int nextBatchToRead;            // number of the next batch that will be handed to the consumer
+    int stopped;                    // flag telling the loader threads to quit
+    int *bufferBatch;               // number of the (completely filled) batch held by each buffer (-1 = none)
+    int *releasedBatch;             // number of the batch last released from each buffer by a consumer
+    MNIST_Batch *buffers;           // ring of batch buffers
+    pthread_t *threads;             // loader threads
+    pthread_mutex_t lock;           // protects all counters and the bufferBatch array
+    pthread_cond_t bufferFreed;     // signaled when the consumer releases a batch
+    pthread_cond_t bufferFilled;    // signaled when a loader thread has filled a batch
+};
+
+
+
+
+/**
+ * @brief Returns a newly allocated array holding the sample positions 0 to count-1 in sequential order
+ * @details The array can be passed as loading order to createMNISTLoader() and be shuffled before each epoch.
+ * @param count Number of samples
+ */
+
+int *createSampleOrder(int count);
+
+
+
+
+/**
+ * @brief Randomly permutes a sample order (Fisher-Yates shuffle) so that each epoch visits the samples differently
+ * @param order A pointer to an array of sample positions
+ * @param count Number of samples in the array
+ * @param rng A pointer to the random number generator
+ */
+
+void shuffleSampleOrder(int *order, int count, Random *rng);
+
+
+
+
+/**
+ * @brief Creates a loader and starts its threads which immediately begin prefetching batches
+ * @param dataset A pointer to the data set that the images and labels are read from
+ * @param order An array of sampleCount data set positions defining the loading order (NULL = sequential)
+ * @param augmentation A pointer to the distortions that are applied to the images (NULL = none)
+ * @param sampleCount Total number of images to be loaded
+ * @param batchSize Number of images per batch
+ * @param bufferCount Number of batch buffers in the ring
+ * @param threadCount Number of loader threads
+ * @attention Streamed (gzip-compressed) data sets are rewound and decompressed by a single loader thread in
+ * sequential order (order must be NULL).
+ */
+
+MNIST_Loader *createMNISTLoader(MNIST_Dataset *dataset, const int *order, const MNIST_Augmentation *augmentation, int sampleCount, int batchSize, int bufferCount, int threadCount);
+
+
+
+
+/**
+ * @brief Creates a loader whose batches are filled by the tasks of a thread pool (instead of own loader threads)
+ * @details Whenever a buffer is free, a background task filling the buffer's next batch is submitted to the pool, i.e.
+ * the batches are prefetched by worker threads that have nothing else to do (threads waiting for the end of a layer
+ * never pick them up, see submitThreadPoolTask). If a batch has not been started by the time it is needed, the
+ * consumer fills it itself. Without a (multithreaded) pool, and for streamed data sets (which must be decompressed in
+ * order), the loader falls back to its own loader thread.
+ * @param dataset A pointer to the data set that the images and labels are read from
+ * @param order An array of sampleCount data set positions defining the loading order (NULL = sequential)
+ * @param augmentation A pointer to the distortions that are applied to the images (NULL = none)
+ * @param sampleCount Total number of images to be loaded
+ * @param batchSize Number of images per batch
+ * @param bufferCount Number of batch buffers in the ring
+ * @param pool A pointer to the thread pool (or NULL)
+ */
+
+MNIST_Loader *createMNISTPoolLoader(MNIST_Dataset *dataset, const int *order, const MNIST_Augmentation *augmentation, int sampleCount, int batchSize, int bufferCount, ThreadPool *pool);
+
+
+
+
+/**
+ * @brief Stops the loader threads and frees the loader and all of its buffers
+ * @param loader A pointer to the loader
+ */
+
+void deleteMNISTLoader(MNIST_Loader *loader);
+
+
+
+
+/**
+ * @brief Returns the next batch (in loading order), waiting for a loader thread to fill it if necessary
+ * @details Returns NULL once all batches have been handed out. Each batch must be given back via
+ * releaseMNISTBatch() so that its buffer can be re-filled.
+ * @param loader A pointer to the loader
+ */
+
+MNIST_Batch *getNextMNISTBatch(MNIST_Loader *loader);
+
+
+
+
+/**
+ * @brief Gives a batch's buffer back to the loader so that it can be re-filled with a following batch
+ * @details Batches can be released in any order, e.g. by several consumer threads.
+ * @param loader A pointer to the loader
+ * @param batch A pointer to the batch that has been processed
+ */
+
+void releaseMNISTBatch(MNIST_Loader *loader, MNIST_Batch *batch);
+
+
+
+
+#endif
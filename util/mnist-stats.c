@@ -8,6 +8,7 @@
 
 // Include external libraries
 #include <string.h>
+#include <time.h>
 
 // Include project libraries
 #include "screen.h"
@@ -82,16 +83,17 @@ void displayImage(MNIST_Image *img, int lbl, int cls, int row, int col){
 /**
  * @brief Outputs progress to the console while processing MNIST training images
  * @param imgCount Number of images already read from the MNIST file
+ * @param imgTotal Total number of images in the training set
  * @param errCount Number of errors (images incorrectly classified)
  */
 
-void displayTrainingProgress(int imgCount, int errCount){
+void displayTrainingProgress(int imgCount, int imgTotal, int errCount){
     
-    double progress = (double)(imgCount+1)/(double)(MNIST_MAX_TRAINING_IMAGES)*100;
+    double progress = (double)(imgCount+1)/(double)(imgTotal)*100;
     
     moveCursorTo(0);
     
-    printf("Training: Reading image No. %'6d of %'6d images [%3d%%]  ",(imgCount+1),MNIST_MAX_TRAINING_IMAGES,(int)progress);
+    printf("Training: Reading image No. %'6d of %'6d images [%3d%%]  ",(imgCount+1),imgTotal,(int)progress);
     
     double accuracy = 1 - ((double)errCount/(double)(imgCount+1));
     
@@ -105,16 +107,17 @@ void displayTrainingProgress(int imgCount, int errCount){
 /**
  * @brief Outputs progress to the console while processing MNIST testing images
  * @param imgCount Number of images already read from the MNIST file
+ * @param imgTotal Total number of images in the testing set
  * @param errCount Number of errors (images incorrectly classified)
  */
 
-void displayTestingProgress(int imgCount, int errCount){
+void displayTestingProgress(int imgCount, int imgTotal, int errCount){
     
-    double progress = (double)(imgCount+1)/(double)(MNIST_MAX_TESTING_IMAGES)*100;
+    double progress = (double)(imgCount+1)/(double)(imgTotal)*100;
     
     moveCursorTo(0);
     
-    printf("Testing:  Reading image No. %'6d of %'6d images [%3d%%]  ",(imgCount+1),MNIST_MAX_TESTING_IMAGES,(int)progress);
+    printf("Testing:  Reading image No. %'6d of %'6d images [%3d%%]  ",(imgCount+1),imgTotal,(int)progress);
     
     double accuracy = 1 - ((double)errCount/(double)(imgCount+1));
     
@@ -124,3 +127,36 @@ void displayTestingProgress(int imgCount, int errCount){
 
 
 
+
+/**
+ * @brief Outputs the result of a training epoch (accuracy and processing time) on a new line
+ * @param epoch Number of the epoch (0 = first epoch)
+ * @param epochCount Total number of training epochs
+ * @param imgCount Number of images processed during the epoch
+ * @param errCount Number of errors (images incorrectly classified) during the epoch
+ * @param duration Processing time of the epoch in seconds
+ */
+
+void displayEpochResult(int epoch, int epochCount, int imgCount, int errCount, double duration){
+    
+    double accuracy = 1 - ((double)errCount/(double)imgCount);
+    
+    printf("\nEpoch %2d of %2d: Accuracy=%5.2f%%  Time=%6.2f sec (%'.0f images/sec)\n",epoch+1, epochCount, accuracy*100, duration, imgCount/duration);
+    
+}
+
+
+
+
+/**
+ * @brief Returns the current time in seconds (with sub-second precision) of a monotonic clock
+ * @details Only the difference between two calls is meaningful, e.g. to measure the duration of a processing step
+ */
+
+double getWallClockTime(void){
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
@@ -41,10 +41,11 @@ void displayImage(MNIST_Image *img, int lbl, int cls, int row, int col);
 /**
  * @brief Outputs progress to the console while processing MNIST training images
  * @param imgCount Number of images already read from the MNIST file
+ * @param imgTotal Total number of images in the training set
  * @param errCount Number of errors (images incorrectly classified)
  */
 
-void displayTrainingProgress(int imgCount, int errCount);
+void displayTrainingProgress(int imgCount, int imgTotal, int errCount);
 
 
 
@@ -52,10 +53,35 @@ void displayTrainingProgress(int imgCount, int errCount);
 /**
  * @brief Outputs progress to the console while processing MNIST testing images
  * @param imgCount Number of images already read from the MNIST file
+ * @param imgTotal Total number of images in the testing set
  * @param errCount Number of errors (images incorrectly classified)
  */
 
-void displayTestingProgress(int imgCount, int errCount);
+void displayTestingProgress(int imgCount, int imgTotal, int errCount);
+
+
+
+
+/**
+ * @brief Outputs the result of a training epoch (accuracy and processing time) on a new line
+ * @param epoch Number of the epoch (0 = first epoch)
+ * @param epochCount Total number of training epochs
+ * @param imgCount Number of images processed during the epoch
+ * @param errCount Number of errors (images incorrectly classified) during the epoch
+ * @param duration Processing time of the epoch in seconds
+ */
+
+void displayEpochResult(int epoch, int epochCount, int imgCount, int errCount, double duration);
+
+
+
+
+/**
+ * @brief Returns the current time in seconds (with sub-second precision) of a monotonic clock
+ * @details Only the difference between two calls is meaningful, e.g. to measure the duration of a processing step
+ */
+
+double getWallClockTime(void);
 
 
 
@@ -9,6 +9,10 @@
 // Include external libraries
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // Include project libraries
 #include "mnist-utils.h"
@@ -216,22 +220,633 @@ MNIST_Label getLabelByPosition(FILE *labelFile, int position){
 
 
 
+/**
+ * @brief Maps a whole file read-only into memory and returns a pointer to its first byte
+ * @param fileName The name of the file that is to be mapped
+ * @param fileSize A pointer to a variable that receives the byte size of the file
+ */
+
+void *mapFile(char *fileName, size_t *fileSize){
+    
+    int fd = open(fileName, O_RDONLY);
+    if (fd == -1) {
+        printf("Abort! Could not find MNIST file: %s\n",fileName);
+        exit(1);
+    }
+    
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1 || fileStat.st_size == 0) {
+        printf("Abort! Could not read MNIST file: %s\n",fileName);
+        exit(1);
+    }
+    
+    *fileSize = fileStat.st_size;
+    
+    void *map = mmap(NULL, *fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        printf("Abort! Could not map MNIST file into memory: %s\n",fileName);
+        exit(1);
+    }
+    
+    // The mapping remains valid after the file descriptor is closed
+    close(fd);
+    
+    return map;
+}
+
+
+
+
+/**
+ * @brief Returns a 32bit number (in MNIST=big-endian byte order) from the header of a mapped file
+ * @param map A pointer to the start of the mapped file
+ * @param index The index of the number inside the header (0=magic number, 1=count, ...)
+ */
+
+uint32_t getMappedHeaderValue(void *map, int index){
+    
+    uint32_t value;
+    memcpy(&value, (uint8_t*)map + (index * sizeof(uint32_t)), sizeof(value));
+    
+    return flipBytes(value);
+}
+
+
+
+
+/**
+ * @brief Validates the magic number of an IDX file and returns its number of dimensions
+ * @details The magic number consists of 2 zero bytes, the data type and the number of dimensions. Aborts if
+ * the file is not an unsigned byte IDX file with the expected number of dimensions.
+ * @param magicNumber The magic number (first 4 bytes of the file, in machine byte order)
+ * @param minDimCount Minimum number of dimensions expected
+ * @param maxDimCount Maximum number of dimensions expected
+ * @param fileName The name of the file (for error messages)
+ */
+
+int getIDXDimensionCount(uint32_t magicNumber, int minDimCount, int maxDimCount, char *fileName){
+    
+    int dataType = (magicNumber >> 8) & 0xff;
+    int dimCount = magicNumber & 0xff;
+    
+    if ((magicNumber >> 16) != 0 || dataType != IDX_UNSIGNED_BYTE_TYPE || dimCount < minDimCount || dimCount > maxDimCount) {
+        printf("Abort! Invalid IDX file header (magic number 0x%08x): %s\n",magicNumber, fileName);
+        exit(1);
+    }
+    
+    return dimCount;
+}
+
+
+
+
+/**
+ * @brief Reads and validates the header of a mapped IDX file and returns a pointer to its first data byte
+ * @details An IDX header consists of a magic number followed by the size of each dimension. Aborts if the
+ * header is invalid or if the file is shorter than stated in its header.
+ * @param map A pointer to the start of the mapped file
+ * @param mapSize Byte size of the mapped file
+ * @param minDimCount Minimum number of dimensions expected
+ * @param maxDimCount Maximum number of dimensions expected
+ * @param dims A pointer to an array of IDX_MAX_DIMENSIONS values that receives the size of each dimension
+ * @param dimCount A pointer to a variable that receives the number of dimensions
+ * @param fileName The name of the file (for error messages)
+ */
+
+const uint8_t *readIDXHeader(void *map, size_t mapSize, int minDimCount, int maxDimCount, uint32_t *dims, int *dimCount, char *fileName){
+    
+    uint32_t magicNumber = (mapSize >= sizeof(uint32_t)) ? getMappedHeaderValue(map, 0) : 0;
+    
+    *dimCount = getIDXDimensionCount(magicNumber, minDimCount, maxDimCount, fileName);
+    
+    size_t headerSize = (1 + *dimCount) * sizeof(uint32_t);
+    
+    if (mapSize < headerSize) {
+        printf("Abort! IDX file header is incomplete: %s\n",fileName);
+        exit(1);
+    }
+    
+    size_t dataSize = 1;
+    
+    for (int d=0; d<*dimCount; d++){
+        dims[d] = getMappedHeaderValue(map, 1+d);
+        dataSize *= dims[d];
+    }
+    
+    if (mapSize < headerSize + dataSize) {
+        printf("Abort! IDX file is truncated: %s\n",fileName);
+        exit(1);
+    }
+    
+    return (const uint8_t*)map + headerSize;
+}
+
+
+
+
+/**
+ * @brief Reads and validates the header of a (gzip-compressed) IDX file stream and returns its number of dimensions
+ * @param file The file stream, positioned at the start of the file
+ * @param minDimCount Minimum number of dimensions expected
+ * @param maxDimCount Maximum number of dimensions expected
+ * @param dims A pointer to an array of IDX_MAX_DIMENSIONS values that receives the size of each dimension
+ * @param fileName The name of the file (for error messages)
+ */
+
+int readIDXStreamHeader(gzFile file, int minDimCount, int maxDimCount, uint32_t *dims, char *fileName){
+    
+    uint32_t header[1 + IDX_MAX_DIMENSIONS];
+    
+    if (gzread(file, header, sizeof(uint32_t)) != sizeof(uint32_t)) {
+        printf("Abort! IDX file header is incomplete: %s\n",fileName);
+        exit(1);
+    }
+    
+    int dimCount = getIDXDimensionCount(flipBytes(header[0]), minDimCount, maxDimCount, fileName);
+    
+    if (gzread(file, header+1, dimCount * sizeof(uint32_t)) != (int)(dimCount * sizeof(uint32_t))) {
+        printf("Abort! IDX file header is incomplete: %s\n",fileName);
+        exit(1);
+    }
+    
+    for (int d=0; d<dimCount; d++) dims[d] = flipBytes(header[1+d]);
+    
+    return dimCount;
+}
+
+
+
+
+/**
+ * @brief Sets the number of images and the image size of a data set from the dimensions of its IDX files
+ * @details Images are stored as count x [height x] width pixels (2 or 3 dimensions), labels as count bytes.
+ * @param dataset A pointer to the data set
+ * @param imageDims The dimensions of the image file
+ * @param imageDimCount The number of dimensions of the image file
+ * @param labelDims The dimensions of the label file
+ * @param imageFileName The name of the image file (for error messages)
+ * @param labelFileName The name of the label file (for error messages)
+ */
+
+void setDatasetDimensions(MNIST_Dataset *dataset, uint32_t *imageDims, int imageDimCount, uint32_t *labelDims, char *imageFileName, char *labelFileName){
+    
+    if (imageDims[0] != labelDims[0]) {
+        printf("Abort! Number of images and labels do not match: %s %s\n",imageFileName, labelFileName);
+        exit(1);
+    }
+    
+    uint32_t imgHeight = (imageDimCount == 3) ? imageDims[1] : 1;
+    uint32_t imgWidth  = imageDims[imageDimCount-1];
+    
+    if (imageDims[0] > INT32_MAX || (uint64_t)imgWidth * imgHeight > INT32_MAX) {
+        printf("Abort! Too many or too large images: %s\n",imageFileName);
+        exit(1);
+    }
+    
+    dataset->count     = imageDims[0];
+    dataset->imgHeight = imgHeight;
+    dataset->imgWidth  = imgWidth;
+    dataset->imageSize = imgWidth * imgHeight;
+}
+
+
+
+
+/**
+ * @brief Opens a pair of gzip-compressed IDX image and label files as a sequentially readable data set
+ * @details The files are decompressed incrementally while they are read (see readDatasetStream()),
+ * i.e. an uncompressed copy never needs to exist on disk or in memory.
+ * @param imageFileName The name of the gzip-compressed image file
+ * @param labelFileName The name of the (gzip-compressed) label file
+ */
+
+MNIST_Dataset *openMNISTStream(char *imageFileName, char *labelFileName){
+    
+    MNIST_Dataset *dataset = (MNIST_Dataset*)malloc(sizeof(MNIST_Dataset));
+    
+    dataset->imageStream = gzopen(imageFileName, "rb");
+    dataset->labelStream = gzopen(labelFileName, "rb");
+    
+    if (dataset->imageStream == NULL || dataset->labelStream == NULL) {
+        printf("Abort! Could not find MNIST file: %s %s\n",imageFileName, labelFileName);
+        exit(1);
+    }
+    
+    // Decompress in larger chunks than zlib's default (8 KB) to reduce the number of file reads
+    gzbuffer(dataset->imageStream, MNIST_STREAM_BUFFER_SIZE);
+    gzbuffer(dataset->labelStream, MNIST_STREAM_BUFFER_SIZE);
+    
+    uint32_t imageDims[IDX_MAX_DIMENSIONS];
+    uint32_t labelDims[IDX_MAX_DIMENSIONS];
+    
+    int imageDimCount = readIDXStreamHeader(dataset->imageStream, 2, 3, imageDims, imageFileName);
+    readIDXStreamHeader(dataset->labelStream, 1, 1, labelDims, labelFileName);
+    
+    setDatasetDimensions(dataset, imageDims, imageDimCount, labelDims, imageFileName, labelFileName);
+    
+    // Remember where the data starts so that the streams can be rewound for each pass over the data set
+    dataset->imageStreamStart = gztell(dataset->imageStream);
+    dataset->labelStreamStart = gztell(dataset->labelStream);
+    
+    dataset->pixels   = NULL;
+    dataset->labels   = NULL;
+    dataset->inputs   = NULL;
+    dataset->order    = NULL;
+    dataset->imageMap = NULL;
+    dataset->labelMap = NULL;
+    
+    return dataset;
+}
+
+
+
+
+/**
+ * @brief Opens a pair of IDX image and label files (e.g. the MNIST files) as a memory-mapped data set
+ * @details Reads the number of images and their size from the file headers and aborts if the files are
+ * missing, truncated, not unsigned byte IDX files or do not match each other. Files ending in ".gz" are
+ * opened as gzip-compressed streams instead (see openMNISTStream()).
+ * @param imageFileName The name of the MNIST image file
+ * @param labelFileName The name of the MNIST label file
+ */
+
+MNIST_Dataset *openMNISTDataset(char *imageFileName, char *labelFileName){
+    
+    size_t nameLength = strlen(imageFileName);
+    
+    if (nameLength > 3 && strcmp(imageFileName + nameLength - 3, ".gz") == 0) return openMNISTStream(imageFileName, labelFileName);
+    
+    MNIST_Dataset *dataset = (MNIST_Dataset*)malloc(sizeof(MNIST_Dataset));
+    
+    dataset->imageMap = mapFile(imageFileName, &dataset->imageMapSize);
+    dataset->labelMap = mapFile(labelFileName, &dataset->labelMapSize);
+    
+    // Images are stored as count x [height x] width pixels (2 or 3 dimensions), labels as count bytes (1 dimension)
+    uint32_t imageDims[IDX_MAX_DIMENSIONS];
+    uint32_t labelDims[IDX_MAX_DIMENSIONS];
+    int imageDimCount, labelDimCount;
+    
+    dataset->pixels = readIDXHeader(dataset->imageMap, dataset->imageMapSize, 2, 3, imageDims, &imageDimCount, imageFileName);
+    dataset->labels = readIDXHeader(dataset->labelMap, dataset->labelMapSize, 1, 1, labelDims, &labelDimCount, labelFileName);
+    
+    setDatasetDimensions(dataset, imageDims, imageDimCount, labelDims, imageFileName, labelFileName);
+    
+    dataset->inputs      = NULL;
+    dataset->order       = NULL;
+    dataset->imageStream = NULL;
+    dataset->labelStream = NULL;
+    
+    return dataset;
+}
+
+
+
+
+/**
+ * @brief Returns whether a data set is read sequentially from (gzip-compressed) streams instead of random access
+ * @param dataset A pointer to the data set
+ */
+
+int isStreamedDataset(MNIST_Dataset *dataset){
+    
+    return (dataset->imageStream != NULL);
+}
+
+
+
+
+/**
+ * @brief Positions the streams of a streamed data set back at its first image and label
+ * @param dataset A pointer to the (streamed) data set
+ */
+
+void rewindDatasetStream(MNIST_Dataset *dataset){
+    
+    if (gzseek(dataset->imageStream, dataset->imageStreamStart, SEEK_SET) == -1 ||
+        gzseek(dataset->labelStream, dataset->labelStreamStart, SEEK_SET) == -1) {
+        printf("Abort! Could not rewind compressed MNIST files\n");
+        exit(1);
+    }
+}
+
+
+
+
+/**
+ * @brief Decompresses the next images and labels of a streamed data set into caller-provided buffers
+ * @param dataset A pointer to the (streamed) data set
+ * @param count Number of images (and labels) to be read
+ * @param pixels A pointer to a buffer that can hold count x dataset->imageSize pixels
+ * @param labels A pointer to a buffer that can hold count labels
+ */
+
+void readDatasetStream(MNIST_Dataset *dataset, int count, uint8_t *pixels, MNIST_Label *labels){
+    
+    size_t pixelCount = (size_t)count * dataset->imageSize;
+    
+    // gzread reads at most INT_MAX bytes at a time
+    while (pixelCount > 0){
+        unsigned chunk = (pixelCount > (1u<<30)) ? (1u<<30) : (unsigned)pixelCount;
+        if (gzread(dataset->imageStream, pixels, chunk) != (int)chunk) {
+            printf("Abort! Compressed MNIST image file is truncated or corrupt\n");
+            exit(1);
+        }
+        pixels += chunk;
+        pixelCount -= chunk;
+    }
+    
+    if (gzread(dataset->labelStream, labels, count * sizeof(MNIST_Label)) != (int)(count * sizeof(MNIST_Label))) {
+        printf("Abort! Compressed MNIST label file is truncated or corrupt\n");
+        exit(1);
+    }
+}
+
+
+
+
+/**
+ * @brief Returns the byte offset of the labels inside a cache file
+ * @param cfh A pointer to the cache file header
+ */
+
+size_t getCacheLabelOffset(MNIST_CacheFileHeader *cfh){
+    
+    return sizeof(MNIST_CacheFileHeader) + ((size_t)cfh->count * cfh->imageSize * cfh->valueSize);
+}
+
+
+
+
+/**
+ * @brief Returns the byte offset of the (optional) sample order inside a cache file
+ * @details The order is aligned to 4 bytes.
+ * @param cfh A pointer to the cache file header
+ */
+
+size_t getCacheOrderOffset(MNIST_CacheFileHeader *cfh){
+    
+    size_t offset = getCacheLabelOffset(cfh) + ((size_t)cfh->count * sizeof(MNIST_Label));
+    
+    return (offset + sizeof(int32_t) - 1) & ~(sizeof(int32_t) - 1);
+}
+
+
+
+
+/**
+ * @brief Opens a pre-normalized cache file as a memory-mapped data set
+ * @details Aborts if the file is invalid or was written with a different floating point precision.
+ * @param fileName The name of the cache file
+ */
+
+MNIST_Dataset *openMNISTCache(char *fileName){
+    
+    MNIST_Dataset *dataset = (MNIST_Dataset*)malloc(sizeof(MNIST_Dataset));
+    
+    dataset->imageMap = mapFile(fileName, &dataset->imageMapSize);
+    dataset->labelMap = NULL;
+    dataset->labelMapSize = 0;
+    
+    MNIST_CacheFileHeader *cfh = (MNIST_CacheFileHeader*)dataset->imageMap;
+    
+    if (dataset->imageMapSize < sizeof(MNIST_CacheFileHeader) || cfh->magicNumber != MNIST_CACHE_FILE_MAGIC_NUMBER) {
+        printf("Abort! Invalid MNIST cache file: %s\n",fileName);
+        exit(1);
+    }
+    
+    if (cfh->valueSize != sizeof(Real)) {
+        printf("Abort! MNIST cache file was written for a different precision (rerun mnist-cache): %s\n",fileName);
+        exit(1);
+    }
+    
+    // Cache files written before the image geometry was stored hold no width/height (=0)
+    if (cfh->imgWidth == 0 || cfh->imgHeight == 0 || cfh->imageSize != cfh->imgWidth * cfh->imgHeight) {
+        printf("Abort! MNIST cache file has an outdated format or invalid image size (rerun mnist-cache): %s\n",fileName);
+        exit(1);
+    }
+    
+    size_t fileSize = getCacheOrderOffset(cfh) + (cfh->hasOrder ? (size_t)cfh->count * sizeof(int32_t) : 0);
+    
+    if (dataset->imageMapSize < fileSize) {
+        printf("Abort! MNIST cache file is truncated: %s\n",fileName);
+        exit(1);
+    }
+    
+    dataset->count     = cfh->count;
+    dataset->imgWidth  = cfh->imgWidth;
+    dataset->imgHeight = cfh->imgHeight;
+    dataset->imageSize = cfh->imageSize;
+    dataset->pixels    = NULL;
+    dataset->inputs    = (const Real*)((uint8_t*)dataset->imageMap + sizeof(MNIST_CacheFileHeader));
+    dataset->labels    = (const MNIST_Label*)((uint8_t*)dataset->imageMap + getCacheLabelOffset(cfh));
+    dataset->order     = cfh->hasOrder ? (const int*)((uint8_t*)dataset->imageMap + getCacheOrderOffset(cfh)) : NULL;
+    dataset->imageStream = NULL;
+    dataset->labelStream = NULL;
+    
+    // The stored order is used as image positions by the loader, i.e. it must not point outside of the data set
+    for (int i=0; dataset->order != NULL && i<dataset->count; i++){
+        if (dataset->order[i] < 0 || dataset->order[i] >= dataset->count) {
+            printf("Abort! MNIST cache file holds an invalid sample order (rerun mnist-cache): %s\n",fileName);
+            exit(1);
+        }
+    }
+    
+    return dataset;
+}
+
+
+
+
+/**
+ * @brief Opens the pre-normalized cache file of a data set if it exists, and otherwise its MNIST image and label files
+ * @param cacheFileName The name of the cache file (NULL = don't use a cache file)
+ * @param imageFileName The name of the MNIST image file
+ * @param labelFileName The name of the MNIST label file
+ */
+
+MNIST_Dataset *openCachedMNISTDataset(char *cacheFileName, char *imageFileName, char *labelFileName){
+    
+    if (cacheFileName != NULL && access(cacheFileName, R_OK) == 0) return openMNISTCache(cacheFileName);
+    
+    return openMNISTDataset(imageFileName, labelFileName);
+}
+
+
+
+
+/**
+ * @brief Writes all images of a data set, normalized, together with their labels into a cache file
+ * @param dataset A pointer to the data set
+ * @param order An array of dataset->count sample positions to be stored as fixed sample order (or NULL)
+ * @param fileName The name of the cache file
+ */
+
+void writeMNISTCache(MNIST_Dataset *dataset, const int *order, char *fileName){
+    
+    if (dataset->pixels == NULL) {
+        printf("Abort! MNIST cache files can only be written from uncompressed MNIST files: %s\n",fileName);
+        exit(1);
+    }
+    
+    FILE *cacheFile = fopen(fileName, "wb");
+    if (cacheFile == NULL) {
+        printf("Abort! Could not create MNIST cache file: %s\n",fileName);
+        exit(1);
+    }
+    
+    MNIST_CacheFileHeader cfh;
+    memset(&cfh, 0, sizeof(cfh));
+    cfh.magicNumber = MNIST_CACHE_FILE_MAGIC_NUMBER;
+    cfh.valueSize   = sizeof(Real);
+    cfh.count       = dataset->count;
+    cfh.imageSize   = dataset->imageSize;
+    cfh.imgWidth    = dataset->imgWidth;
+    cfh.imgHeight   = dataset->imgHeight;
+    cfh.hasOrder    = (order != NULL);
+    
+    int ok = (fwrite(&cfh, sizeof(cfh), 1, cacheFile) == 1);
+    
+    Real *vals = (Real*)malloc(dataset->imageSize * sizeof(Real));
+    
+    for (int i=0; i<dataset->count && ok; i++){
+        normalizePixels(getDatasetPixels(dataset, i), dataset->imageSize, vals);
+        ok = (fwrite(vals, sizeof(Real), dataset->imageSize, cacheFile) == (size_t)dataset->imageSize);
+    }
+    
+    free(vals);
+    
+    if (ok) ok = (fwrite(dataset->labels, sizeof(MNIST_Label), dataset->count, cacheFile) == (size_t)dataset->count);
+    
+    if (ok && order != NULL){
+        // Pad the labels so that the order is aligned to 4 bytes
+        size_t padding = getCacheOrderOffset(&cfh) - getCacheLabelOffset(&cfh) - dataset->count * sizeof(MNIST_Label);
+        uint8_t zeros[sizeof(int32_t)] = {0};
+        
+        ok = (fwrite(zeros, 1, padding, cacheFile) == padding) &&
+             (fwrite(order, sizeof(int32_t), dataset->count, cacheFile) == (size_t)dataset->count);
+    }
+    
+    if (fclose(cacheFile) != 0 || !ok) {
+        printf("Abort! Could not write MNIST cache file: %s\n",fileName);
+        exit(1);
+    }
+}
+
+
+
+
+/**
+ * @brief Unmaps (or closes) the files of a data set and frees the data set
+ * @param dataset A pointer to the data set that is to be closed
+ */
+
+void closeMNISTDataset(MNIST_Dataset *dataset){
+    
+    if (dataset->imageMap != NULL) munmap(dataset->imageMap, dataset->imageMapSize);
+    if (dataset->labelMap != NULL) munmap(dataset->labelMap, dataset->labelMapSize);
+    
+    if (dataset->imageStream != NULL) gzclose(dataset->imageStream);
+    if (dataset->labelStream != NULL) gzclose(dataset->labelStream);
+    
+    free(dataset);
+}
+
+
+
+
+/**
+ * @brief Returns a pointer to the pixels of the image at the given position of a data set (without copying the image)
+ * @param dataset A pointer to the data set
+ * @param position The index of the image (0 to dataset->count-1)
+ */
+
+const uint8_t *getDatasetPixels(MNIST_Dataset *dataset, int position){
+    
+    return dataset->pixels + ((size_t)position * dataset->imageSize);
+}
+
+
+
+
+/**
+ * @brief Returns the label at the given position of a data set
+ * @param dataset A pointer to the data set
+ * @param position The index of the label (0 to dataset->count-1)
+ */
+
+MNIST_Label getDatasetLabel(MNIST_Dataset *dataset, int position){
+    
+    return dataset->labels[position];
+}
+
+
+
+
+/**
+ * @brief Returns a pointer to the normalized values of the image at the given position of a cached data set
+ * @param dataset A pointer to the data set (opened from a cache file)
+ * @param position The index of the image (0 to dataset->count-1)
+ */
+
+const Real *getDatasetInputs(MNIST_Dataset *dataset, int position){
+    
+    return dataset->inputs + ((size_t)position * dataset->imageSize);
+}
+
+
+
+
+/**
+ * @brief Writes the normalized pixels of a given MNIST image into a caller-provided array
+ * @details Each pixel's grey shade (0-255) is centered around 0 and scaled to -1..+1. No memory is allocated,
+ * i.e. the values can be written directly into a preallocated buffer (e.g. the network's input layer).
+ * @param img A pointer to a MNIST image
+ * @param vals A pointer to an array that can hold MNIST_IMG_WIDTH * MNIST_IMG_HEIGHT values
+ */
+
+void normalizeImage(const MNIST_Image *img, Real *vals){
+    
+    normalizePixels(img->pixel, MNIST_IMG_WIDTH*MNIST_IMG_HEIGHT, vals);
+    
+}
+
+
+
+
+/**
+ * @brief Writes a given number of normalized pixels into a caller-provided array
+ * @details Each pixel's grey shade (0-255) is centered around 0 and scaled to -1..+1.
+ * @param pixels A pointer to the pixels of an image
+ * @param count Number of pixels
+ * @param vals A pointer to an array that can hold count values
+ */
+
+void normalizePixels(const uint8_t *pixels, int count, Real *vals){
+    
+    for (int i=0; i<count; i++)
+        //        vals[i] = ((double)pixels[i]/255);     // Image pixels' grey shades (0-255) are normalized to 0-1
+        // Pre-processing the input data: subtract mean and normalize
+        vals[i] = ((Real)(pixels[i]-127)/128);
+    
+}
+
+
+
+
 /**
  * @brief Returns a Vector holding the image pixels of a given MNIST image
+ * @attention The vector is allocated on the heap and must be freed by the caller.
+ * Use normalizeImage() to write the pixels into a preallocated buffer instead.
  * @param img A pointer to a MNIST image
  */
 
 Vector *getVectorFromImage(MNIST_Image *img){
     
-    Vector *v = (Vector*)malloc(sizeof(Vector) + (MNIST_IMG_WIDTH*MNIST_IMG_HEIGHT * sizeof(double)));
+    Vector *v = (Vector*)malloc(sizeof(Vector) + (MNIST_IMG_WIDTH*MNIST_IMG_HEIGHT * sizeof(Real)));
     
     v->count = MNIST_IMG_WIDTH*MNIST_IMG_HEIGHT;
     
-    for (int i=0;i<v->count;i++)
-        //        v->vals[i] = ((double)img->pixel[i]/255);     // Image pixels' grey shades (0-255) are normalized to 0-1
-        // Pre-processing the input data: subtract mean and normalize
-        v->vals[i] = ((double)(img->pixel[i]-127)/128);
+    normalizeImage(img, v->vals);
     
     return v;
 }
-
@@ -15,6 +15,7 @@
 // Include external libraries
 #include <stdint.h>
 #include <stdio.h>
+#include <zlib.h>
 
 // Define locations of MNIST data set files
 #define MNIST_TRAINING_SET_IMAGE_FILE_NAME "./data/train-images-idx3-ubyte"
@@ -22,6 +23,15 @@
 #define MNIST_TESTING_SET_IMAGE_FILE_NAME "./data/t10k-images-idx3-ubyte"
 #define MNIST_TESTING_SET_LABEL_FILE_NAME "./data/t10k-labels-idx1-ubyte"
 
+// Define locations of the pre-normalized cache files (one per floating point precision, see cache.c)
+#ifdef USE_FLOAT
+#define MNIST_TRAINING_SET_CACHE_FILE_NAME "./data/train-normalized-f32.cache"
+#define MNIST_TESTING_SET_CACHE_FILE_NAME "./data/t10k-normalized-f32.cache"
+#else
+#define MNIST_TRAINING_SET_CACHE_FILE_NAME "./data/train-normalized-f64.cache"
+#define MNIST_TESTING_SET_CACHE_FILE_NAME "./data/t10k-normalized-f64.cache"
+#endif
+
 /// Define number datasets (images+labels) in the TRAIN file/s
 #define MNIST_MAX_TRAINING_IMAGES 60000
 
@@ -32,27 +42,49 @@
 #define MNIST_IMG_WIDTH 28
 #define MNIST_IMG_HEIGHT 28
 
+// Define the data type code of IDX files holding unsigned bytes (the only type supported) and the maximum number of dimensions
+#define IDX_UNSIGNED_BYTE_TYPE 0x08
+#define IDX_MAX_DIMENSIONS 8
+
+// Define the size of the decompression buffer used when reading gzip-compressed data set files
+#define MNIST_STREAM_BUFFER_SIZE (1<<20)
+
+// Define the magic number identifying a pre-normalized cache file ("MNCA")
+#define MNIST_CACHE_FILE_MAGIC_NUMBER 0x4D4E4341
+
 
 
 typedef struct MNIST_ImageFileHeader MNIST_ImageFileHeader;
 typedef struct MNIST_LabelFileHeader MNIST_LabelFileHeader;
+typedef struct MNIST_CacheFileHeader MNIST_CacheFileHeader;
 
 typedef struct MNIST_Image MNIST_Image;
 typedef uint8_t MNIST_Label;
 
+typedef struct MNIST_Dataset MNIST_Dataset;
+
 
 typedef struct Vector Vector;
 
 
+/// Define the floating point type of all network values, i.e. weights, activations, errors and input vectors
+/// (compile with -DUSE_FLOAT to build the single-precision/float32 variant of the network)
+#ifdef USE_FLOAT
+typedef float Real;
+#else
+typedef double Real;
+#endif
+
+
 
 
 /**
- * @brief Variably-sized data structure defining a vector with "count" doubles
+ * @brief Variably-sized data structure defining a vector with "count" real (float or double) values
  */
 
 struct Vector{
     int count;              // number of values in the vector
-    double vals[];          // array of values inside the vector
+    Real vals[];            // array of values inside the vector
 };
 
 
@@ -103,6 +135,61 @@ struct MNIST_LabelFileHeader{
 
 
 
+/**
+ * @brief Data block defining the header of a pre-normalized cache file
+ * @details A cache file contains all images already normalized (as float or double values) followed by
+ * all labels and an optional fixed sample order. Numbers are stored in the machine's native byte order.
+ * The header is padded to 64 bytes so that the normalized images are aligned to cache lines.
+ */
+
+struct MNIST_CacheFileHeader{
+    uint32_t magicNumber;           // MNIST_CACHE_FILE_MAGIC_NUMBER
+    uint32_t valueSize;             // byte size of a normalized value (4=float, 8=double)
+    uint32_t count;                 // number of images (=number of labels)
+    uint32_t imageSize;             // number of values per image
+    uint32_t hasOrder;              // 1 if the file contains a fixed sample order, 0 if not
+    uint32_t imgWidth;              // width of each image in pixels
+    uint32_t imgHeight;             // height of each image in pixels
+    uint32_t reserved[9];           // padding to 64 bytes
+};
+
+
+
+
+/**
+ * @brief Data structure giving random access to a memory-mapped pair of IDX image and label files
+ * @details Both files are mapped into memory once when the data set is opened. Images and labels are then
+ * accessed in place (zero-copy), i.e. without any system calls or copying, in any order and from any thread.
+ * The number and size of the images are taken from the file headers, i.e. any IDX data set (MNIST, EMNIST,
+ * Fashion-MNIST, ...) can be used. Since the operating system only pages in the parts of the files that are
+ * accessed (and evicts them again under memory pressure), data sets may also be larger than the RAM.
+ * A data set opened from a pre-normalized cache file provides normalized inputs instead of raw images.
+ * Gzip-compressed files can not be mapped; they are opened as streams that are decompressed front to back
+ * (see readDatasetStream()) and hence only support sequential access.
+ */
+
+struct MNIST_Dataset{
+    int count;                      // number of images (=number of labels) in the data set
+    int imgWidth;                   // width of each image in pixels
+    int imgHeight;                  // height of each image in pixels
+    int imageSize;                  // number of pixels per image
+    const uint8_t *pixels;          // pointer to the first image inside the mapped image file (NULL for a cache)
+    const MNIST_Label *labels;      // pointer to the first label inside the mapped label file
+    const Real *inputs;             // pointer to the first normalized image inside a mapped cache file (or NULL)
+    const int *order;               // fixed sample order stored in a mapped cache file (or NULL)
+    gzFile imageStream;             // gzip-compressed image file stream (or NULL if the file is mapped)
+    gzFile labelStream;             // gzip-compressed label file stream (or NULL if the file is mapped)
+    z_off_t imageStreamStart;       // (uncompressed) position of the first image in the image file stream
+    z_off_t labelStreamStart;       // (uncompressed) position of the first label in the label file stream
+    void *imageMap;                 // start of the mapped image file
+    void *labelMap;                 // start of the mapped label file
+    size_t imageMapSize;            // byte size of the mapped image file
+    size_t labelMapSize;            // byte size of the mapped label file
+};
+
+
+
+
 /**
  * @brief Returns a file pointer to the MNIST image file
  * @details Opens the file and moves the read pointer to the position of the 1st image
@@ -159,8 +246,174 @@ MNIST_Label getLabelByPosition(FILE *labelFile, int position);
 
 
 
+/**
+ * @brief Opens a pair of IDX image and label files (e.g. the MNIST files) as a memory-mapped data set
+ * @details Reads the number of images and their size from the file headers and aborts if the files are
+ * missing, truncated, not unsigned byte IDX files or do not match each other. Files ending in ".gz" are
+ * opened as gzip-compressed streams instead (see openMNISTStream()).
+ * @param imageFileName The name of the MNIST image file
+ * @param labelFileName The name of the MNIST label file
+ */
+
+MNIST_Dataset *openMNISTDataset(char *imageFileName, char *labelFileName);
+
+
+
+
+/**
+ * @brief Opens a pair of gzip-compressed IDX image and label files as a sequentially readable data set
+ * @details The files are decompressed incrementally while they are read (see readDatasetStream()),
+ * i.e. an uncompressed copy never needs to exist on disk or in memory.
+ * @param imageFileName The name of the gzip-compressed image file
+ * @param labelFileName The name of the (gzip-compressed) label file
+ */
+
+MNIST_Dataset *openMNISTStream(char *imageFileName, char *labelFileName);
+
+
+
+
+/**
+ * @brief Returns whether a data set is read sequentially from (gzip-compressed) streams instead of random access
+ * @param dataset A pointer to the data set
+ */
+
+int isStreamedDataset(MNIST_Dataset *dataset);
+
+
+
+
+/**
+ * @brief Positions the streams of a streamed data set back at its first image and label
+ * @param dataset A pointer to the (streamed) data set
+ */
+
+void rewindDatasetStream(MNIST_Dataset *dataset);
+
+
+
+
+/**
+ * @brief Decompresses the next images and labels of a streamed data set into caller-provided buffers
+ * @param dataset A pointer to the (streamed) data set
+ * @param count Number of images (and labels) to be read
+ * @param pixels A pointer to a buffer that can hold count x dataset->imageSize pixels
+ * @param labels A pointer to a buffer that can hold count labels
+ */
+
+void readDatasetStream(MNIST_Dataset *dataset, int count, uint8_t *pixels, MNIST_Label *labels);
+
+
+
+
+/**
+ * @brief Unmaps (or closes) the files of a data set and frees the data set
+ * @param dataset A pointer to the data set that is to be closed
+ */
+
+void closeMNISTDataset(MNIST_Dataset *dataset);
+
+
+
+
+/**
+ * @brief Returns a pointer to the pixels of the image at the given position of a data set (without copying the image)
+ * @param dataset A pointer to the data set
+ * @param position The index of the image (0 to dataset->count-1)
+ */
+
+const uint8_t *getDatasetPixels(MNIST_Dataset *dataset, int position);
+
+
+
+
+/**
+ * @brief Returns the label at the given position of a data set
+ * @param dataset A pointer to the data set
+ * @param position The index of the label (0 to dataset->count-1)
+ */
+
+MNIST_Label getDatasetLabel(MNIST_Dataset *dataset, int position);
+
+
+
+
+/**
+ * @brief Opens a pre-normalized cache file as a memory-mapped data set
+ * @details Aborts if the file is invalid or was written with a different floating point precision.
+ * @param fileName The name of the cache file
+ */
+
+MNIST_Dataset *openMNISTCache(char *fileName);
+
+
+
+
+/**
+ * @brief Opens the pre-normalized cache file of a data set if it exists, and otherwise its MNIST image and label files
+ * @param cacheFileName The name of the cache file (NULL = don't use a cache file)
+ * @param imageFileName The name of the MNIST image file
+ * @param labelFileName The name of the MNIST label file
+ */
+
+MNIST_Dataset *openCachedMNISTDataset(char *cacheFileName, char *imageFileName, char *labelFileName);
+
+
+
+
+/**
+ * @brief Writes all images of a data set, normalized, together with their labels into a cache file
+ * @param dataset A pointer to the data set
+ * @param order An array of dataset->count sample positions to be stored as fixed sample order (or NULL)
+ * @param fileName The name of the cache file
+ */
+
+void writeMNISTCache(MNIST_Dataset *dataset, const int *order, char *fileName);
+
+
+
+
+/**
+ * @brief Returns a pointer to the normalized values of the image at the given position of a cached data set
+ * @param dataset A pointer to the data set (opened from a cache file)
+ * @param position The index of the image (0 to dataset->count-1)
+ */
+
+const Real *getDatasetInputs(MNIST_Dataset *dataset, int position);
+
+
+
+
+/**
+ * @brief Writes a given number of normalized pixels into a caller-provided array
+ * @details Each pixel's grey shade (0-255) is centered around 0 and scaled to -1..+1.
+ * @param pixels A pointer to the pixels of an image
+ * @param count Number of pixels
+ * @param vals A pointer to an array that can hold count values
+ */
+
+void normalizePixels(const uint8_t *pixels, int count, Real *vals);
+
+
+
+
+/**
+ * @brief Writes the normalized pixels of a given MNIST image into a caller-provided array
+ * @details Each pixel's grey shade (0-255) is centered around 0 and scaled to -1..+1. No memory is allocated,
+ * i.e. the values can be written directly into a preallocated buffer (e.g. the network's input layer).
+ * @param img A pointer to a MNIST image
+ * @param vals A pointer to an array that can hold MNIST_IMG_WIDTH * MNIST_IMG_HEIGHT values
+ */
+
+void normalizeImage(const MNIST_Image *img, Real *vals);
+
+
+
+
 /**
  * @brief Returns a Vector holding the image pixels of a given MNIST image
+ * @attention The vector is allocated on the heap and must be freed by the caller.
+ * Use normalizeImage() to write the pixels into a preallocated buffer instead.
  * @param img A pointer to a MNIST image
  */
 